@@ -0,0 +1,160 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Runtime.InteropServices;
+using System.Text;
+using System.Threading;
+
+namespace FlashC167
+{
+    /// <summary>
+    /// Reads the progress and log events of the DLL on a thread of its own, so the
+    /// threads sending the download never wait on the console or on the log files
+    /// </summary>
+    internal class FlashEvents
+    {
+        // EVENT_xxx and EVENT_TEXT_BYTES of the DLL
+        private const Int32 EventProgress = 1;
+        private const Int32 EventResult = 2;
+        private const Int32 EventLog = 3;
+        private const Int32 EventTextBytes = 336;
+
+        // The DLL keeps 128 events per board. A download posts a progress event for
+        // every 0.1%; while fewer than 10 slots are free the DLL drops them, never
+        // the result and log lines, so a late poll only skips percentages
+        private const Int32 PollMs = 100;
+
+        // Longest wait at the end for the log lines still being written
+        private const Int32 LogWaitMs = 5000;
+
+        private const String NetworkLogFile = "p:\\users\\smail\\flashlog\\flash.log";
+        private const String LocalLogFile = "flash.log";
+
+        [DllImport ("FlashSourcesDLL.dll")]
+        public static extern void EnableFlashEvents (Int32 enable);
+
+        [DllImport ("FlashSourcesDLL.dll")]
+        public static extern Int32 GetFlashEvent (out Int32 comPort, out Int32 type, out Int32 value,
+                                                  StringBuilder text, Int32 textSize);
+
+        private Thread pollThread;
+        private volatile Boolean stopping;
+
+        // Last percentage (0.1% units) or result text of every board, by COM port
+        private SortedDictionary<Int32, String> boardStatus = new SortedDictionary<Int32, String> ();
+        private StringBuilder eventText = new StringBuilder (EventTextBytes);
+
+        // Log lines handed to the thread pool and not written yet
+        private Int32 pendingLogLines;
+        private Object logFileLock = new Object ();
+
+        // Call this from program.cs before FlashMain
+        public void Start ()
+        {
+            EnableFlashEvents (1);
+            stopping = false;
+            pollThread = new Thread (Poll);
+            pollThread.IsBackground = true;
+            pollThread.Start ();
+        }
+
+        // Call this from program.cs after FlashMain; the events left are read and
+        // the log lines written (or given up on after LogWaitMs)
+        public void Stop ()
+        {
+            stopping = true;
+            pollThread.Join ();
+            ReadEvents ();
+            EnableFlashEvents (0);
+
+            DateTime giveUp = DateTime.Now.AddMilliseconds (LogWaitMs);
+            while ((Thread.VolatileRead (ref pendingLogLines) > 0) && (DateTime.Now < giveUp))
+            {
+                Thread.Sleep (10);
+            }
+        }
+
+        private void Poll ()
+        {
+            while (stopping == false)
+            {
+                ReadEvents ();
+                Thread.Sleep (PollMs);
+            }
+        }
+
+        // Empties the DLL's event rings; the console title shows the progress of
+        // every board
+        private void ReadEvents ()
+        {
+            Int32 comPort;
+            Int32 type;
+            Int32 value;
+            Boolean statusChanged = false;
+
+            while (GetFlashEvent (out comPort, out type, out value, eventText, EventTextBytes) == 1)
+            {
+                if (type == EventProgress)
+                {
+                    boardStatus[comPort] = (value / 10).ToString () + "." + (value % 10).ToString () + "%";
+                    statusChanged = true;
+                }
+                else if (type == EventResult)
+                {
+                    boardStatus[comPort] = (value == 0) ? "done" : "error " + value.ToString ();
+                    statusChanged = true;
+                }
+                else if (type == EventLog)
+                {
+                    // text mode fprintf wrote the line with CR LF
+                    WriteLogLine (eventText.ToString ().TrimEnd ('\n') + Environment.NewLine);
+                }
+            }
+
+            if (statusChanged == true)
+            {
+                StringBuilder title = new StringBuilder ();
+                foreach (KeyValuePair<Int32, String> board in boardStatus)
+                {
+                    title.Append ("COM" + board.Key.ToString () + " " + board.Value + "  ");
+                }
+                try
+                {
+                    Console.Title = title.ToString ().TrimEnd ();
+                }
+                catch (IOException)
+                {
+                    // no console window
+                }
+            }
+        }
+
+        // The network share can take seconds to open, so the line is written by
+        // the thread pool
+        private void WriteLogLine (String aLine)
+        {
+            Interlocked.Increment (ref pendingLogLines);
+            ThreadPool.QueueUserWorkItem (delegate (Object state)
+            {
+                lock (logFileLock)
+                {
+                    AppendLine (NetworkLogFile, aLine);
+                    AppendLine (LocalLogFile, aLine);
+                }
+                Interlocked.Decrement (ref pendingLogLines);
+            });
+        }
+
+        private static void AppendLine (String aFileName, String aLine)
+        {
+            try
+            {
+                File.AppendAllText (aFileName, aLine);
+            }
+            catch (Exception)
+            {
+                // as before, a log file that cannot be opened is skipped
+            }
+        }
+    }
+}
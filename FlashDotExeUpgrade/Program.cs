@@ -8,6 +8,9 @@ namespace FlashC167
         [DllImport("FlashSourcesDLL.dll")]
         public static extern Int32 FlashMain(Int32 argc, String[] argv);
 
+        [DllImport("FlashSourcesDLL.dll")]
+        public static extern Int32 GetPortResult(Int32 comPort);
+
         // .NET came into play to support faster downloads with XP machines. All legacy code
         //  wrapped in a DLL. Serial ports were changed over to .NET to increase download speed.
         private static void Main(string[] args)
@@ -20,6 +23,24 @@ namespace FlashC167
 
             sc.SerialDLLInit();
 
+            // "1,3,5" as the COM port flashes the boards on all of them at the same time;
+            // each port gets its own serial port object
+            String[] gangPorts = args[0].Split(',');
+            SerComm[] gangComms = new SerComm[0];
+            if (gangPorts.Length > 1)
+            {
+                gangComms = new SerComm[gangPorts.Length];
+                for (Int32 i = 0; i < gangPorts.Length; i++)
+                {
+                    gangComms[i] = new SerComm();
+                    UInt16 port;
+                    if (UInt16.TryParse(gangPorts[i], out port))
+                    {
+                        gangComms[i].SerialDLLInitPort(port);
+                    }
+                }
+            }
+
             // MVB boards are designed differently such that a different access to RAM and FLASH are needed in the
             // C167; therefore stage2x is used for those type boards (such as the MVB)
             Boolean useStage2MV = false;
@@ -42,17 +63,46 @@ namespace FlashC167
             // The last argument is always the Path to where Flash_Result.txt will be written
             string PathFileName = args[args.Length - 1];
 
+            // Progress and the flash.log lines come back as events read on another thread,
+            // so the download never waits on the console or the network share
+            FlashEvents events = new FlashEvents();
+            events.Start();
+
             // Link to legacy code via DLL call
             // Since the last arg (Path) is exclusively used here, just subtract 1 from the args length so that the DLL
             // doesn't even know about it
             Int32 retVal = FlashMain((Int32)args.Length - 1, args);
 
-            // Update error code file with the return value
+            events.Stop();
+
+            // Update error code file with the return value; a gang adds the result of each port
             string retValText = "1[" + retVal.ToString("D3") + "]" + System.Environment.NewLine;
+            if (gangComms.Length > 0)
+            {
+                foreach (String port in gangPorts)
+                {
+                    Int32 portNumber;
+                    if (Int32.TryParse(port, out portNumber))
+                    {
+                        retValText += "COM" + port + "[" + GetPortResult(portNumber).ToString("D3") + "]" +
+                                      System.Environment.NewLine;
+                    }
+                }
+            }
 
             System.IO.File.WriteAllText(PathFileName, retValText);
 
-            sc.Close();
+            if (gangComms.Length > 0)
+            {
+                foreach (SerComm comm in gangComms)
+                {
+                    comm.Close();
+                }
+            }
+            else
+            {
+                sc.Close();
+            }
 
             Console.WriteLine("Press any key to continue...");
             Console.ReadKey();
@@ -1,4 +1,5 @@
 ﻿using System;
+using System.Diagnostics;
 using System.IO.Ports;
 using System.Runtime.InteropServices;
 
@@ -17,9 +18,25 @@ namespace FlashC167
 
         public delegate Int32 RxCharDelegate ();
 
+        public delegate void TxBufferDelegate (IntPtr aTxBuf, Int32 aLength);
+
+        public delegate Int32 RxBufferDelegate (IntPtr aRxBuf, Int32 aLength, Int32 aTimeoutMs);
+
+        public delegate void FlushDelegate ();
+
+        public delegate void SetBaudDelegate (Int32 aBaudRate);
+
         private InitDelegate InitDG;
         private TxCharDelegate TxCharDG;
         private RxCharDelegate RxCharDG;
+        private TxBufferDelegate TxBufferDG;
+        private RxBufferDelegate RxBufferDG;
+        private FlushDelegate FlushDG;
+        private SetBaudDelegate SetBaudDG;
+
+        // Reused between calls so a block write doesn't allocate
+        private Byte[] txBuffer = new Byte[0];
+        private Byte[] rxBuffer = new Byte[0];
 
         [DllImport ("FlashSourcesDLL.dll")]
         public static extern void SetInitComCallback (InitDelegate func);
@@ -30,6 +47,25 @@ namespace FlashC167
         [DllImport ("FlashSourcesDLL.dll")]
         public static extern void SetRxCharCallback (RxCharDelegate fn);
 
+        [DllImport ("FlashSourcesDLL.dll")]
+        public static extern void SetTxBufferCallback (TxBufferDelegate fn);
+
+        [DllImport ("FlashSourcesDLL.dll")]
+        public static extern void SetRxBufferCallback (RxBufferDelegate fn);
+
+        [DllImport ("FlashSourcesDLL.dll")]
+        public static extern void SetFlushCallback (FlushDelegate fn);
+
+        [DllImport ("FlashSourcesDLL.dll")]
+        public static extern void SetBaudCallback (SetBaudDelegate fn);
+
+        [DllImport ("FlashSourcesDLL.dll")]
+        public static extern void SetPortCallbacks (Int32 aComPort, InitDelegate initFn,
+                                                    TxBufferDelegate txBufferFn,
+                                                    RxBufferDelegate rxBufferFn,
+                                                    FlushDelegate flushFn,
+                                                    SetBaudDelegate setBaudFn);
+
         // Call this from program.cs
         public void SerialDLLInit ()
         {
@@ -39,6 +75,27 @@ namespace FlashC167
             SetTxCharCallback (TxCharDG);
             RxCharDG = new RxCharDelegate (Getc);
             SetRxCharCallback (RxCharDG);
+            TxBufferDG = new TxBufferDelegate (Write);
+            SetTxBufferCallback (TxBufferDG);
+            RxBufferDG = new RxBufferDelegate (Read);
+            SetRxBufferCallback (RxBufferDG);
+            FlushDG = new FlushDelegate (Flush);
+            SetFlushCallback (FlushDG);
+            SetBaudDG = new SetBaudDelegate (SetBaud);
+            SetBaudCallback (SetBaudDG);
+        }
+
+        // Call this from program.cs once per port when several boards are flashed
+        // at the same time; the DLL calls this object from the thread flashing
+        // aComPort only
+        public void SerialDLLInitPort (UInt16 aComPort)
+        {
+            InitDG = new InitDelegate (Init);
+            TxBufferDG = new TxBufferDelegate (Write);
+            RxBufferDG = new RxBufferDelegate (Read);
+            FlushDG = new FlushDelegate (Flush);
+            SetBaudDG = new SetBaudDelegate (SetBaud);
+            SetPortCallbacks (aComPort, InitDG, TxBufferDG, RxBufferDG, FlushDG, SetBaudDG);
         }
 
         // This is called from the DLL after desired com port and baud rate is
@@ -53,7 +110,11 @@ namespace FlashC167
 
         public void Close ()
         {
-            serialPort.Close ();
+            // a board of a gang may have failed before its port was opened
+            if (serialPort != null)
+            {
+                serialPort.Close ();
+            }
         }
 
         public void Putc (Byte tx)
@@ -76,5 +137,78 @@ namespace FlashC167
             }
             return rx;
         }
+
+        // Writes a whole buffer from the DLL with a single call into the serial port
+        public void Write (IntPtr aTxBuf, Int32 aLength)
+        {
+            if (txBuffer.Length < aLength)
+            {
+                txBuffer = new Byte[aLength];
+            }
+            Marshal.Copy (aTxBuf, txBuffer, 0, aLength);
+            serialPort.Write (txBuffer, 0, aLength);
+        }
+
+        // Reads up to aLength bytes into the DLL buffer; returns the number of bytes
+        // received before aTimeoutMs expired. Bytes already buffered by the driver are
+        // taken without waiting, even with a timeout of 0 or once the time is up; the
+        // timeout only ends the read when nothing is buffered.
+        public Int32 Read (IntPtr aRxBuf, Int32 aLength, Int32 aTimeoutMs)
+        {
+            Int32 numRead = 0;
+            Stopwatch sw = Stopwatch.StartNew ();
+
+            if (rxBuffer.Length < aLength)
+            {
+                rxBuffer = new Byte[aLength];
+            }
+
+            while (numRead < aLength)
+            {
+                Int32 buffered = serialPort.BytesToRead;
+                if (buffered > 0)
+                {
+                    numRead += serialPort.Read (rxBuffer, numRead, Math.Min (buffered, aLength - numRead));
+                    continue;
+                }
+
+                Int32 remainingMs = aTimeoutMs - (Int32)sw.ElapsedMilliseconds;
+                if (remainingMs <= 0)
+                {
+                    break;
+                }
+                serialPort.ReadTimeout = remainingMs;
+                try
+                {
+                    numRead += serialPort.Read (rxBuffer, numRead, aLength - numRead);
+                }
+                catch (TimeoutException)
+                {
+                    break;
+                }
+            }
+
+            serialPort.ReadTimeout = 20;
+            Marshal.Copy (rxBuffer, 0, aRxBuf, numRead);
+            return numRead;
+        }
+
+        // Returns after every byte written has been handed to the UART
+        public void Flush ()
+        {
+            serialPort.BaseStream.Flush ();
+            while (serialPort.BytesToWrite > 0)
+            {
+                System.Threading.Thread.Sleep (1);
+            }
+        }
+
+        // Called from the DLL when the target changes baud rate after the loader
+        // is running; the rate can exceed what Init's UInt16 argument can carry
+        public void SetBaud (Int32 aBaudRate)
+        {
+            serialPort.BaudRate = aBaudRate;
+            serialPort.DiscardInBuffer ();
+        }
     }
 }
\ No newline at end of file
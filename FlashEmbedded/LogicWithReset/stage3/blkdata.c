@@ -7,6 +7,10 @@
 *  Subsystem  : Third stage boot loader
 *  Procedures : Download_block_data
 *               Get_total_bytes
+*               Download_pipelined
+*               Download_verified
+*               Receive_verified
+*               Unpack_block
 *
 *  Abstract   :
 *  Compiler   :
@@ -18,11 +22,18 @@
 *  01 May 2000 D.Smail
 *    Created
 * Revised:
+*  17 Oct 2026
+*    Added the pipelined download mode
+*  17 Oct 2026
+*    Added the verified download mode
+*  17 Oct 2026
+*    SRAM addresses through HAL_ADDRESS (HAL.H)
+*  17 Oct 2026
+*    Added the packed 'x' blocks
 **************************************************************************/
 
-#include <reg167.h>
-
 #include "cpu_dep.h"
+#include "hal.h"
 #include "include.h"
 
 
@@ -107,7 +118,8 @@ void Download_block_data (struct interface_data_t *globs)
 
     /* Initialize variables */
     header_state = MSB_OF_MSW_FLASH_ADDRESS;
-    sram_ptr = (UINT_8 huge *)START_OF_DOWNLOAD_SRAM;
+    sram_ptr = (UINT_8 huge *)HAL_ADDRESS (START_OF_DOWNLOAD_SRAM);
+    hi_byte = 0;
 
     /* Init so that code remains in loop until byte_count constructed */
     byte_count = 1;
@@ -219,4 +231,513 @@ void Get_total_bytes (struct interface_data_t *globs)
 
 }
 
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Download_pipelined
+*
+*  ABSTRACT:
+*     Receive and program blocks until the PC sends an empty block
+*
+*  INPUTS:
+*
+*     Globals:
+*        None
+*
+*     Constants:
+*        START_OF_DOWNLOAD_SRAM
+*        FLASH_PROGRAM_SUCCESS
+*        PIPELINE_COMPLETE
+*
+*     Procedure Parameters:
+*        globs        struct interface_data_t *    shared variables
+*
+*  OUTPUTS:
+*
+*     Global Variables:
+*        None
+*
+*     Returned Value:
+*        PIPELINE_COMPLETE
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Replaces the 'b' / 'p' command pair so that the PC can send block N+1
+*  while block N is being programmed. Each block is preceded by a sequence
+*  number byte and then has the same format as in Download_block_data:
+*
+*         8  bit sequence number
+*         32 bit FLASH Address
+*         16 bit block size
+*         8  bit data
+*
+*  The address, size and data are stored at START_OF_DOWNLOAD_SRAM exactly
+*  as Download_block_data does, so Program_flash is used unchanged. The
+*  bytes of the next block that arrive during programming are held in the
+*  receive ring (see Rx_pump). After each block is programmed "*P" (or "$P"
+*  on failure) is sent followed by the sequence number of the block. A
+*  block size of 0 ends the mode; main then sends "*W". The sequence number
+*  bytes are not part of the total byte count.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+State_t Download_pipelined (struct interface_data_t *globs)
+{
+    UINT_8  seq;            /* sequence number of the current block */
+    UINT_8  i;
+    UINT_8  huge *sram_ptr; /* Used to store downloaded block data in RAM */
+    UINT_16 byte_count;     /* number of data bytes in the current block */
+    State_t state;          /* result of programming the block */
+
+    while (1)
+    {
+        seq = (UINT_8)io_getbyte();
+
+        /* 4 address bytes and 2 block size bytes */
+        sram_ptr = (UINT_8 huge *)HAL_ADDRESS (START_OF_DOWNLOAD_SRAM);
+        for (i = 0; i < 6; i++)
+        {
+            *sram_ptr++ = (UINT_8)io_getbyte();
+        }
+        byte_count = ((UINT_16) * (sram_ptr - 2) << 8) | * (sram_ptr - 1);
+
+        /* Empty block; end of download */
+        if (byte_count == 0)
+        {
+            break;
+        }
+
+        globs->total_bytes -= 6 + (UINT_32)byte_count;
+
+        while (byte_count != 0)
+        {
+            *sram_ptr++ = (UINT_8)io_getbyte();
+            byte_count--;
+        }
+
+        state = Program_flash (globs);
+
+        if (state == FLASH_PROGRAM_SUCCESS)
+        {
+            io_putbyte ('*');
+        }
+        else
+        {
+            io_putbyte ('$');
+        }
+        io_putbyte ('P');
+        io_putbyte (seq);
+    }
+
+    return (PIPELINE_COMPLETE);
+}
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Download_verified
+*
+*  ABSTRACT:
+*     Pipelined download in which every block carries a CRC and a bad
+*   block is sent again
+*
+*  INPUTS:
+*
+*     Globals:
+*        digest_table
+*
+*     Constants:
+*        START_OF_DOWNLOAD_SRAM
+*        PACKED_BLOCK_SRAM
+*        PACKED_BLOCK_FLAG
+*        MAX_PACKED_BYTES
+*        DIGEST_POLYNOMIAL
+*        VERIFY_TIMEOUT_LOOPS
+*        VERIFY_WINDOW
+*        FLASH_PROGRAM_SUCCESS
+*        FLASH_PROGRAM_ERROR
+*        PIPELINE_COMPLETE
+*
+*     Procedure Parameters:
+*        globs        struct interface_data_t *    shared variables
+*
+*  OUTPUTS:
+*
+*     Global Variables:
+*        digest_table
+*
+*     Returned Value:
+*        PIPELINE_COMPLETE after the empty block
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Same as Download_pipelined except that every block, the empty one
+*  included, is followed by a 32 bit CRC (MSB first):
+*
+*         8  bit sequence number
+*         32 bit FLASH Address
+*         16 bit block size
+*         8  bit data
+*         32 bit CRC
+*
+*  The CRC is the Crc_32_block byte loop with DIGEST_POLYNOMIAL, started
+*  at the sequence number, over the address, size and data. The sequence
+*  numbers start at 0 and go up by one per block.
+*
+*  If bit 15 of the block size is set (PACKED_BLOCK_FLAG) and the rest of
+*  the size is not 0, the data is packed (Unpack_block) and the rest of
+*  the size is the number of packed bytes, at most MAX_PACKED_BYTES. They
+*  are received at PACKED_BLOCK_SRAM and the CRC covers them as sent. The
+*  block to be programmed is unpacked behind the address at
+*  START_OF_DOWNLOAD_SRAM and its size replaced by the unpacked one, so
+*  Program_flash sees a plain block; one that does not unpack is answered
+*  "$P".
+*
+*  Blocks are programmed strictly in sequence order:
+*
+*     - the next block, intact: programmed and answered "*P" (or "$P")
+*       and its sequence number. After "$P" the same block is expected
+*       again.
+*     - a block with a bad CRC, or one that stops arriving for
+*       VERIFY_TIMEOUT_LOOPS: answered "$X" and the sequence number
+*       expected, so the PC sends again from there.
+*     - a block already programmed (up to VERIFY_WINDOW behind), intact:
+*       its acknowledge was lost; answered "*P" again without
+*       programming.
+*     - a later block, intact: sent by the PC before it learned of a bad
+*       block; ignored.
+*
+*  Only blocks actually programmed are counted off the total (unpacked
+*  sizes), so 'z' still checks that the whole image arrived. The wait for
+*  a sequence number has no timeout: after a failure the PC stays quiet
+*  for longer than VERIFY_TIMEOUT_LOOPS, so a block cut short is given up
+*  and the next byte is the start of a block. The mode only ends with the empty
+*  block (or a reset).
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Packed blocks
+******************************************************************************/
+State_t Download_verified (struct interface_data_t *globs)
+{
+    UINT_8  expected;       /* sequence number of the next block to program */
+    UINT_8  seq;            /* sequence number of the current block */
+    UINT_8  data;
+    UINT_8  complete;       /* FALSE if the block stopped arriving */
+    UINT_8  i;
+    UINT_8  packed;         /* TRUE if the block data is packed */
+    UINT_8  huge *sram_ptr;
+    UINT_8  huge *data_ptr; /* where the block data is received */
+    UINT_16 byte_count;     /* number of data bytes in the current block */
+    UINT_32 crc;            /* CRC of the bytes received */
+    UINT_32 block_crc;      /* CRC sent by the PC */
+    State_t state;
+
+    Make_crc_table_32 (DIGEST_POLYNOMIAL, digest_table);
+    expected = 0;
+
+    while (1)
+    {
+        seq = (UINT_8)io_getbyte();
+        crc = seq;
+
+        /* 4 address bytes and 2 block size bytes, then the data */
+        sram_ptr = (UINT_8 huge *)HAL_ADDRESS (START_OF_DOWNLOAD_SRAM);
+        byte_count = 0;
+        packed = FALSE;
+        complete = Receive_verified (sram_ptr, 6, &crc);
+        if (complete == TRUE)
+        {
+            byte_count = ((UINT_16)sram_ptr[4] << 8) | sram_ptr[5];
+            data_ptr = sram_ptr + 6;
+            if (((byte_count & PACKED_BLOCK_FLAG) != 0) &&
+                    (byte_count != PACKED_BLOCK_FLAG))
+            {
+                packed = TRUE;
+                byte_count &= ~PACKED_BLOCK_FLAG;
+                data_ptr = (UINT_8 huge *)HAL_ADDRESS (PACKED_BLOCK_SRAM);
+                if (byte_count > MAX_PACKED_BYTES)
+                {
+                    complete = FALSE;
+                }
+            }
+        }
+        if (complete == TRUE)
+        {
+            complete = Receive_verified (data_ptr, byte_count, &crc);
+        }
+
+        /* CRC sent by the PC */
+        block_crc = 0;
+        for (i = 0; (i < 4) && (complete == TRUE); i++)
+        {
+            complete = io_getbyte_timeout (VERIFY_TIMEOUT_LOOPS, &data);
+            block_crc = (block_crc << 8) | data;
+        }
+
+        if ((complete == FALSE) || (block_crc != crc))
+        {
+            io_putbyte ('$');
+            io_putbyte ('X');
+            io_putbyte (expected);
+            continue;
+        }
 
+        if (seq != expected)
+        {
+            /* Programmed already; the acknowledge did not reach the PC */
+            if ((UINT_8) (expected - seq) <= VERIFY_WINDOW)
+            {
+                io_putbyte ('*');
+                io_putbyte ('P');
+                io_putbyte (seq);
+            }
+            continue;
+        }
+
+        /* Empty block; end of download */
+        if (byte_count == 0)
+        {
+            break;
+        }
+
+        state = FLASH_PROGRAM_SUCCESS;
+        if (packed == TRUE)
+        {
+            if (Unpack_block (data_ptr, byte_count, sram_ptr + 6,
+                              &byte_count) == TRUE)
+            {
+                sram_ptr[4] = (UINT_8) (byte_count >> 8);
+                sram_ptr[5] = (UINT_8)byte_count;
+            }
+            else
+            {
+                state = FLASH_PROGRAM_ERROR;
+            }
+        }
+
+        if (state == FLASH_PROGRAM_SUCCESS)
+        {
+            state = Program_flash (globs);
+        }
+
+        if (state == FLASH_PROGRAM_SUCCESS)
+        {
+            globs->total_bytes -= 6 + (UINT_32)byte_count;
+            expected++;
+            io_putbyte ('*');
+        }
+        else
+        {
+            io_putbyte ('$');
+        }
+        io_putbyte ('P');
+        io_putbyte (seq);
+    }
+
+    return (PIPELINE_COMPLETE);
+}
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Receive_verified
+*
+*  ABSTRACT:
+*     Receives bytes into SRAM and runs them through the block CRC
+*
+*  INPUTS:
+*
+*     Globals:
+*        digest_table
+*
+*     Constants:
+*        VERIFY_TIMEOUT_LOOPS
+*
+*     Procedure Parameters:
+*        dest         UINT_8 huge *     where the bytes are stored
+*        count        UINT_16           number of bytes
+*        crc          UINT_32 *         running CRC; updated
+*
+*  OUTPUTS:
+*
+*     Global Variables:
+*        None
+*
+*     Returned Value:
+*        TRUE if all the bytes arrived, FALSE if one took longer than
+*        VERIFY_TIMEOUT_LOOPS
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The CRC step is the one of Crc_32_block, done as each byte arrives
+*  so no time is spent on it once the block is complete.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+UINT_8 Receive_verified (UINT_8 huge *dest, UINT_16 count, UINT_32 *crc)
+{
+    UINT_8  data;
+    UINT_16 tab_index;      /* index into the CRC lookup table */
+
+    while (count != 0)
+    {
+        if (io_getbyte_timeout (VERIFY_TIMEOUT_LOOPS, &data) == FALSE)
+        {
+            return (FALSE);
+        }
+        *dest++ = data;
+
+        tab_index = (UINT_16) (*crc >> 24);
+        *crc = ((*crc << 8) | data) ^ digest_table[tab_index];
+        count--;
+    }
+
+    return (TRUE);
+}
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Unpack_block
+*
+*  ABSTRACT:
+*     Unpacks the data of a packed 'x' block
+*
+*  INPUTS:
+*
+*     Constants:
+*        PACK_RUN
+*        PACK_MATCH
+*        PACK_MIN_LENGTH
+*        PACK_LONG_MATCH
+*        MAX_UNPACKED_BYTES
+*
+*     Procedure Parameters:
+*        src          UINT_8 huge *     packed bytes
+*        src_count    UINT_16           number of packed bytes
+*        dest         UINT_8 huge *     where the data is unpacked
+*        dest_count   UINT_16 *         number of bytes unpacked
+*
+*  OUTPUTS:
+*
+*     Global Variables:
+*        None
+*
+*     Returned Value:
+*        TRUE if the packed bytes were well formed, FALSE if a control
+*        byte needed more bytes than were sent, a copy reached back before
+*        the start of the block or the data grew past MAX_UNPACKED_BYTES
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The control bytes are described with PACKED_BLOCK_FLAG (INCLUDE.H).
+*  Copies only reach back into the same block, so nothing but the block
+*  itself has to be kept. A copy may overlap the bytes it produces (a
+*  distance shorter than the length repeats a pattern), so it is done a
+*  byte at a time. Rx_pump is called for each control byte so the UART
+*  is not overrun while a block is unpacked.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+UINT_8 Unpack_block (UINT_8 huge *src, UINT_16 src_count,
+                     UINT_8 huge *dest, UINT_16 *dest_count)
+{
+    UINT_8  control;
+    UINT_8  huge *end;      /* first byte after the packed bytes */
+    UINT_16 out;            /* bytes unpacked so far */
+    UINT_16 length;
+    UINT_16 distance;
+
+    end = src + src_count;
+    out = 0;
+
+    while (src < end)
+    {
+        Rx_pump();
+
+        control = *src++;
+
+        if (control < PACK_RUN)
+        {
+            /* Literal bytes */
+            length = (UINT_16)control + 1;
+            if (((UINT_16) (end - src) < length) ||
+                (length > MAX_UNPACKED_BYTES - out))
+            {
+                return (FALSE);
+            }
+            while (length != 0)
+            {
+                dest[out++] = *src++;
+                length--;
+            }
+        }
+        else if (control < PACK_MATCH)
+        {
+            /* Run of one byte */
+            length = (UINT_16) (control & 0x3F) + PACK_MIN_LENGTH;
+            if ((src == end) || (length > MAX_UNPACKED_BYTES - out))
+            {
+                return (FALSE);
+            }
+            while (length != 0)
+            {
+                dest[out++] = *src;
+                length--;
+            }
+            src++;
+        }
+        else
+        {
+            /* Copy of earlier output */
+            length = (UINT_16) ((control >> 4) & 0x07) + PACK_MIN_LENGTH;
+            if (src == end)
+            {
+                return (FALSE);
+            }
+            distance = (((UINT_16) (control & 0x0F) << 8) | *src++) + 1;
+            if (length == PACK_LONG_MATCH)
+            {
+                if (src == end)
+                {
+                    return (FALSE);
+                }
+                length += *src++;
+            }
+            if ((distance > out) || (length > MAX_UNPACKED_BYTES - out))
+            {
+                return (FALSE);
+            }
+            while (length != 0)
+            {
+                dest[out] = dest[out - distance];
+                out++;
+                length--;
+            }
+        }
+    }
+
+    *dest_count = out;
+    return (TRUE);
+}
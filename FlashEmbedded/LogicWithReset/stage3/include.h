@@ -18,12 +18,83 @@
 *  01 Apr 2000 D.Smail
 *    Created
 * Revised:
+*  17 Oct 2026
+*    Added the verified download ('x') constants
+*  17 Oct 2026
+*    Added the program routines of the detected FLASH
+*  17 Oct 2026
+*    Added erase on demand ('a')
+*  17 Oct 2026
+*    Added the packed 'x' blocks
+*  17 Oct 2026
+*    Baud switch rate error left to the test pattern
+*  17 Oct 2026
+*    New commands only built with NEW_COMMANDS
 **************************************************************************/
 
 #define     START_OF_DOWNLOAD_SRAM      0x210000
 
+/* Bytes received while FLASH is being programmed are queued here (64K so
+   the 16 bit ring indexes wrap by themselves) */
+#define     RX_RING_SRAM                0x220000
+#define     RX_RING_SIZE                0x10000
+
+/* Optional features reported to the PC by the 'v' command. 'v' and the
+   commands behind these bits are only built with NEW_COMMANDS (make
+   -DNEWCMD) until they have been tested on a Logic; STAGE3.HEX and the
+   stage2 byte count are those of the loader without them */
+#define     CAP_PIPELINED_DOWNLOAD      0x01
+#define     CAP_SECTOR_DIGEST           0x02
+#define     CAP_BAUD_SWITCH             0x04
+#define     CAP_VERIFIED_DOWNLOAD       0x08
+#define     CAP_ERASE_ON_DEMAND         0x10
+#define     CAP_COMPRESSED_BLOCKS       0x20
+#define     STAGE3_CAPABILITIES         (CAP_PIPELINED_DOWNLOAD | \
+                                         CAP_SECTOR_DIGEST      | \
+                                         CAP_BAUD_SWITCH        | \
+                                         CAP_VERIFIED_DOWNLOAD  | \
+                                         CAP_ERASE_ON_DEMAND    | \
+                                         CAP_COMPRESSED_BLOCKS)
+
+/* Baud rate switch ('n' command) */
+#define     BAUD_TEST_LENGTH            4       /* test bytes echoed at the new rate */
+#define     BAUD_CONFIRM_BYTE           'Y'     /* PC received the echo correctly */
+#define     BAUD_SWITCH_DELAY_LOOPS     20000   /* lets the "*N" stop bit go out */
+#define     BAUD_CONFIRM_LOOPS          0x80000 /* wait for each test byte */
+
+/* CRC-32 polynomial of the sector digests ('h' command) and of the
+   verified download blocks ('x' command) */
+#define     DIGEST_POLYNOMIAL           0x04C11DB7
+
+/* Verified download ('x' command) */
+#define     VERIFY_TIMEOUT_LOOPS        0x10000 /* gap inside a block (~125 ms) */
+#define     VERIFY_WINDOW               16      /* blocks behind the next one
+                                                   that are acknowledged again */
+
+/* Packed 'x' blocks (Unpack_block): bit 15 of the block size is set and
+   the size is the number of packed bytes, which are received here and
+   unpacked to START_OF_DOWNLOAD_SRAM (a size of exactly 8000 is a plain
+   block; nothing is packed into 0 bytes). The packed bytes are made of
+   control bytes:
+     00-3F  control+1 literal bytes follow
+     40-7F  the next byte repeated (control & 3F)+3 times
+     80-FF  copy of earlier output: length ((control >> 4) & 7)+3, an
+            extra length byte added when that is 10; distance
+            ((control & 0F) << 8 | next byte)+1 */
+#define     PACKED_BLOCK_FLAG           0x8000
+#define     PACKED_BLOCK_SRAM           (START_OF_DOWNLOAD_SRAM + 0x8008)
+#define     MAX_PACKED_BYTES            0x4000
+#define     MAX_UNPACKED_BYTES          0x8000
+#define     PACK_RUN                    0x40
+#define     PACK_MATCH                  0x80
+#define     PACK_MIN_LENGTH             3
+#define     PACK_LONG_MATCH             10
+
 #define     NUM_FLASH_SECTORS           4
 
+/* Most sectors in a sector map (Get_sector; SST 39SF040 pair) */
+#define     MAX_FLASH_SECTORS           128
+
 
 #define     MSB_OF_MSW_FLASH_ADDRESS    0
 #define     LSB_OF_MSW_FLASH_ADDRESS    1
@@ -59,6 +130,12 @@ typedef enum
     DOWNLOAD_ERROR,
     RESET_COMPLETE,
     RESET_ERROR,
+    PIPELINE_COMPLETE,
+    REPORT_CAPABILITIES,
+    BAUD_SWITCH_READY,
+    BAUD_SWITCH_REJECTED,
+    ERASE_ON_DEMAND_READY,
+    ERASE_ON_DEMAND_REJECTED,
     UNKNOWN_COMMAND
 } State_t;
 
@@ -70,6 +147,14 @@ typedef struct
     UINT_32  address; /* received from PC; flash address where CRC is stored */
 } CRC_t;
 
+/* Lookup table of the CRC being calculated; only one width is built */
+union crc_table_t
+{
+    UINT_8   table_8[256];
+    UINT_16  table_16[256];
+    UINT_32  table_32[256];
+};
+
 struct interface_data_t
 {
     UINT_16 huge *amd_addr_1; /* address for a FLASH command (write,erase) */
@@ -89,24 +174,63 @@ struct interface_data_t
 
     CRC_t   crc;
     UINT_16 device_type;        /* AMD 29040 or Intel 28F800B */
+
+    UINT_16 new_s0bg;           /* baud rate generator reload for 'n' */
+
+    /* Erase on demand ('a'): a sector is erased just before the first block
+       programmed into it; bit set once erased or already programmed */
+    UINT_8  erase_on_demand;
+    UINT_16 sector_erased[MAX_FLASH_SECTORS / 16];
+
+    /* FLASH programming routines of device_type (Select_program_routines) */
+    void    (*program_begin) (struct interface_data_t *, UINT_16 huge *);
+    UINT_16 (*program_word) (struct interface_data_t *, UINT_16 huge *, UINT_16);
+    void    (*program_end) (struct interface_data_t *, UINT_16 huge *);
 };
 
 
+/* Globals */
+extern UINT_32 digest_table[256];   /* sector.c */
+
+
 /* Prototypes */
 /* serial.c */
+void    io_init (void);
 UINT_8  io_getbyte (void);
 void    io_putbyte (UINT_8);
+void    Rx_pump (void);
+UINT_8  io_getbyte_timeout (UINT_32, UINT_8 *);
+State_t Baud_switch_request (struct interface_data_t *);
+void    Baud_switch (struct interface_data_t *);
 
 /* crc.c */
 UINT_8  Calc_crc (struct interface_data_t *);
 void    Get_crc_from_flash (struct interface_data_t *);
 UINT_8 ResetPCB (struct interface_data_t *globs);
 UINT_8  Binary_byte_to_ASCII (UINT_8);
+void    Make_crc_table_8 (UINT_8, UINT_8 *);
+void    Make_crc_table_16 (UINT_16, UINT_16 *);
+void    Make_crc_table_32 (UINT_32, UINT_32 *);
+UINT_8  Crc_8_block (UINT_8, UINT_8 huge *, UINT_32, UINT_8 *);
+UINT_16 Crc_16_block (UINT_16, UINT_8 huge *, UINT_32, UINT_16 *);
+UINT_32 Crc_32_block (UINT_32, UINT_8 huge *, UINT_32, UINT_32 *);
+
+/* sector.c */
+UINT_8  Get_sector (struct interface_data_t *, UINT_8, UINT_32 *, UINT_32 *);
+State_t Send_sector_digests (struct interface_data_t *);
+State_t Erase_sector_command (struct interface_data_t *);
+UINT_16 Erase_sector (struct interface_data_t *, UINT_32);
+State_t Erase_on_demand_command (struct interface_data_t *);
+UINT_16 Erase_sectors_on_demand (struct interface_data_t *, UINT_32, UINT_32);
 
 
 /* blkdata.c */
 void    Download_block_data (struct interface_data_t *);
 void    Get_total_bytes (struct interface_data_t *);
+State_t Download_pipelined (struct interface_data_t *);
+State_t Download_verified (struct interface_data_t *);
+UINT_8  Receive_verified (UINT_8 huge *, UINT_16, UINT_32 *);
+UINT_8  Unpack_block (UINT_8 huge *, UINT_16, UINT_8 huge *, UINT_16 *);
 
 /* main.c */
 void    main (void);
@@ -116,6 +240,7 @@ State_t Get_command (struct interface_data_t *);
 void    Init_flash_pointers (struct interface_data_t *);
 State_t Erase_flash (struct interface_data_t *);
 State_t Program_flash (struct interface_data_t *);
+void    Select_program_routines (struct interface_data_t *);
 UINT_16 Erase_flash_chip (struct interface_data_t *);
 State_t Autoselect_flash (struct interface_data_t *);
 UINT_16 Erase_INTEL28F800 (struct interface_data_t *globs);
@@ -0,0 +1,1735 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Simulator.c
+*  Subsystem  : PC (Linux) - Logic simulator
+*  Procedures : main
+*               New_sim_port
+*               Load_stage_file
+*               Preload_flash
+*               Save_flash
+*               Link_noise
+*               Verify_flash
+*               Print_results
+*               Poll_events
+*               Print_events
+*               Link_to_pc
+*               Byte_time_ns
+*               Baud_mismatch
+*               Sim_init_com
+*               Sim_tx_buffer
+*               Sim_rx_buffer
+*               Sim_flush
+*               Sim_set_baud
+*               Sim_ms_clock
+*               Sim_us_delay
+*
+*  Abstract   : Runs FlashMain against the simulated Logic. The callbacks
+*               normally supplied by the .NET executable are replaced by an
+*               in-process loopback on a virtual clock, so a whole download
+*               (boot strap loader, stage3, erase, program, CRC) runs in a
+*               fraction of its real time and always takes the same
+*               simulated time.
+*                 Each COM port has its own Logic and its own PC clock, so
+*               a gang ("--ports=1,2,3") flashes several boards at once,
+*               one thread each.
+*  Compiler   : gcc
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    One simulated Logic per COM port; "--ports" runs a gang
+*  17 Oct 2026
+*    "--resident" starts with stage3 running
+*  17 Oct 2026
+*    "--noise", "--drop", "--cut" and "--save" for the verified download
+*  17 Oct 2026
+*    "--events" polls the progress and log events as the .NET executable
+*  17 Oct 2026
+*    "--record" keeps the bytes to and from stage3 for stage3host
+**************************************************************************/
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "include.h"
+#include "Simulator.h"
+
+/* Bytes from the Logic not yet read by the PC */
+#define  PC_RX_QUEUE_SIZE                 0x10000
+
+/* Corruption of a byte the PC receives at the wrong baud rate */
+#define  PC_GARBLE_MASK                   0x5A
+
+/* Corruption of a byte hit by link noise ("--noise") */
+#define  LINK_NOISE_MASK                  0x10
+
+/* Data bytes per record of a "--save" file */
+#define  SAVE_RECORD_BYTES                32
+
+/* Link_noise results */
+#define  LINK_INTACT                      0
+#define  LINK_CORRUPTED                   1
+#define  LINK_DROPPED                     2
+
+/* Real time between two polls of GetFlashEvent ("--events") */
+#define  EVENT_POLL_US                    1000
+
+/* Defaults of the command line options */
+#define  DEFAULT_DEVICE                   "amd29f040"
+#define  DEFAULT_CPU_CODE                 CPU_CODE_2
+#define  DEFAULT_FCPU_HZ                  20000000UL
+#define  DEFAULT_STAGE_DIR                "../FlashDotExeUpgrade/Resources"
+
+/* DLL exports normally called by the .NET executable */
+int FlashMain (int argc, char *argv[]);
+void SetInitComCallback (void (*func) (unsigned int comPort, unsigned int baudRate));
+void SetPortCallbacks (int comPort,
+                       void (*initCom) (unsigned int comPort, unsigned int baudRate),
+                       void (*txBuffer) (const unsigned char *buf, int len),
+                       int (*rxBuffer) (unsigned char *buf, int len, int timeout_ms),
+                       void (*flush) (void), void (*setBaud) (int baud));
+int GetPortResult (int comPort);
+void SetTxBufferCallback (void (*func) (const unsigned char *buf, int len));
+void SetRxBufferCallback (int (*func) (unsigned char *buf, int len, int timeout_ms));
+void SetFlushCallback (void (*func) (void));
+void SetBaudCallback (void (*func) (int baud));
+void CopyStage1HexData (char *aString, long int aSize);
+void CopyStage2HexData (char *aString, long int aSize);
+void CopyStage3HexData (char *aString, long int aSize);
+void EnableFlashEvents (int enable);
+int GetFlashEvent (int *comPort, int *type, long *value, char *text,
+                   int textSize);
+
+struct rx_byte_t
+{
+    unsigned char byte;
+    long baud;              /* rate the Logic sent it at */
+    sim_ns_t arrival;
+};
+
+/* A simulated Logic and the PC end of its line */
+struct sim_port_t
+{
+    struct target_t target;
+
+    sim_ns_t pc_now;            /* the PC's clock */
+    sim_ns_t pc_tx_free;        /* when the PC transmitter is free again */
+    long pc_baud;
+
+    struct rx_byte_t pc_rx_queue[PC_RX_QUEUE_SIZE];
+    unsigned long pc_rx_head;   /* next byte to read */
+    unsigned long pc_rx_tail;   /* next free entry */
+
+    unsigned long noise_every;  /* every n-th download byte corrupted; 0 off */
+    unsigned long drop_every;   /* every n-th download byte lost; 0 off */
+    unsigned long link_bytes;   /* download bytes either way */
+    unsigned long noisy_bytes;  /* download bytes corrupted or lost */
+};
+
+/* Events read by Poll_events, per COM port ("--events") */
+struct event_counts_t
+{
+    volatile int stop;          /* set by main when FlashMain returned */
+    unsigned long progress[MAX_COM_PORT + 1];
+    unsigned long backwards[MAX_COM_PORT + 1];  /* progress that went down */
+    long last_progress[MAX_COM_PORT + 1];
+    unsigned long results[MAX_COM_PORT + 1];
+    long result[MAX_COM_PORT + 1];
+    unsigned long log_lines;
+};
+
+static char *Load_stage_file (const char *dir, const char *name,
+                              unsigned long *num_bytes);
+static struct sim_port_t *New_sim_port (const struct device_model_t *device,
+                                        unsigned char cpu_code,
+                                        unsigned long fcpu_hz,
+                                        unsigned char legacy,
+                                        const unsigned long stage_bytes[3]);
+static unsigned char Preload_flash (struct target_t *target,
+                                    const char *hex_name);
+static unsigned char Save_flash (const struct target_t *target,
+                                 const char *hex_name);
+static int Link_noise (unsigned char *byte);
+static void *Poll_events (void *arg);
+static void Print_events (const struct event_counts_t *counts,
+                          const int *ports, int num_ports);
+static long Verify_flash (const struct target_t *target, const char *hex_name,
+                          unsigned long *num_bytes);
+static void Print_results (int com_port, const struct sim_port_t *p, int rc,
+                           long mismatches, unsigned long app_bytes);
+
+static void Sim_init_com (unsigned int com_port, unsigned int baud_rate);
+static void Sim_tx_buffer (const unsigned char *buf, int len);
+static int Sim_rx_buffer (unsigned char *buf, int len, int timeout_ms);
+static void Sim_flush (void);
+static void Sim_set_baud (int baud);
+static unsigned long Sim_ms_clock (void);
+static void Sim_us_delay (unsigned long us);
+
+/* Logic on each COM port; NULL if the port is not simulated */
+static struct sim_port_t *sim_ports[MAX_COM_PORT + 1];
+
+/* Port opened by the calling thread (Sim_init_com) */
+static __thread struct sim_port_t *port;
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: main
+*
+*  ABSTRACT:
+*     Simulates one download
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       argc            int         number of arguments
+*       argv            char *[]    [options] <hex file> [FlashMain options]
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           FlashMain's result; 1 if it passed but a FLASH does
+*                     not hold the hex file
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Options:
+*       --device=<name>     FLASH part (default amd29f040)
+*       --cpu=<A5|C5|D5>    boot strap loader acknowledge (default C5)
+*       --fcpu=<Hz>         CPU clock; sets the reachable baud rates
+*       --stages=<dir>      STAGE1/2/3.HEX (default the .NET resources)
+*       --preload=<hex>     FLASH contents before the download
+*       --legacy            loader without the commands added since 2.1
+*       --ports=<list>      gang of Logics, e.g. "1,2,3" (default 1)
+*       --resident[=<baud>] stage3 already running, as after a failed
+*                           session (default 38400 baud)
+*       --noise=<n>         every n-th byte of the 'w' / 'x' blocks and
+*                           their acknowledges is corrupted
+*       --drop=<n>          every n-th of those bytes is lost
+*       --cut=<blocks>      the Logic loses power once it has programmed
+*                           this many blocks
+*       --save=<hex>        FLASH of the (first) port written afterwards,
+*                           for "--preload" of a resumed session
+*       --events            the progress and log lines are read from
+*                           GetFlashEvent by a second thread while
+*                           FlashMain runs, as the .NET executable does
+*       --record=<name>     bytes the (first) Logic received once stage3
+*                           ran written to <name>.pc and what it sent to
+*                           <name>.logic, for "stage3host --replay"
+*   Everything after the hex file is passed to FlashMain unchanged (baud
+*   rates, CRC configuration file, "lockstep", "delta", ...). Afterwards
+*   the simulated times are printed and the FLASH of every port is compared
+*   with the hex file.
+*     A single port uses the default callbacks (SetInitComCallback ...),
+*   a gang registers every port with SetPortCallbacks, as the .NET
+*   executable does.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     "--ports"
+*  17 Oct 2026
+*     "--resident"
+*  17 Oct 2026
+*     "--noise", "--drop", "--cut" and "--save"
+*  17 Oct 2026
+*     "--events"
+*  17 Oct 2026
+*     "--record"
+******************************************************************************/
+int main (int argc, char *argv[])
+{
+    const struct device_model_t *device;
+    const char *stage_dir = DEFAULT_STAGE_DIR;
+    const char *preload_name = NULL;
+    const char *port_list = "1";
+    const char *save_name = NULL;
+    const char *record_name = NULL;
+    char record_file[300];
+    long resident_baud = 0;
+    unsigned long noise_every = 0;
+    unsigned long drop_every = 0;
+    unsigned long cut_blocks = 0;
+    unsigned char events = FALSE;
+    static struct event_counts_t event_counts;
+    pthread_t poller;
+    int ports[MAX_COM_PORT];
+    int num_ports;
+    int port_rc;
+    struct sim_port_t *p;
+    unsigned long fcpu_hz = DEFAULT_FCPU_HZ;
+    unsigned char cpu_code = DEFAULT_CPU_CODE;
+    unsigned char legacy = FALSE;
+    unsigned long stage_bytes[3];
+    char *stage_hex[3];
+    char hex_name[300];
+    char **flash_argv;
+    unsigned long app_bytes;
+    long mismatches;
+    int flash_argc;
+    int arg;
+    int i;
+    int rc;
+
+    device = Find_device_model (DEFAULT_DEVICE);
+
+    for (arg = 1; (arg < argc) && !strncmp (argv[arg], "--", 2); arg++)
+    {
+        if (!strncmp (argv[arg], "--device=", 9))
+        {
+            device = Find_device_model (argv[arg] + 9);
+            if (device == NULL)
+            {
+                printf ("** Unknown device %s; one of:\n", argv[arg] + 9);
+                List_device_models();
+                return (1);
+            }
+        }
+        else if (!strncmp (argv[arg], "--cpu=", 6))
+        {
+            cpu_code = (unsigned char)strtoul (argv[arg] + 6, NULL, 16);
+        }
+        else if (!strncmp (argv[arg], "--fcpu=", 7))
+        {
+            fcpu_hz = strtoul (argv[arg] + 7, NULL, 10);
+        }
+        else if (!strncmp (argv[arg], "--stages=", 9))
+        {
+            stage_dir = argv[arg] + 9;
+        }
+        else if (!strncmp (argv[arg], "--preload=", 10))
+        {
+            preload_name = argv[arg] + 10;
+        }
+        else if (!strcmp (argv[arg], "--legacy"))
+        {
+            legacy = TRUE;
+        }
+        else if (!strncmp (argv[arg], "--ports=", 8))
+        {
+            port_list = argv[arg] + 8;
+        }
+        else if (!strcmp (argv[arg], "--resident"))
+        {
+            resident_baud = 38400;
+        }
+        else if (!strncmp (argv[arg], "--resident=", 11))
+        {
+            resident_baud = strtol (argv[arg] + 11, NULL, 10);
+        }
+        else if (!strncmp (argv[arg], "--noise=", 8))
+        {
+            noise_every = strtoul (argv[arg] + 8, NULL, 10);
+        }
+        else if (!strncmp (argv[arg], "--drop=", 7))
+        {
+            drop_every = strtoul (argv[arg] + 7, NULL, 10);
+        }
+        else if (!strncmp (argv[arg], "--cut=", 6))
+        {
+            cut_blocks = strtoul (argv[arg] + 6, NULL, 10);
+        }
+        else if (!strncmp (argv[arg], "--save=", 7))
+        {
+            save_name = argv[arg] + 7;
+        }
+        else if (!strcmp (argv[arg], "--events"))
+        {
+            events = TRUE;
+        }
+        else if (!strncmp (argv[arg], "--record=", 9))
+        {
+            record_name = argv[arg] + 9;
+        }
+        else
+        {
+            printf ("** Unknown option %s\n", argv[arg]);
+            return (1);
+        }
+    }
+
+    num_ports = Parse_port_list (port_list, ports);
+    if ((arg >= argc) || (fcpu_hz == 0) || (num_ports == 0) || (resident_baud < 0))
+    {
+        printf ("\tUsage is: flashsim [--device=<name>] [--cpu=<A5|C5|D5>] [--fcpu=<Hz>]\n"
+                "\t                   [--stages=<dir>] [--preload=<hex file>] [--legacy]\n"
+                "\t                   [--ports=<port>[,<port>...]] [--resident[=<baud>]]\n"
+                "\t                   [--noise=<n>] [--drop=<n>] [--cut=<blocks>] [--save=<hex file>]\n"
+                "\t                   [--events] [--record=<name>]\n"
+                "\t                   <IntelHexFilename> [FlashC167 options ...]\n"
+                "\tDevices:\n");
+        List_device_models();
+        return (1);
+    }
+
+    /* FlashMain lower cases its copy of the name */
+    strncpy (hex_name, argv[arg], sizeof (hex_name) - 1);
+    hex_name[sizeof (hex_name) - 1] = '\0';
+
+    stage_hex[0] = Load_stage_file (stage_dir, "STAGE1.HEX", &stage_bytes[0]);
+    stage_hex[1] = Load_stage_file (stage_dir, "STAGE2.HEX", &stage_bytes[1]);
+    stage_hex[2] = Load_stage_file (stage_dir, "STAGE3.HEX", &stage_bytes[2]);
+    if ((stage_hex[0] == NULL) || (stage_hex[1] == NULL) || (stage_hex[2] == NULL))
+    {
+        return (1);
+    }
+    CopyStage1HexData (stage_hex[0], (long)strlen (stage_hex[0]));
+    CopyStage2HexData (stage_hex[1], (long)strlen (stage_hex[1]));
+    CopyStage3HexData (stage_hex[2], (long)strlen (stage_hex[2]));
+
+    for (i = 0; i < num_ports; i++)
+    {
+        p = New_sim_port (device, cpu_code, fcpu_hz, legacy, stage_bytes);
+        if (p == NULL)
+        {
+            return (1);
+        }
+        sim_ports[ports[i]] = p;
+        p->noise_every = noise_every;
+        p->drop_every = drop_every;
+        p->target.cut_blocks = cut_blocks;
+        if (resident_baud != 0)
+        {
+            Target_resident (&p->target, resident_baud);
+        }
+        if ((preload_name != NULL) &&
+                (Preload_flash (&p->target, preload_name) == FALSE))
+        {
+            return (1);
+        }
+        if (num_ports > 1)
+        {
+            SetPortCallbacks (ports[i], Sim_init_com, Sim_tx_buffer,
+                              Sim_rx_buffer, Sim_flush, Sim_set_baud);
+        }
+    }
+
+    if (record_name != NULL)
+    {
+        p = sim_ports[ports[0]];
+        snprintf (record_file, sizeof (record_file), "%s.pc", record_name);
+        p->target.record_pc = fopen (record_file, "wb");
+        snprintf (record_file, sizeof (record_file), "%s.logic", record_name);
+        p->target.record_logic = fopen (record_file, "wb");
+        if ((p->target.record_pc == NULL) || (p->target.record_logic == NULL))
+        {
+            printf ("** Unable to create %s.pc / .logic\n", record_name);
+            return (1);
+        }
+    }
+
+    SetInitComCallback (Sim_init_com);
+    SetTxBufferCallback (Sim_tx_buffer);
+    SetRxBufferCallback (Sim_rx_buffer);
+    SetFlushCallback (Sim_flush);
+    SetBaudCallback (Sim_set_baud);
+    Set_ms_clock (Sim_ms_clock);
+    Set_us_delay (Sim_us_delay);
+
+    /* FlashMain sees the COM port, the hex file and the remaining options */
+    flash_argc = argc - arg + 1;
+    flash_argv = (char **)malloc ((size_t) (flash_argc + 1) * sizeof (char *));
+    if (flash_argv == NULL)
+    {
+        printf ("** Out of memory\n");
+        return (1);
+    }
+    flash_argv[0] = strdup (port_list);
+    for (i = 1; i < flash_argc; i++)
+    {
+        flash_argv[i] = strdup (argv[arg + i - 1]);
+    }
+    flash_argv[flash_argc] = NULL;
+
+    if (events == TRUE)
+    {
+        EnableFlashEvents (1);
+        if (pthread_create (&poller, NULL, Poll_events, &event_counts) != 0)
+        {
+            printf ("** Event poller not started\n");
+            return (1);
+        }
+    }
+
+    rc = FlashMain (flash_argc, flash_argv);
+
+    if (events == TRUE)
+    {
+        event_counts.stop = TRUE;
+        pthread_join (poller, NULL);
+        EnableFlashEvents (0);
+        Print_events (&event_counts, ports, num_ports);
+    }
+
+    if ((save_name != NULL) &&
+            (Save_flash (&sim_ports[ports[0]]->target, save_name) == FALSE))
+    {
+        rc = 1;
+    }
+
+    if (record_name != NULL)
+    {
+        p = sim_ports[ports[0]];
+        fclose (p->target.record_pc);
+        fclose (p->target.record_logic);
+    }
+
+    for (i = 0; i < num_ports; i++)
+    {
+        p = sim_ports[ports[i]];
+        port_rc = GetPortResult (ports[i]);
+        if (port_rc == PORT_NOT_FLASHED)
+        {
+            port_rc = rc;
+        }
+        mismatches = 0;
+        app_bytes = 0;
+        if (port_rc == 0)
+        {
+            mismatches = Verify_flash (&p->target, hex_name, &app_bytes);
+        }
+        Print_results (ports[i], p, port_rc, mismatches, app_bytes);
+        if ((port_rc == 0) && (mismatches != 0) && (rc == 0))
+        {
+            rc = 1;
+        }
+        free (p);
+    }
+
+    for (i = 0; i < flash_argc; i++)
+    {
+        free (flash_argv[i]);
+    }
+    free (flash_argv);
+    for (i = 0; i < 3; i++)
+    {
+        free (stage_hex[i]);
+    }
+
+    return (rc);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: New_sim_port
+*
+*  ABSTRACT:
+*     Creates the simulated Logic of one COM port
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       device          const struct device_model_t *   FLASH part
+*       cpu_code        unsigned char   boot strap loader acknowledge
+*       fcpu_hz         unsigned long   CPU clock
+*       legacy          unsigned char   TRUE: original command set only
+*       stage_bytes     const unsigned long [3]     size of each stage
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       struct sim_port_t *     malloc'd; NULL if out of memory
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The Logic starts in its boot strap loader with the FLASH erased and
+*   the PC's clock at 0.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created from main
+* Revised :
+******************************************************************************/
+static struct sim_port_t *New_sim_port (const struct device_model_t *device,
+                                        unsigned char cpu_code,
+                                        unsigned long fcpu_hz,
+                                        unsigned char legacy,
+                                        const unsigned long stage_bytes[3])
+{
+    struct sim_port_t *p;
+
+    p = (struct sim_port_t *)calloc (1, sizeof (struct sim_port_t));
+    if (p == NULL)
+    {
+        printf ("** Out of memory\n");
+        return (NULL);
+    }
+    Target_init (&p->target, device, cpu_code, fcpu_hz, legacy, stage_bytes);
+    return (p);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Load_stage_file
+*
+*  ABSTRACT:
+*     Reads a boot loader stage the way the .NET executable hands it over
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       dir             const char *        directory of the stage files
+*       name            const char *        e.g. "STAGE1.HEX"
+*       num_bytes       unsigned long *     bytes the stage loads
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       char *        Intel Hex text (malloc'd); NULL if unreadable
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The simulated Logic needs the byte count of each stage to know when
+*   the next stage starts, so the text is also parsed here.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static char *Load_stage_file (const char *dir, const char *name,
+                              unsigned long *num_bytes)
+{
+    struct hex_image_t image;
+    char path[300];
+    char *text;
+    char *parse_copy;
+    long size;
+    FILE *fp;
+
+    snprintf (path, sizeof (path), "%s/%s", dir, name);
+    fp = fopen (path, "rb");
+    if (fp == NULL)
+    {
+        printf ("** Unable to open stage file %s\n", path);
+        return (NULL);
+    }
+
+    fseek (fp, 0, SEEK_END);
+    size = ftell (fp);
+    fseek (fp, 0, SEEK_SET);
+
+    text = (char *)malloc ((size_t)size + 1);
+    parse_copy = (char *)malloc ((size_t)size + 1);
+    if ((text == NULL) || (parse_copy == NULL) ||
+            (fread (text, 1, (size_t)size, fp) != (size_t)size))
+    {
+        printf ("** Unable to read stage file %s\n", path);
+        fclose (fp);
+        free (text);
+        free (parse_copy);
+        return (NULL);
+    }
+    fclose (fp);
+    text[size] = '\0';
+    strcpy (parse_copy, text);
+
+    Init_hex_image (&image);
+    if (Parse_hex_file (parse_copy, NULL, &image))
+    {
+        printf ("** Error parsing stage file %s\n", path);
+        Free_hex_image (&image);
+        free (text);
+        free (parse_copy);
+        return (NULL);
+    }
+    *num_bytes = image.num_data_bytes;
+    Free_hex_image (&image);
+    free (parse_copy);
+
+    return (text);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Preload_flash
+*
+*  ABSTRACT:
+*     Programs a hex file into the simulated FLASH before the download
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       target          struct target_t *   Logic of one port
+*       hex_name        const char *        Intel Hex file
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE if loaded
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Gives "delta" downloads an earlier release to compare against.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Preload_flash (struct target_t *target,
+                                    const char *hex_name)
+{
+    struct hex_image_t image;
+    struct image_segment_t *seg;
+    unsigned long address;
+    unsigned long i;
+    unsigned int s;
+    FILE *fp;
+
+    fp = fopen (hex_name, "r");
+    if (fp == NULL)
+    {
+        printf ("** Unable to open preload file %s\n", hex_name);
+        return (FALSE);
+    }
+
+    Init_hex_image (&image);
+    if (Parse_hex_file (NULL, fp, &image))
+    {
+        printf ("** Error parsing preload file %s\n", hex_name);
+        fclose (fp);
+        Free_hex_image (&image);
+        return (FALSE);
+    }
+    fclose (fp);
+
+    for (s = 0; s < image.num_segments; s++)
+    {
+        seg = &image.segment[s];
+        for (i = 0; i < seg->length; i++)
+        {
+            address = seg->address + i;
+            if ((address >= SIM_FLASH_START) &&
+                    (address < SIM_FLASH_START + SIM_FLASH_SIZE))
+            {
+                target->flash[address - SIM_FLASH_START] = seg->data[i];
+            }
+        }
+    }
+
+    Free_hex_image (&image);
+    return (TRUE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Save_flash
+*
+*  ABSTRACT:
+*     Writes the simulated FLASH to an Intel Hex file
+*
+*  INPUTS:
+*
+*     Constants:
+*       SAVE_RECORD_BYTES
+*
+*     Procedure Parameters:
+*       target          const struct target_t *     Logic of one port
+*       hex_name        const char *        file written
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE if written
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Records of up to SAVE_RECORD_BYTES bytes, erased (0xFF) bytes left
+*   out, with an extended linear address record for every 64K. Preloading
+*   the file gives the FLASH of a board that lost power part way through
+*   a download ("--cut").
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Save_flash (const struct target_t *target,
+                                 const char *hex_name)
+{
+    unsigned long offset;
+    unsigned long address;
+    unsigned long upper = 0xffffffffUL; /* upper 16 bits of the last ELA */
+    unsigned int count;
+    unsigned int i;
+    unsigned char checksum;
+    FILE *fp;
+
+    fp = fopen (hex_name, "w");
+    if (fp == NULL)
+    {
+        printf ("** Unable to write FLASH file %s\n", hex_name);
+        return (FALSE);
+    }
+
+    offset = 0;
+    while (offset < SIM_FLASH_SIZE)
+    {
+        if (target->flash[offset] == 0xff)
+        {
+            offset++;
+            continue;
+        }
+
+        /* Run of programmed bytes within one record and one 64K page */
+        address = SIM_FLASH_START + offset;
+        count = 0;
+        while ((count < SAVE_RECORD_BYTES) && (offset + count < SIM_FLASH_SIZE) &&
+                (target->flash[offset + count] != 0xff) &&
+                (((address + count) & 0xffff) >= (address & 0xffff)))
+        {
+            count++;
+        }
+
+        if ((address >> 16) != upper)
+        {
+            upper = address >> 16;
+            checksum = (unsigned char) (0x02 + 0x04 + (upper >> 8) + upper);
+            fprintf (fp, ":02000004%04lX%02X\n", upper,
+                     (unsigned char) (0x100 - checksum));
+        }
+
+        checksum = (unsigned char) (count + (address >> 8) + address);
+        fprintf (fp, ":%02X%04lX00", count, address & 0xffff);
+        for (i = 0; i < count; i++)
+        {
+            fprintf (fp, "%02X", target->flash[offset + i]);
+            checksum += target->flash[offset + i];
+        }
+        fprintf (fp, "%02X\n", (unsigned char) (0x100 - checksum));
+
+        offset += count;
+    }
+
+    fprintf (fp, ":00000001FF\n");
+    fclose (fp);
+    return (TRUE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Link_noise
+*
+*  ABSTRACT:
+*     Applies "--noise" and "--drop" to one byte on the line
+*
+*  INPUTS:
+*
+*     Constants:
+*       LINK_NOISE_MASK
+*
+*     Procedure Parameters:
+*       byte            unsigned char *     byte sent; corrupted here
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           LINK_INTACT, LINK_CORRUPTED or LINK_DROPPED
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Only bytes of the pipelined and verified downloads count, in both
+*   directions, so the commands around the download still get through.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static int Link_noise (unsigned char *byte)
+{
+    if (((port->noise_every == 0) && (port->drop_every == 0)) ||
+            (Target_downloading (&port->target) == FALSE))
+    {
+        return (LINK_INTACT);
+    }
+
+    port->link_bytes++;
+    if ((port->drop_every != 0) && ((port->link_bytes % port->drop_every) == 0))
+    {
+        port->noisy_bytes++;
+        return (LINK_DROPPED);
+    }
+    if ((port->noise_every != 0) && ((port->link_bytes % port->noise_every) == 0))
+    {
+        port->noisy_bytes++;
+        *byte ^= LINK_NOISE_MASK;
+        return (LINK_CORRUPTED);
+    }
+    return (LINK_INTACT);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Verify_flash
+*
+*  ABSTRACT:
+*     Compares the simulated FLASH with the hex file
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       target          const struct target_t *     Logic of one port
+*       hex_name        const char *        Intel Hex file downloaded
+*       num_bytes       unsigned long *     bytes in the hex file
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       long          bytes that differ (or lie outside the FLASH); -1 if
+*                     the file could not be read
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static long Verify_flash (const struct target_t *target, const char *hex_name,
+                          unsigned long *num_bytes)
+{
+    struct hex_image_t image;
+    struct image_segment_t *seg;
+    unsigned long address;
+    unsigned long i;
+    unsigned int s;
+    long mismatches;
+    FILE *fp;
+
+    *num_bytes = 0;
+
+    fp = fopen (hex_name, "r");
+    if (fp == NULL)
+    {
+        return (-1);
+    }
+
+    Init_hex_image (&image);
+    if (Parse_hex_file (NULL, fp, &image))
+    {
+        fclose (fp);
+        Free_hex_image (&image);
+        return (-1);
+    }
+    fclose (fp);
+
+    mismatches = 0;
+    for (s = 0; s < image.num_segments; s++)
+    {
+        seg = &image.segment[s];
+        for (i = 0; i < seg->length; i++)
+        {
+            address = seg->address + i;
+            if ((address < SIM_FLASH_START) ||
+                    (address >= SIM_FLASH_START + SIM_FLASH_SIZE) ||
+                    (target->flash[address - SIM_FLASH_START] != seg->data[i]))
+            {
+                mismatches++;
+            }
+        }
+    }
+
+    *num_bytes = image.num_data_bytes;
+    Free_hex_image (&image);
+    return (mismatches);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Print_results
+*
+*  ABSTRACT:
+*     Prints the simulated times and the throughput
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       com_port        int             port of the Logic
+*       p               const struct sim_port_t *
+*       rc              int             FlashMain's result for the port
+*       mismatches      long            from Verify_flash
+*       app_bytes       unsigned long   bytes in the hex file
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The download time runs from the end of the stage3 load to the end of
+*   the session; its throughput is the number to compare between protocol
+*   changes, since the boot loader time depends only on the stage sizes.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Print_results (int com_port, const struct sim_port_t *p, int rc,
+                           long mismatches, unsigned long app_bytes)
+{
+    const struct target_t *target = &p->target;
+    const struct target_stats_t *stats = &target->stats;
+    sim_ns_t end_ns;
+    sim_ns_t download_ns;
+
+    end_ns = (p->pc_now > target->now) ? p->pc_now : target->now;
+    download_ns = end_ns - stats->stage3_ready_ns;
+
+    printf ("\n ** Simulated Logic on COM%d: %s, CPU code %02XH, %.3f MHz%s\n",
+            com_port, target->device->description, target->cpu_code,
+            target->fcpu_hz / 1e6, (target->legacy == TRUE) ? ", legacy loader" : "");
+    printf (" ** FlashMain result ............................ %d\n", rc);
+    printf (" ** Final Logic baud rate ....................... %ld\n",
+            Target_baud (target));
+    printf (" ** Simulated time ......................... %10.3f s\n",
+            (double)end_ns / NS_PER_S);
+    printf (" **   boot loader (stage1 - stage3) ........ %10.3f s\n",
+            (double)stats->stage3_ready_ns / NS_PER_S);
+    printf (" **   download (stage3 - end) .............. %10.3f s\n",
+            (double)download_ns / NS_PER_S);
+    printf (" **     erasing (%4lu sectors) ............. %10.3f s\n",
+            stats->sectors_erased, (double)stats->erase_ns / NS_PER_S);
+    printf (" **     programming (%7lu words) ......... %10.3f s\n",
+            stats->words_programmed, (double)stats->program_ns / NS_PER_S);
+    printf (" **     CRC calculation .................... %10.3f s\n",
+            (double)stats->crc_ns / NS_PER_S);
+    printf (" ** Bytes PC -> Logic ...................... %10lu\n",
+            stats->bytes_received);
+    printf (" ** Bytes Logic -> PC ...................... %10lu\n",
+            stats->bytes_sent);
+    if (stats->garbled_bytes != 0)
+    {
+        printf (" ** Bytes received at the wrong baud rate .. %10lu\n",
+                stats->garbled_bytes);
+    }
+    if (p->noisy_bytes != 0)
+    {
+        printf (" ** Bytes corrupted or lost on the link .... %10lu\n",
+                p->noisy_bytes);
+    }
+    if (stats->blocks_rejected != 0)
+    {
+        printf (" ** Blocks rejected by the Logic ('$X') .... %10lu\n",
+                stats->blocks_rejected);
+    }
+    if (target->phase == TGT_DEAD)
+    {
+        printf (" ** Logic lost power after ............... %6lu blocks\n",
+                stats->blocks_programmed);
+    }
+
+    if (rc != 0)
+    {
+        return;
+    }
+
+    if (mismatches < 0)
+    {
+        printf (" ** FLASH contents .............................. NOT CHECKED\n");
+        return;
+    }
+
+    printf (" ** Application bytes ...................... %10lu\n", app_bytes);
+    if (download_ns != 0)
+    {
+        printf (" ** Download throughput .................... %10.0f bytes/s\n",
+                (double)app_bytes * NS_PER_S / download_ns);
+    }
+    if (mismatches == 0)
+    {
+        printf (" ** FLASH contents .............................. MATCH HEX FILE\n");
+    }
+    else
+    {
+        printf (" ** FLASH contents .............................. %ld BYTES DIFFER\n",
+                mismatches);
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Poll_events
+*
+*  ABSTRACT:
+*     Reads the events of FlashMain while it runs ("--events")
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       arg             void *          struct event_counts_t *
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       void *          NULL
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Stands in for the poll thread of the .NET executable: every
+*   EVENT_POLL_US of real time the events waiting are read and counted.
+*   The flash.log lines are printed instead of written to the log files.
+*   Once main sets "stop" the events left are read and the thread ends.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void *Poll_events (void *arg)
+{
+    struct event_counts_t *counts = (struct event_counts_t *)arg;
+    char text[EVENT_TEXT_BYTES];
+    int com_port;
+    int type;
+    long value;
+    int last_poll;
+
+    last_poll = FALSE;
+    while (1)
+    {
+        if (counts->stop == TRUE)
+        {
+            last_poll = TRUE;
+        }
+
+        while (GetFlashEvent (&com_port, &type, &value, text, sizeof (text)) == 1)
+        {
+            if ((com_port < 0) || (com_port > MAX_COM_PORT))
+            {
+                continue;
+            }
+            if (type == EVENT_PROGRESS)
+            {
+                counts->progress[com_port]++;
+                if (value < counts->last_progress[com_port])
+                {
+                    counts->backwards[com_port]++;
+                }
+                counts->last_progress[com_port] = value;
+            }
+            else if (type == EVENT_RESULT)
+            {
+                counts->results[com_port]++;
+                counts->result[com_port] = value;
+            }
+            else if (type == EVENT_LOG)
+            {
+                counts->log_lines++;
+                printf (" ** flash.log (COM%ld): %s", value, text);
+            }
+        }
+
+        if (last_poll == TRUE)
+        {
+            break;
+        }
+        usleep (EVENT_POLL_US);
+    }
+
+    return (NULL);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Print_events
+*
+*  ABSTRACT:
+*     Prints the events read per COM port ("--events")
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       counts          const struct event_counts_t *
+*       ports           const int *     COM ports flashed
+*       num_ports       int             number of ports
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     A complete download ends at 100.0% and has exactly one result; the
+*   progress must never go down.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Print_events (const struct event_counts_t *counts,
+                          const int *ports, int num_ports)
+{
+    int i;
+    int com_port;
+
+    for (i = 0; i < num_ports; i++)
+    {
+        com_port = ports[i];
+        printf ("\n ** Events of COM%d: %lu progress, last %ld.%ld%%",
+                com_port, counts->progress[com_port],
+                counts->last_progress[com_port] / 10,
+                counts->last_progress[com_port] % 10);
+        if (counts->backwards[com_port] != 0)
+        {
+            printf (", %lu BACKWARDS", counts->backwards[com_port]);
+        }
+        printf ("; %lu result (%ld)", counts->results[com_port],
+                counts->result[com_port]);
+    }
+    printf ("\n ** flash.log lines ........................ %10lu\n",
+            counts->log_lines);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Link_to_pc
+*
+*  ABSTRACT:
+*     Queues a byte sent by the Logic for the PC
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       byte            unsigned char   byte sent
+*       arrival         sim_ns_t        time its stop bit reaches the PC
+*       sender_baud     long            rate the Logic sent it at
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The PC's receive buffer never fills in practice; if the queue does the
+*   byte is dropped, like a receive overrun.
+*     Target_receive runs on the thread of the port, so the byte goes to
+*   the port of the calling thread. Link noise may corrupt or lose it.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Link noise
+******************************************************************************/
+void Link_to_pc (unsigned char byte, sim_ns_t arrival, long sender_baud)
+{
+    struct rx_byte_t *entry;
+
+    if ((port->pc_rx_tail - port->pc_rx_head >= PC_RX_QUEUE_SIZE) ||
+            (Link_noise (&byte) == LINK_DROPPED))
+    {
+        return;
+    }
+
+    entry = &port->pc_rx_queue[port->pc_rx_tail % PC_RX_QUEUE_SIZE];
+    entry->byte = byte;
+    entry->baud = sender_baud;
+    entry->arrival = arrival;
+    port->pc_rx_tail++;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Byte_time_ns
+*
+*  ABSTRACT:
+*     Time one byte occupies the line
+*
+*  INPUTS:
+*
+*     Constants:
+*       BITS_PER_UART_BYTE
+*
+*     Procedure Parameters:
+*       baud            long        bits per second
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       sim_ns_t      nsecs
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+sim_ns_t Byte_time_ns (long baud)
+{
+    return ((BITS_PER_UART_BYTE * NS_PER_S) / (sim_ns_t)baud);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Baud_mismatch
+*
+*  ABSTRACT:
+*     Checks whether a byte sent at one rate is readable at another
+*
+*  INPUTS:
+*
+*     Constants:
+*       BAUD_MATCH_PERCENT
+*
+*     Procedure Parameters:
+*       baud_a          long        sender's rate
+*       baud_b          long        receiver's rate
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE if the rates differ by more than BAUD_MATCH_PERCENT
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned char Baud_mismatch (long baud_a, long baud_b)
+{
+    long diff;
+
+    diff = (baud_a > baud_b) ? (baud_a - baud_b) : (baud_b - baud_a);
+    return ((diff * 100 > baud_b * BAUD_MATCH_PERCENT) ? TRUE : FALSE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Sim_init_com
+*
+*  ABSTRACT:
+*     Opens the simulated COM port (InitComCallback)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       com_port        unsigned int    selects the Logic
+*       baud_rate       unsigned int    rate of the PC's UART
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The calling thread talks to the Logic of this port from now on. A
+*   port not given with "--ports" is simulated as port 1 would be.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Logic selected by the COM port
+******************************************************************************/
+static void Sim_init_com (unsigned int com_port, unsigned int baud_rate)
+{
+    if ((com_port <= MAX_COM_PORT) && (sim_ports[com_port] != NULL))
+    {
+        port = sim_ports[com_port];
+    }
+    else if (port == NULL)
+    {
+        port = sim_ports[1];
+    }
+    port->pc_baud = (long)baud_rate;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Sim_tx_buffer
+*
+*  ABSTRACT:
+*     Sends bytes from the PC to the Logic (TxBufferCallback)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       buf             const unsigned char *   bytes to send
+*       len             int                     number of bytes
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Returns at once, as the serial driver buffers the bytes; they leave
+*   back to back at the PC's rate. The Logic handles each as it arrives, so
+*   its answers are queued, time stamped, before the PC reads them. A byte
+*   lost to link noise still takes its time on the line.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Link noise
+******************************************************************************/
+static void Sim_tx_buffer (const unsigned char *buf, int len)
+{
+    unsigned char byte;
+    int i;
+
+    for (i = 0; i < len; i++)
+    {
+        if (port->pc_tx_free < port->pc_now)
+        {
+            port->pc_tx_free = port->pc_now;
+        }
+        port->pc_tx_free += Byte_time_ns (port->pc_baud);
+
+        byte = buf[i];
+        if (Link_noise (&byte) != LINK_DROPPED)
+        {
+            Target_receive (&port->target, byte, port->pc_tx_free, port->pc_baud);
+        }
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Sim_rx_buffer
+*
+*  ABSTRACT:
+*     Receives bytes from the Logic (RxBufferCallback)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       buf             unsigned char *     received bytes
+*       len             int                 bytes wanted
+*       timeout_ms      int                 longest wait
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           bytes received
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The PC's clock moves to the arrival of each byte read, or to the end
+*   of the timeout if fewer than "len" bytes arrive in time. Bytes sent at
+*   a rate the PC is not set to are received corrupted; differently from
+*   the Logic's corruption, so a byte echoed at the wrong rate both ways
+*   does not come back intact.
+*     Before each byte the Logic is given the time up to its arrival (or
+*   the timeout) to act on its own timeouts (Target_poll).
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Wrong rate corruption differs from the Logic's
+*  17 Oct 2026
+*     Logic timeouts run while the PC waits
+******************************************************************************/
+static int Sim_rx_buffer (unsigned char *buf, int len, int timeout_ms)
+{
+    struct rx_byte_t *entry;
+    sim_ns_t deadline;
+    sim_ns_t limit;         /* time the Logic may run to without the PC */
+    int num_read;
+
+    deadline = port->pc_now + (sim_ns_t) (timeout_ms > 0 ? timeout_ms : 0) * NS_PER_MS;
+    num_read = 0;
+
+    while (num_read < len)
+    {
+        limit = deadline;
+        if (port->pc_rx_head != port->pc_rx_tail)
+        {
+            entry = &port->pc_rx_queue[port->pc_rx_head % PC_RX_QUEUE_SIZE];
+            if (entry->arrival < limit)
+            {
+                limit = entry->arrival;
+            }
+        }
+        Target_poll (&port->target, limit);
+
+        if (port->pc_rx_head == port->pc_rx_tail)
+        {
+            break;
+        }
+        entry = &port->pc_rx_queue[port->pc_rx_head % PC_RX_QUEUE_SIZE];
+        if (entry->arrival > deadline)
+        {
+            break;
+        }
+
+        if (port->pc_now < entry->arrival)
+        {
+            port->pc_now = entry->arrival;
+        }
+        buf[num_read] = entry->byte;
+        if (Baud_mismatch (entry->baud, port->pc_baud))
+        {
+            buf[num_read] = (unsigned char) (entry->byte ^ PC_GARBLE_MASK);
+        }
+        num_read++;
+        port->pc_rx_head++;
+    }
+
+    if ((num_read < len) && (port->pc_now < deadline))
+    {
+        port->pc_now = deadline;
+    }
+    return (num_read);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Sim_flush
+*
+*  ABSTRACT:
+*     Waits until the PC has sent everything written (FlushCallback)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Sim_flush (void)
+{
+    if (port->pc_now < port->pc_tx_free)
+    {
+        port->pc_now = port->pc_tx_free;
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Sim_set_baud
+*
+*  ABSTRACT:
+*     Changes the PC's rate (SetBaudCallback)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       baud            int         new rate
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Like SerComm.SetBaud, bytes already received are discarded.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Sim_set_baud (int baud)
+{
+    port->pc_baud = baud;
+
+    while ((port->pc_rx_head != port->pc_rx_tail) &&
+            (port->pc_rx_queue[port->pc_rx_head % PC_RX_QUEUE_SIZE].arrival <= port->pc_now))
+    {
+        port->pc_rx_head++;
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Sim_ms_clock
+*
+*  ABSTRACT:
+*     The PC's clock in msecs, for every deadline in the DLL
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned long   simulated msecs
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Each port has its own clock; the thread's port is used.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Clock of the calling thread's port
+******************************************************************************/
+static unsigned long Sim_ms_clock (void)
+{
+    sim_ns_t latest = 0;
+    int i;
+
+    if (port != NULL)
+    {
+        return ((unsigned long) (port->pc_now / NS_PER_MS));
+    }
+
+    /* a thread without a port (FlashMain itself in a gang) sees the time
+    of the port that has run longest */
+    for (i = 0; i <= MAX_COM_PORT; i++)
+    {
+        if ((sim_ports[i] != NULL) && (sim_ports[i]->pc_now > latest))
+        {
+            latest = sim_ports[i]->pc_now;
+        }
+    }
+    return ((unsigned long) (latest / NS_PER_MS));
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Sim_us_delay
+*
+*  ABSTRACT:
+*     Advances the PC's clock instead of waiting (Pace_us)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       us              unsigned long   microseconds
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Sim_us_delay (unsigned long us)
+{
+    port->pc_now += (sim_ns_t)us * NS_PER_US;
+}
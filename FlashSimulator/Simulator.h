@@ -0,0 +1,201 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Simulator.h
+*  Subsystem  : PC (Linux) - Logic simulator
+*  Procedures : N/A
+*
+*  Abstract   : Simulated C167 Logic for running FlashMain without a board.
+*               The PC side (the DLL sources, unchanged) and the simulated
+*               Logic are joined by an in-process loopback that runs on a
+*               virtual clock: every byte occupies the line for 10 bit
+*               times at its baud rate and every FLASH operation takes the
+*               time of the device model, so runs are repeatable.
+*  Compiler   : gcc
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Target_resident
+*  17 Oct 2026
+*    Verified download ('x'); link noise and power loss for testing it
+*  17 Oct 2026
+*    Packed 'x' blocks
+*  17 Oct 2026
+*    Bytes to and from stage3 recorded for stage3host
+**************************************************************************/
+
+/* Virtual time in nanoseconds */
+typedef unsigned long long sim_ns_t;
+
+#define  NS_PER_US                        1000ULL
+#define  NS_PER_MS                        1000000ULL
+#define  NS_PER_S                         1000000000ULL
+
+/* Start bit, 8 data bits and a stop bit */
+#define  BITS_PER_UART_BYTE               10
+
+/* Largest difference (percent) between two baud rates that still lets
+   bytes through; the C167 UART samples each bit 3 times around the middle */
+#define  BAUD_MATCH_PERCENT               3
+
+/* FLASH of the Logic */
+#define  SIM_FLASH_START                  0x100000UL
+#define  SIM_FLASH_SIZE                   0x100000UL
+
+/* Receive buffer of the third stage loader (START_OF_DOWNLOAD_SRAM) */
+#define  SIM_SRAM_SIZE                    (6UL + 0xffffUL)
+
+/* C167 time spent by the third stage loader itself */
+#define  WORD_LOOP_NS                     1000ULL    /* per word in Program_flash */
+#define  CRC_NS_PER_BYTE                  1500ULL    /* Crc_xx_block */
+#define  UNPACK_NS_PER_BYTE               500ULL     /* Unpack_block, per byte out */
+#define  BAUD_SWITCH_DELAY_NS             (10 * NS_PER_MS)   /* BAUD_SWITCH_DELAY_LOOPS */
+#define  BAUD_CONFIRM_NS                  (1000 * NS_PER_MS) /* BAUD_CONFIRM_LOOPS */
+#define  VERIFY_TIMEOUT_NS                (125 * NS_PER_MS)  /* VERIFY_TIMEOUT_LOOPS */
+
+/* Blocks behind the next one an 'x' block is acknowledged again for
+   (VERIFY_WINDOW) */
+#define  SIM_VERIFY_WINDOW                16
+
+/* Optional features of the simulated third stage loader */
+#define  SIM_CAPABILITIES                 (CAP_PIPELINED_DOWNLOAD | \
+                                           CAP_SECTOR_DIGEST      | \
+                                           CAP_BAUD_SWITCH        | \
+                                           CAP_VERIFIED_DOWNLOAD  | \
+                                           CAP_ERASE_ON_DEMAND    | \
+                                           CAP_COMPRESSED_BLOCKS)
+
+/* Packed 'x' blocks: MAX_PACKED_BYTES and MAX_UNPACKED_BYTES of stage3 */
+#define  SIM_MAX_PACKED                   0x4000
+#define  SIM_MAX_UNPACKED                 0x8000
+
+/* Most sectors in a sector map (Target_get_sector) */
+#define  SIM_MAX_SECTORS                  256
+
+/* Where the Logic is in the boot sequence */
+#define  TGT_WAIT_FOR_ZERO                0   /* boot strap loader autobaud */
+#define  TGT_STAGE1                       1   /* BSL receiving 32 bytes */
+#define  TGT_STAGE2                       2   /* stage1 receiving stage2 */
+#define  TGT_STAGE3                       3   /* stage2 receiving stage3 */
+#define  TGT_COMMAND                      4   /* stage3 waiting for a command */
+#define  TGT_ARGUMENTS                    5   /* stage3 receiving command data */
+#define  TGT_PIPE_HEADER                  6   /* 'w' block header */
+#define  TGT_PIPE_DATA                    7   /* 'w' block data */
+#define  TGT_BAUD_TEST                    8   /* 'n' test pattern */
+#define  TGT_BAUD_CONFIRM                 9   /* 'n' confirmation byte */
+#define  TGT_RESET                        10  /* 'S' done; application running */
+#define  TGT_VERIFY_SEQ                   11  /* 'x' block sequence number */
+#define  TGT_VERIFY_BLOCK                 12  /* 'x' header, data and CRC */
+#define  TGT_DEAD                         13  /* power lost ("--cut") */
+
+/* Erase and program times of one FLASH part (datasheet typical values) */
+struct device_model_t
+{
+    const char *name;           /* command line name */
+    const char *description;
+    unsigned char id;           /* answer to 'f' ('1' ... '7') */
+    unsigned long program_word_ns;  /* one 16 bit word (both chips of a
+                                       byte wide pair in parallel) */
+    unsigned long sector_erase_ms;  /* sector of 64K or more */
+    unsigned long small_erase_ms;   /* parameter / boot sector below 64K */
+    unsigned long chip_erase_ms;    /* 'e'; 0 if erased sector by sector */
+};
+
+/* Time the Logic spent in each kind of work */
+struct target_stats_t
+{
+    sim_ns_t stage3_ready_ns;   /* last stage3 byte echoed */
+    sim_ns_t erase_ns;
+    sim_ns_t program_ns;
+    sim_ns_t crc_ns;
+    unsigned long bytes_received;
+    unsigned long bytes_sent;
+    unsigned long words_programmed;
+    unsigned long blocks_programmed;
+    unsigned long sectors_erased;
+    unsigned long garbled_bytes;    /* received at the wrong baud rate */
+    unsigned long blocks_rejected;  /* 'x' blocks answered "$X" */
+};
+
+struct target_t
+{
+    const struct device_model_t *device;
+    unsigned char cpu_code;     /* boot strap loader acknowledge */
+    unsigned long fcpu_hz;      /* CPU clock; sets the reachable baud rates */
+    unsigned char legacy;       /* TRUE: original command set only */
+    unsigned long stage_bytes[3];   /* size of stage1, stage2 and stage3 */
+    unsigned long cut_blocks;   /* blocks programmed before the power is
+                                   lost; 0 for never */
+    FILE *record_pc;            /* "--record": bytes stage3 received */
+    FILE *record_logic;         /* and the bytes it sent */
+
+    int phase;                  /* TGT_xxx */
+    sim_ns_t now;               /* the Logic's own clock */
+    sim_ns_t tx_free;           /* when the transmitter is free again */
+    sim_ns_t deadline;          /* baud test timeout */
+    unsigned int s0bg;          /* baud rate reload of the UART */
+    unsigned int old_s0bg;      /* rate to return to if a switch fails */
+    unsigned int new_s0bg;      /* rate accepted by 'n' */
+    unsigned long count;        /* bytes of the current phase */
+
+    unsigned char command;      /* command receiving arguments */
+    unsigned char args[17];     /* 'r' has the most */
+    unsigned int num_args;
+    unsigned int args_needed;
+    unsigned char seq;          /* 'w' / 'x' block sequence number */
+    unsigned char expected;     /* 'x' sequence number to program next */
+    unsigned long block_crc;    /* 'x' CRC of the bytes received */
+    unsigned long block_size;   /* data bytes of the current block */
+    unsigned char block_packed; /* TRUE if the 'x' block data is packed */
+
+    unsigned long total_bytes;  /* 't' count still expected */
+    unsigned char erase_on_demand;  /* 'a': sectors erased when reached */
+    unsigned char sector_erased[SIM_MAX_SECTORS];
+    unsigned char crc_width;
+    unsigned long crc_address;
+    unsigned long crc_result;
+
+    unsigned char sram[SIM_SRAM_SIZE];
+    unsigned char packed[SIM_MAX_PACKED];   /* PACKED_BLOCK_SRAM */
+    unsigned char flash[SIM_FLASH_SIZE];
+
+    struct target_stats_t stats;
+};
+
+/* Target.c */
+const struct device_model_t *Find_device_model (const char *name);
+
+void List_device_models (void);
+
+void Target_init (struct target_t *t, const struct device_model_t *device,
+                  unsigned char cpu_code, unsigned long fcpu_hz,
+                  unsigned char legacy, const unsigned long stage_bytes[3]);
+
+void Target_resident (struct target_t *t, long baud);
+
+void Target_receive (struct target_t *t, unsigned char byte,
+                     sim_ns_t arrival, long sender_baud);
+
+void Target_poll (struct target_t *t, sim_ns_t until);
+
+unsigned char Target_downloading (const struct target_t *t);
+
+long Target_baud (const struct target_t *t);
+
+unsigned char Target_get_sector (const struct target_t *t, unsigned char index,
+                                 unsigned long *start, unsigned long *size);
+
+/* Simulator.c */
+void Link_to_pc (unsigned char byte, sim_ns_t arrival, long sender_baud);
+
+sim_ns_t Byte_time_ns (long baud);
+
+unsigned char Baud_mismatch (long baud_a, long baud_b);
@@ -0,0 +1,2077 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Stage3Host.c
+*  Subsystem  : PC (Linux) - third stage loader on the PC
+*  Procedures : main
+*               Hal_address
+*               Hal_flash_read
+*               Hal_flash_write
+*               Hal_reset
+*               io_init
+*               io_getbyte
+*               io_putbyte
+*               Rx_pump
+*               io_getbyte_timeout
+*               Baud_switch_request
+*               Baud_switch
+*               Find_host_device
+*               Load_hex
+*               Load_replay
+*               Build_script
+*               Add_block
+*               Add_byte
+*               Add_long
+*               Command_byte
+*               Amd_write
+*               Intel_write
+*               Program_word
+*               Erase_range
+*               Sector_range
+*               Busy
+*               Finish
+*
+*  Abstract   : Runs the third stage loader sources (MAIN.C, FLASH.C,
+*               SECTOR.C, blkdata.c, CRC.C) built with HOST_BUILD, so
+*               the time the Logic itself spends on a download can be
+*               measured and compared without a board or a serial line.
+*
+*               This file is the loader's HAL (HAL.H) on the PC:
+*               - the FLASH is a model of the part on the external bus,
+*                 following its command sequences, status bits and
+*                 datasheet program and erase times;
+*               - SRAM is a byte array;
+*               - the UART delivers a script of PC commands made from a
+*                 hex file (f, e or a, t, w / x / b+p blocks, z) as fast as the
+*                 loader reads it, so no line time is included.
+*               The loader's time is counted in bus accesses: every FLASH
+*               read or write costs HOST_BUS_CYCLE_NS and every access to
+*               the UART (including each Rx_pump) HOST_UART_POLL_NS. The
+*               instructions in between are not counted.
+*  Compiler   : gcc
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    "--on-demand" sends 'a' instead of 'e'; the FLASH starts with an older
+*    application in it
+*  17 Oct 2026
+*    "--packed" sends packed 'x' blocks
+*  17 Oct 2026
+*    "--replay" sends the bytes FlashMain sent to flashsim's Logic
+**************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu_dep.h"
+#include "hal.h"
+#include "include.h"
+#include "flash.h"
+
+/* HAL.H renames the loader's main() to Stage3_main() */
+#undef  main
+
+/* Virtual time in nanoseconds */
+typedef unsigned long long host_ns_t;
+
+#define  HOST_NS_PER_MS                   1000000ULL
+#define  HOST_NS_PER_S                    1000000000ULL
+
+/* One access of the C167 (20 MHz, one wait state) to the external bus */
+#define  HOST_BUS_CYCLE_NS                100ULL
+
+/* One look at the UART: S0RIR / S0TIR test and the buffer register */
+#define  HOST_UART_POLL_NS                200ULL
+
+/* SRAM of the Logic; holds the download buffer and the receive ring */
+#define  HOST_SRAM_START                  0x200000UL
+#define  HOST_SRAM_SIZE                   0x40000UL
+
+/* Largest block of the script (MAX_BYTES_IN_DOWNLOAD_BLOCK in the DLL),
+   and of a packed script (COMPRESSED_BLOCK_BYTES) */
+#define  HOST_BLOCK_BYTES                 0x8000UL
+#define  HOST_PACKED_BLOCK_BYTES          0x1000UL
+
+/* How the part sits on the 16 bit bus */
+#define  HOST_BUS_AMD_PAIR                0   /* two byte wide parts */
+#define  HOST_BUS_M29W800                 1   /* word wide, commands on D0-D7 */
+#define  HOST_BUS_INTEL                   2   /* Intel command set */
+
+/* State of the FLASH model */
+#define  HOST_READ_ARRAY                  0
+#define  HOST_AUTOSELECT                  1   /* AMD 0x90; Intel ID / query */
+#define  HOST_PROGRAM_SETUP               2   /* AMD 0xA0 / Intel 0x40 seen */
+#define  HOST_ERASE_SETUP                 3   /* AMD 0x80 / Intel 0x20 seen */
+#define  HOST_BYPASS                      4   /* unlock bypass */
+#define  HOST_BYPASS_PROGRAM              5   /* unlock bypass 0xA0 seen */
+#define  HOST_BYPASS_RESET                6   /* unlock bypass 0x90 seen */
+#define  HOST_INTEL_STATUS                7   /* reads return the status */
+
+/* How the script is sent */
+#define  HOST_PIPELINED                   0   /* 'w' */
+#define  HOST_VERIFIED                    1   /* 'x' */
+#define  HOST_LOCKSTEP                    2   /* 'b' and 'p' per block */
+#define  HOST_PACKED                      3   /* 'x', blocks packed */
+
+/* A FLASH part on the bus; same typical times as the simulator (Target.c) */
+struct host_device_t
+{
+    const char *name;           /* command line name */
+    const char *description;
+    UINT_8   bus;               /* HOST_BUS_xxx */
+    UINT_16  man_id;            /* autoselect / intelligent identifier */
+    UINT_16  dev_id;
+    UINT_8   bypass;            /* TRUE if unlock bypass is accepted */
+    unsigned long program_word_ns;
+    unsigned long sector_erase_ms;
+    unsigned long chip_erase_ms;
+};
+
+/* The FLASH model */
+struct host_flash_t
+{
+    const struct host_device_t *device;
+    UINT_16  word[TOTAL_FLASH_EPROM_BYTES / 2];
+    int      state;             /* HOST_xxx */
+    int      unlock;            /* AMD unlock cycles seen (0 - 2) */
+    host_ns_t busy_until;       /* end of the program / erase running */
+    UINT_16  busy_data;         /* word being programmed; 0xFFFF for an erase */
+    UINT_8   failed;            /* last program did not give the data */
+    UINT_8   intel_status;      /* Intel status register error bits */
+};
+
+/* Counters of the run */
+struct host_stats_t
+{
+    unsigned long bus_reads;
+    unsigned long bus_writes;
+    unsigned long status_reads; /* reads while the part was busy */
+    unsigned long uart_polls;
+    unsigned long words_programmed;
+    unsigned long sectors_erased;
+    host_ns_t program_ns;       /* time the part spent programming */
+    host_ns_t erase_ns;
+    host_ns_t phase_ns[26];     /* per command letter */
+    unsigned long phase_count[26];
+};
+
+static const struct host_device_t *Find_host_device (const char *name);
+static unsigned char Load_hex (const char *name);
+static unsigned char Load_replay (const char *name);
+static void Build_script (int mode, UINT_8 on_demand);
+static void Add_block (int mode, UINT_8 seq, UINT_32 address,
+                       const UINT_8 *data, UINT_16 length);
+static void Add_byte (UINT_8 byte);
+static void Add_long (UINT_32 value);
+static int  Command_byte (UINT_16 data);
+static void Amd_write (UINT_32 offset, UINT_16 data);
+static void Intel_write (UINT_32 offset, UINT_16 data);
+static void Program_word (UINT_32 offset, UINT_16 data);
+static void Erase_range (UINT_32 start, UINT_32 size, unsigned long ms);
+static void Sector_range (UINT_32 offset, UINT_32 *start, UINT_32 *size);
+static UINT_8 Busy (void);
+static void Finish (const char *reason);
+
+/* The DLL's packer (Compress.c), so packed blocks are the ones FlashMain
+   sends */
+unsigned long Pack_block (const unsigned char *data, unsigned long length,
+                          unsigned char *packed, unsigned long max_packed);
+
+static const struct host_device_t host_devices[] =
+{
+    /* name           description                 bus                id                                       bypass word ns  sector chip */
+    { "amd29f040",    "AMD 29F040 (x2)",          HOST_BUS_AMD_PAIR, AMD_MAN_ID,   AMD_29F040_DEV_ID,    FALSE, 7000,   1000,  8000  },
+    { "intel28f800t", "Intel 28F800 top boot",    HOST_BUS_INTEL,    INTEL_MAN_ID, INTEL_28F800T_DEV_ID, FALSE, 9000,   1000,  0     },
+    { "intel28f800b", "Intel 28F800 bottom boot", HOST_BUS_INTEL,    INTEL_MAN_ID, INTEL_28F800B_DEV_ID, FALSE, 9000,   1000,  0     },
+    { "m29w800",      "ST M29W800",               HOST_BUS_M29W800,  0x0020,       M29W800_DEV_ID,       TRUE,  10000,  800,   12000 },
+    { "sst39sf040",   "SST 39SF040 (x2)",         HOST_BUS_AMD_PAIR, SST_MAN_ID,   SST_39SF040_DEV_ID,   FALSE, 14000,  18,    70    },
+    { NULL,           NULL,                       0,                 0,            0,                    FALSE, 0,      0,     0     }
+};
+
+static struct host_flash_t flash;
+static struct host_stats_t stats;
+static UINT_8 sram[HOST_SRAM_SIZE];
+static host_ns_t now;           /* the Logic's clock */
+
+/* Hex file */
+static UINT_8 image[TOTAL_FLASH_EPROM_BYTES];
+static UINT_8 image_present[TOTAL_FLASH_EPROM_BYTES];
+static unsigned long image_bytes;
+
+/* Bytes from the "PC"; command[] holds the command letter at the first
+   byte of every command, 0 elsewhere */
+static UINT_8 *script;
+static UINT_8 *command;
+static unsigned long script_length;
+static unsigned long script_size;
+static unsigned long script_pos;
+
+/* Bytes to the "PC" */
+static unsigned long replies;
+static unsigned long reply_errors;  /* answers starting with '$' */
+static UINT_8 reply_prefix;         /* '*' or '$' of the answer being sent */
+static int reply_state;             /* 0 first byte, 1 letter, 2 sequence */
+
+/* "--replay": what flashsim's Logic answered to the same bytes */
+static UINT_8 *recorded_replies;
+static unsigned long recorded_length;
+static unsigned long first_difference;  /* reply byte number + 1; 0 if none */
+
+static int phase;               /* command letter running; 0 before the first */
+static host_ns_t phase_start;
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: main
+*
+*  ABSTRACT:
+*     Downloads a hex file with the third stage loader running on the PC
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       argc            int         number of arguments
+*       argv            char *[]    [options] <hex file>
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           0 if the FLASH holds the hex file (returned through
+*                     Finish, since the loader does not return)
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Options:
+*       --device=<name>     FLASH part (default m29w800)
+*       --verified          blocks sent with 'x' instead of 'w'
+*       --lockstep          blocks sent with 'b' and 'p'
+*       --packed            blocks sent with 'x' and packed as the DLL
+*                           packs them (Pack_block)
+*       --on-demand         'a' instead of 'e': sectors erased as reached
+*       --replay=<name>     the bytes FlashMain sent, recorded by
+*                           "flashsim --record=<name>", instead of a script
+*                           made from the hex file; the loader's answers
+*                           must be the ones the simulated Logic gave
+*   The FLASH starts with every word 0x0000 (an older application), so the
+*   erase time of the part is included and a sector the loader fails to
+*   erase before programming shows up as a mismatch.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     "--on-demand"; FLASH starts programmed
+*  17 Oct 2026
+*     "--packed"
+*  17 Oct 2026
+*     "--replay"
+******************************************************************************/
+int main (int argc, char *argv[])
+{
+    int mode = HOST_PIPELINED;
+    UINT_8 on_demand = FALSE;
+    const char *replay_name = NULL;
+    int arg;
+
+    flash.device = Find_host_device ("m29w800");
+
+    for (arg = 1; (arg < argc) && !strncmp (argv[arg], "--", 2); arg++)
+    {
+        if (!strncmp (argv[arg], "--device=", 9))
+        {
+            flash.device = Find_host_device (argv[arg] + 9);
+            if (flash.device == NULL)
+            {
+                printf ("** Unknown device %s\n", argv[arg] + 9);
+                return (1);
+            }
+        }
+        else if (!strcmp (argv[arg], "--verified"))
+        {
+            mode = HOST_VERIFIED;
+        }
+        else if (!strcmp (argv[arg], "--lockstep"))
+        {
+            mode = HOST_LOCKSTEP;
+        }
+        else if (!strcmp (argv[arg], "--packed"))
+        {
+            mode = HOST_PACKED;
+        }
+        else if (!strcmp (argv[arg], "--on-demand"))
+        {
+            on_demand = TRUE;
+        }
+        else if (!strncmp (argv[arg], "--replay=", 9))
+        {
+            replay_name = argv[arg] + 9;
+        }
+        else
+        {
+            printf ("** Unknown option %s\n", argv[arg]);
+            return (1);
+        }
+    }
+
+    if (arg != argc - 1)
+    {
+        printf ("\tUsage is: stage3host [--device=<name>] [--verified | --lockstep | --packed] [--on-demand]\n"
+                "\t                     [--replay=<flashsim record>] <hex file>\n");
+        printf ("\tdevices:");
+        for (arg = 0; host_devices[arg].name != NULL; arg++)
+        {
+            printf (" %s", host_devices[arg].name);
+        }
+        printf ("\n");
+        return (1);
+    }
+
+    if (Load_hex (argv[arg]) == FALSE)
+    {
+        return (1);
+    }
+
+    memset (flash.word, 0x00, sizeof (flash.word));
+    if (replay_name != NULL)
+    {
+        if (Load_replay (replay_name) == FALSE)
+        {
+            return (1);
+        }
+        printf ("\n ** Third stage loader on the PC: %s, bytes FlashMain sent (%s)\n",
+                flash.device->description, replay_name);
+    }
+    else
+    {
+        Build_script (mode, on_demand);
+        printf ("\n ** Third stage loader on the PC: %s, %s, %s\n",
+                flash.device->description, (mode == HOST_VERIFIED) ? "'x' blocks" :
+                (mode == HOST_PACKED) ? "packed 'x' blocks" :
+                (mode == HOST_LOCKSTEP) ? "'b' / 'p' blocks" : "'w' blocks",
+                (on_demand == TRUE) ? "erase on demand" : "chip erase");
+    }
+
+    Stage3_main();
+
+    Finish ("loader returned");
+    return (1);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Hal_address
+*
+*  ABSTRACT:
+*     Pointer to a C167 address (HAL_ADDRESS)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       address         UINT_32     FLASH or SRAM address of the Logic
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       void *          where the location is kept on the PC
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Reading FLASH through this pointer returns the array, as the part
+*   does in read mode; commands must use Hal_flash_read / Hal_flash_write.
+*   Any other address ends the run.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void *Hal_address (UINT_32 address)
+{
+    if ((address >= FLASH_EPROM_START) &&
+            (address < FLASH_EPROM_START + TOTAL_FLASH_EPROM_BYTES))
+    {
+        return ((UINT_8 *)flash.word + (address - FLASH_EPROM_START));
+    }
+
+    if ((address >= HOST_SRAM_START) &&
+            (address < HOST_SRAM_START + HOST_SRAM_SIZE))
+    {
+        return (&sram[address - HOST_SRAM_START]);
+    }
+
+    printf ("** Loader accessed %06X, outside FLASH and SRAM\n", address);
+    Finish ("bad address");
+    return (NULL);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Hal_flash_read
+*
+*  ABSTRACT:
+*     Bus read of the FLASH (FLASH_READ)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       flash_ptr       UINT_16 *   from HAL_ADDRESS
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       UINT_16         what the part drives on the bus
+*
+*  FUNCTIONAL DESCRIPTION:
+*     While a program or erase runs an AMD style part returns DQ7 inverted
+*   (0 during an erase) and DQ6 toggling; an Intel part returns its status
+*   register with bit 7 clear. A program that could not set the data
+*   leaves DQ5 (AMD) or status bit 4 (Intel) set until the part is reset.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+UINT_16 Hal_flash_read (UINT_16 *flash_ptr)
+{
+    UINT_32 offset;
+    UINT_16 lanes;              /* data lines driven by the status */
+    UINT_8  busy;
+
+    offset = (UINT_32) ((UINT_8 *)flash_ptr - (UINT_8 *)flash.word);
+    now += HOST_BUS_CYCLE_NS;
+    stats.bus_reads++;
+    busy = Busy();
+    if (busy == TRUE)
+    {
+        stats.status_reads++;
+    }
+
+    lanes = (flash.device->bus == HOST_BUS_AMD_PAIR) ? 0xffff : 0x00ff;
+
+    if (flash.device->bus == HOST_BUS_INTEL)
+    {
+        switch (flash.state)
+        {
+            case HOST_INTEL_STATUS:
+                return ((busy == TRUE) ? 0x0000 : (0x0080 | flash.intel_status));
+
+            case HOST_AUTOSELECT:
+                return (((offset >> 1) & 1) ? flash.device->dev_id :
+                        flash.device->man_id);
+
+            default:
+                return (flash.word[offset >> 1]);
+        }
+    }
+
+    if (busy == TRUE)
+    {
+        /* DQ7 inverted, DQ6 toggling */
+        return ((~flash.busy_data & 0x8080 & lanes) |
+                (((UINT_16)now & 0x100) ? (0x4040 & lanes) : 0));
+    }
+
+    if (flash.failed == TRUE)
+    {
+        /* DQ7 still inverted, DQ5 (exceeded timing limits) set */
+        return ((~flash.busy_data & 0x8080 & lanes) | (0x2020 & lanes));
+    }
+
+    if (flash.state == HOST_AUTOSELECT)
+    {
+        return (((offset >> 1) & 1) ? flash.device->dev_id : flash.device->man_id);
+    }
+
+    return (flash.word[offset >> 1]);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Hal_flash_write
+*
+*  ABSTRACT:
+*     Bus write to the FLASH (FLASH_WRITE)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       flash_ptr       UINT_16 *   from HAL_ADDRESS
+*       data            UINT_16     word written
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Writes are ignored while the part is busy.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Hal_flash_write (UINT_16 *flash_ptr, UINT_16 data)
+{
+    UINT_32 offset;
+
+    offset = (UINT_32) ((UINT_8 *)flash_ptr - (UINT_8 *)flash.word);
+    now += HOST_BUS_CYCLE_NS;
+    stats.bus_writes++;
+
+    if (Busy() == TRUE)
+    {
+        return;
+    }
+
+    if (flash.device->bus == HOST_BUS_INTEL)
+    {
+        Intel_write (offset, data);
+    }
+    else
+    {
+        Amd_write (offset, data);
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Hal_reset
+*
+*  ABSTRACT:
+*     Software reset of the Logic (SOFTWARE_RESET)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None (does not return)
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Hal_reset (void)
+{
+    Finish ("software reset");
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: io_init
+*
+*  ABSTRACT:
+*     UART start up (SERIAL.C io_init)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Nothing to do; the script is read directly.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void io_init (void)
+{
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: io_getbyte
+*
+*  ABSTRACT:
+*     Next byte of the script (SERIAL.C io_getbyte)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       UINT_8          byte from the "PC"
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The time since the last command byte is charged to that command.
+*   The run ends when the loader waits for a byte after the last one.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+UINT_8 io_getbyte (void)
+{
+    if (script_pos == script_length)
+    {
+        Finish (NULL);
+    }
+
+    now += HOST_UART_POLL_NS;
+    stats.uart_polls++;
+
+    if (command[script_pos] != 0)
+    {
+        if (phase != 0)
+        {
+            stats.phase_ns[phase - 'a'] += now - phase_start;
+        }
+        phase = command[script_pos];
+        phase_start = now;
+        stats.phase_count[phase - 'a']++;
+    }
+
+    return (script[script_pos++]);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: io_putbyte
+*
+*  ABSTRACT:
+*     Byte to the "PC" (SERIAL.C io_putbyte)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       byte            UINT_8      byte transmitted
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Only counted. An answer starting with '$' is an error; the byte
+*   after "*P", "$P", "$X" and "*V" is a sequence number or the
+*   capabilities and is not taken as the start of an answer.
+*     With "--replay" each byte is compared with the one the simulated
+*   Logic sent in its place.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Compared with the recorded answers
+******************************************************************************/
+void io_putbyte (UINT_8 byte)
+{
+    now += HOST_UART_POLL_NS;
+    stats.uart_polls++;
+
+    if ((recorded_replies != NULL) && (first_difference == 0) &&
+            ((replies >= recorded_length) || (recorded_replies[replies] != byte)))
+    {
+        first_difference = replies + 1;
+    }
+
+    switch (reply_state)
+    {
+        case 1:
+            if (reply_prefix == '$')
+            {
+                reply_errors++;
+            }
+            reply_state = ((byte == 'P') || (byte == 'X') || (byte == 'V')) ? 2 : 0;
+            break;
+
+        case 2:
+            reply_state = 0;
+            break;
+
+        default:
+            if ((byte == '*') || (byte == '$'))
+            {
+                reply_prefix = byte;
+                reply_state = 1;
+            }
+            break;
+    }
+
+    replies++;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Rx_pump
+*
+*  ABSTRACT:
+*     Receiver service while the FLASH is busy (SERIAL.C Rx_pump)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Costs one look at the UART; the script needs no ring.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Rx_pump (void)
+{
+    now += HOST_UART_POLL_NS;
+    stats.uart_polls++;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: io_getbyte_timeout
+*
+*  ABSTRACT:
+*     Next byte of the script unless it has ended (SERIAL.C)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       loops           UINT_32     polls before giving up
+*       byte            UINT_8 *    byte received
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE if a byte was received, FALSE on timeout
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+UINT_8 io_getbyte_timeout (UINT_32 loops, UINT_8 *byte)
+{
+    if (script_pos == script_length)
+    {
+        now += loops * HOST_UART_POLL_NS;
+        stats.uart_polls += loops;
+        return (FALSE);
+    }
+
+    *byte = io_getbyte();
+    return (TRUE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Baud_switch_request
+*
+*  ABSTRACT:
+*     'n' on the PC (SERIAL.C)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       globs        struct interface_data_t *    shared variables
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       BAUD_SWITCH_REJECTED; there is no line to switch
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+State_t Baud_switch_request (struct interface_data_t *globs)
+{
+    io_getbyte();
+    io_getbyte();
+    return (BAUD_SWITCH_REJECTED);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Baud_switch
+*
+*  ABSTRACT:
+*     'n' on the PC (SERIAL.C)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       globs        struct interface_data_t *    shared variables
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Never called, since every request is rejected.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Baud_switch (struct interface_data_t *globs)
+{
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Find_host_device
+*
+*  ABSTRACT:
+*     Looks up a FLASH part by its command line name
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       name            const char *    e.g. "m29w800"
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       const struct host_device_t *    NULL if the name is not known
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static const struct host_device_t *Find_host_device (const char *name)
+{
+    int i;
+
+    for (i = 0; host_devices[i].name != NULL; i++)
+    {
+        if (!strcmp (host_devices[i].name, name))
+        {
+            return (&host_devices[i]);
+        }
+    }
+    return (NULL);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Load_hex
+*
+*  ABSTRACT:
+*     Reads the Intel Hex file to be downloaded
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       name            const char *    hex file
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned char   TRUE if read, FALSE otherwise
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Data (00), extended segment (02) and extended linear (04) address
+*   records are used; checksums are not checked, the DLL's parser does
+*   that. Every byte must be in the FLASH.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Load_hex (const char *name)
+{
+    char line[600];
+    unsigned int count;
+    unsigned int address;
+    unsigned int type;
+    unsigned int value;
+    UINT_32 base;
+    UINT_32 offset;
+    unsigned int i;
+    FILE *fp;
+
+    fp = fopen (name, "r");
+    if (fp == NULL)
+    {
+        printf ("** Unable to open %s\n", name);
+        return (FALSE);
+    }
+
+    base = 0;
+    while (fgets (line, sizeof (line), fp) != NULL)
+    {
+        if ((line[0] != ':') ||
+                (sscanf (line + 1, "%2x%4x%2x", &count, &address, &type) != 3))
+        {
+            continue;
+        }
+
+        if ((type == 2) || (type == 4))
+        {
+            sscanf (line + 9, "%4x", &value);
+            base = (type == 2) ? (value << 4) : (value << 16);
+            continue;
+        }
+        if (type != 0)
+        {
+            continue;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            offset = base + address + i - FLASH_EPROM_START;
+            if ((base + address + i < FLASH_EPROM_START) ||
+                    (offset >= TOTAL_FLASH_EPROM_BYTES) ||
+                    (sscanf (line + 9 + 2 * i, "%2x", &value) != 1))
+            {
+                printf ("** %s: byte at %06X is not in the FLASH\n", name,
+                        base + address + i);
+                fclose (fp);
+                return (FALSE);
+            }
+            if (image_present[offset] == FALSE)
+            {
+                image_bytes++;
+            }
+            image[offset] = (UINT_8)value;
+            image_present[offset] = TRUE;
+        }
+    }
+
+    fclose (fp);
+    return (TRUE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Load_replay
+*
+*  ABSTRACT:
+*     Reads a download recorded by "flashsim --record"
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       name            const char *    <name>.pc and <name>.logic
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned char   TRUE if both files were read, FALSE otherwise
+*
+*  FUNCTIONAL DESCRIPTION:
+*     <name>.pc becomes the script: every byte the simulated Logic received
+*   once stage3 was running. <name>.logic holds what it sent back. The
+*   command letters are not known, so no time is charged per command.
+*     Only the bytes are recorded, not when they came: a download in which
+*   the Logic acted on a timeout ("--drop") or switched the baud rate
+*   (stage3host rejects 'n') does not replay.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Load_replay (const char *name)
+{
+    char file_name[300];
+    unsigned long replies_size = 0x10000;
+    FILE *fp;
+    int c;
+
+    script_size = 0x10000;
+    script = malloc (script_size);
+    command = calloc (script_size, 1);
+    recorded_replies = malloc (replies_size);
+    if ((script == NULL) || (command == NULL) || (recorded_replies == NULL))
+    {
+        printf ("** Out of memory\n");
+        return (FALSE);
+    }
+
+    snprintf (file_name, sizeof (file_name), "%s.pc", name);
+    fp = fopen (file_name, "rb");
+    if (fp == NULL)
+    {
+        printf ("** Unable to open %s\n", file_name);
+        return (FALSE);
+    }
+    while ((c = fgetc (fp)) != EOF)
+    {
+        Add_byte ((UINT_8)c);
+    }
+    fclose (fp);
+
+    snprintf (file_name, sizeof (file_name), "%s.logic", name);
+    fp = fopen (file_name, "rb");
+    if (fp == NULL)
+    {
+        printf ("** Unable to open %s\n", file_name);
+        return (FALSE);
+    }
+    while ((c = fgetc (fp)) != EOF)
+    {
+        if (recorded_length == replies_size)
+        {
+            replies_size *= 2;
+            recorded_replies = realloc (recorded_replies, replies_size);
+            if (recorded_replies == NULL)
+            {
+                printf ("** Out of memory\n");
+                fclose (fp);
+                return (FALSE);
+            }
+        }
+        recorded_replies[recorded_length++] = (UINT_8)c;
+    }
+    fclose (fp);
+
+    return (TRUE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Build_script
+*
+*  ABSTRACT:
+*     Makes the bytes FlashMain would send for the hex file
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       mode            int         HOST_PIPELINED, HOST_VERIFIED,
+*                                   HOST_PACKED or HOST_LOCKSTEP
+*       on_demand       UINT_8      TRUE to send 'a' with no programmed
+*                                   ranges instead of 'e'
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     'f', 'e' (or 'a'), 't' and the blocks, then 'z'. A block is a run of bytes
+*   present in the hex file, at most HOST_BLOCK_BYTES (HOST_PACKED_BLOCK_BYTES
+*   when packed) long and starting at an even address (an odd start is
+*   padded with 0xFF, which the loader skips).
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     'a' in place of 'e'
+*  17 Oct 2026
+*     Packed blocks
+******************************************************************************/
+static void Build_script (int mode, UINT_8 on_demand)
+{
+    UINT_32 total;
+    UINT_32 start;
+    UINT_32 end;
+    UINT_32 offset;
+    UINT_32 max_block;
+    UINT_8  seq;
+    int pass;
+
+    max_block = (mode == HOST_PACKED) ? HOST_PACKED_BLOCK_BYTES : HOST_BLOCK_BYTES;
+
+    /* First pass sizes the 't' count, second one adds the blocks */
+    total = 4;
+    for (pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1)
+        {
+            command[script_length] = 'f';
+            Add_byte ('f');
+            if (on_demand == TRUE)
+            {
+                command[script_length] = 'a';
+                Add_byte ('a');
+                Add_byte (0);
+                Add_byte (0);
+            }
+            else
+            {
+                command[script_length] = 'e';
+                Add_byte ('e');
+            }
+            command[script_length] = 't';
+            Add_byte ('t');
+            Add_long (total);
+            if (mode != HOST_LOCKSTEP)
+            {
+                command[script_length] = (mode == HOST_PIPELINED) ? 'w' : 'x';
+                Add_byte (command[script_length]);
+            }
+        }
+
+        seq = 0;
+        offset = 0;
+        while (offset < TOTAL_FLASH_EPROM_BYTES)
+        {
+            if (image_present[offset] == FALSE)
+            {
+                offset++;
+                continue;
+            }
+
+            start = offset & ~1UL;
+            end = offset;
+            while ((end < TOTAL_FLASH_EPROM_BYTES) && (image_present[end] == TRUE) &&
+                    (end - start < max_block))
+            {
+                if (image_present[start] == FALSE)
+                {
+                    image[start] = 0xff;
+                }
+                end++;
+            }
+
+            if (pass == 0)
+            {
+                total += 6 + (end - start);
+            }
+            else
+            {
+                Add_block (mode, seq++, FLASH_EPROM_START + start, &image[start],
+                           (UINT_16) (end - start));
+            }
+            offset = end;
+        }
+
+        if (pass == 0)
+        {
+            script_size = total + 1024;
+            script = malloc (script_size);
+            command = calloc (script_size, 1);
+        }
+    }
+
+    if (mode != HOST_LOCKSTEP)
+    {
+        Add_block (mode, seq, 0, NULL, 0);
+    }
+
+    command[script_length] = 'z';
+    Add_byte ('z');
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Add_block
+*
+*  ABSTRACT:
+*     Adds one block to the script
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       mode            int             HOST_xxx
+*       seq             UINT_8          'w' / 'x' sequence number
+*       address         UINT_32         FLASH address
+*       data            const UINT_8 *  bytes; NULL for the empty block
+*       length          UINT_16         number of bytes
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Same framing as Pipeline.c: sequence number (not for 'b'), 4 address
+*   and 2 length bytes MSB first, the data and, for 'x', the CRC-32 of
+*   all of them seeded with the sequence number. Packed, the data is
+*   replaced by Pack_block's when that is shorter, with PACKED_BLOCK_FLAG
+*   in the length.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Packed blocks
+******************************************************************************/
+static void Add_block (int mode, UINT_8 seq, UINT_32 address,
+                       const UINT_8 *data, UINT_16 length)
+{
+    UINT_8 packed[HOST_PACKED_BLOCK_BYTES];
+    unsigned long packed_length;
+    unsigned long first;
+    unsigned long i;
+    UINT_16 size_field;     /* length as sent */
+    UINT_32 crc;
+
+    size_field = length;
+    if ((mode == HOST_PACKED) && (length != 0))
+    {
+        packed_length = Pack_block (data, length, packed, length - 1);
+        if (packed_length != 0)
+        {
+            data = packed;
+            length = (UINT_16)packed_length;
+            size_field = PACKED_BLOCK_FLAG | length;
+        }
+    }
+
+    if (mode == HOST_LOCKSTEP)
+    {
+        command[script_length] = 'b';
+        Add_byte ('b');
+    }
+    else
+    {
+        Add_byte (seq);
+    }
+
+    first = script_length;
+    Add_long (address);
+    Add_byte ((UINT_8) (size_field >> 8));
+    Add_byte ((UINT_8)size_field);
+    for (i = 0; i < length; i++)
+    {
+        Add_byte (data[i]);
+    }
+
+    if ((mode == HOST_VERIFIED) || (mode == HOST_PACKED))
+    {
+        Make_crc_table_32 (DIGEST_POLYNOMIAL, digest_table);
+        crc = seq;
+        for (i = first; i < script_length; i++)
+        {
+            crc = ((crc << 8) | script[i]) ^ digest_table[crc >> 24];
+        }
+        Add_long (crc);
+    }
+
+    if (mode == HOST_LOCKSTEP)
+    {
+        command[script_length] = 'p';
+        Add_byte ('p');
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Add_byte
+*
+*  ABSTRACT:
+*     Appends a byte to the script
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       byte            UINT_8      byte
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Add_byte (UINT_8 byte)
+{
+    if (script_length == script_size)
+    {
+        script_size *= 2;
+        script = realloc (script, script_size);
+        command = realloc (command, script_size);
+        memset (command + script_length, 0, script_size - script_length);
+    }
+    script[script_length++] = byte;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Add_long
+*
+*  ABSTRACT:
+*     Appends 4 bytes to the script, MSB first
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       value           UINT_32     value
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Add_long (UINT_32 value)
+{
+    Add_byte ((UINT_8) (value >> 24));
+    Add_byte ((UINT_8) (value >> 16));
+    Add_byte ((UINT_8) (value >> 8));
+    Add_byte ((UINT_8)value);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Command_byte
+*
+*  ABSTRACT:
+*     Command code an AMD style part sees in a bus write
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       data            UINT_16     word on the bus
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int             command byte; -1 if the two parts of a pair were
+*                       given different bytes
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static int Command_byte (UINT_16 data)
+{
+    if (flash.device->bus == HOST_BUS_AMD_PAIR)
+    {
+        return (((data >> 8) == (data & 0xff)) ? (data & 0xff) : -1);
+    }
+    return (data & 0xff);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Amd_write
+*
+*  ABSTRACT:
+*     Bus write to an AMD style part (29F040, 39SF040, M29W800)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       offset          UINT_32     byte offset in the FLASH
+*       data            UINT_16     word written
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Commands are 0xAA at 5555H, 0x55 at 2AAAH and the command at 5555H
+*   (555H and 2AAH for the word wide M29W800, which decodes A0-A10 only).
+*   0xF0 returns to read mode at any time. The M29W800 also has unlock
+*   bypass: after 0xAA, 0x55, 0x20 a word is programmed with 0xA0 and the
+*   data, and 0x90, 0x00 leaves the mode.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Amd_write (UINT_32 offset, UINT_16 data)
+{
+    UINT_32 cmd_address;
+    UINT_32 unlock_1;
+    UINT_32 unlock_2;
+    UINT_32 start;
+    UINT_32 size;
+    int cmd;
+
+    if (flash.device->bus == HOST_BUS_AMD_PAIR)
+    {
+        cmd_address = (offset >> 1) & 0x7fff;
+        unlock_1 = 0x5555;
+        unlock_2 = 0x2aaa;
+    }
+    else
+    {
+        cmd_address = (offset >> 1) & 0x7ff;
+        unlock_1 = 0x555;
+        unlock_2 = 0x2aa;
+    }
+
+    cmd = Command_byte (data);
+
+    switch (flash.state)
+    {
+        case HOST_PROGRAM_SETUP:
+            flash.state = HOST_READ_ARRAY;
+            Program_word (offset, data);
+            return;
+
+        case HOST_BYPASS:
+            if (cmd == 0xa0)
+            {
+                flash.state = HOST_BYPASS_PROGRAM;
+            }
+            else if (cmd == 0x90)
+            {
+                flash.state = HOST_BYPASS_RESET;
+            }
+            return;
+
+        case HOST_BYPASS_PROGRAM:
+            flash.state = HOST_BYPASS;
+            Program_word (offset, data);
+            return;
+
+        case HOST_BYPASS_RESET:
+            flash.state = (cmd == 0x00) ? HOST_READ_ARRAY : HOST_BYPASS;
+            return;
+
+        default:
+            break;
+    }
+
+    if (cmd == 0xf0)
+    {
+        flash.state = HOST_READ_ARRAY;
+        flash.unlock = 0;
+        flash.failed = FALSE;
+        return;
+    }
+
+    if ((flash.unlock == 0) && (cmd_address == unlock_1) && (cmd == 0xaa))
+    {
+        flash.unlock = 1;
+        return;
+    }
+    if ((flash.unlock == 1) && (cmd_address == unlock_2) && (cmd == 0x55))
+    {
+        flash.unlock = 2;
+        return;
+    }
+    if (flash.unlock != 2)
+    {
+        flash.unlock = 0;
+        return;
+    }
+
+    flash.unlock = 0;
+
+    if ((flash.state == HOST_ERASE_SETUP) && (cmd == 0x30))
+    {
+        Sector_range (offset, &start, &size);
+        Erase_range (start, size, flash.device->sector_erase_ms);
+        flash.state = HOST_READ_ARRAY;
+        return;
+    }
+    if (cmd_address != unlock_1)
+    {
+        return;
+    }
+
+    switch (cmd)
+    {
+        case 0xa0:
+            flash.state = HOST_PROGRAM_SETUP;
+            break;
+
+        case 0x90:
+            flash.state = HOST_AUTOSELECT;
+            break;
+
+        case 0x80:
+            flash.state = HOST_ERASE_SETUP;
+            break;
+
+        case 0x10:
+            if (flash.state == HOST_ERASE_SETUP)
+            {
+                Erase_range (0, TOTAL_FLASH_EPROM_BYTES, flash.device->chip_erase_ms);
+                flash.state = HOST_READ_ARRAY;
+            }
+            break;
+
+        case 0x20:
+            if (flash.device->bypass == TRUE)
+            {
+                flash.state = HOST_BYPASS;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Intel_write
+*
+*  ABSTRACT:
+*     Bus write to an Intel 28F800
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       offset          UINT_32     byte offset in the FLASH
+*       data            UINT_16     word written
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     0x40 / 0x10 program the next word written, 0x20 and 0xD0 erase the
+*   block written to, 0x50 clears the status register, 0x70 reads it,
+*   0x90 / 0x98 read the identifiers and 0xFF returns to read mode.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Intel_write (UINT_32 offset, UINT_16 data)
+{
+    UINT_32 start;
+    UINT_32 size;
+
+    switch (flash.state)
+    {
+        case HOST_PROGRAM_SETUP:
+            flash.state = HOST_INTEL_STATUS;
+            Program_word (offset, data);
+            if (flash.failed == TRUE)
+            {
+                flash.intel_status |= 0x10;
+                flash.failed = FALSE;
+            }
+            return;
+
+        case HOST_ERASE_SETUP:
+            flash.state = HOST_INTEL_STATUS;
+            if ((data & 0xff) == 0xd0)
+            {
+                Sector_range (offset, &start, &size);
+                Erase_range (start, size, flash.device->sector_erase_ms);
+            }
+            else
+            {
+                flash.intel_status |= 0x30;
+            }
+            return;
+
+        default:
+            break;
+    }
+
+    switch (data & 0xff)
+    {
+        case 0x40:
+        case 0x10:
+            flash.state = HOST_PROGRAM_SETUP;
+            break;
+
+        case 0x20:
+            flash.state = HOST_ERASE_SETUP;
+            break;
+
+        case 0x50:
+            flash.intel_status = 0;
+            break;
+
+        case 0x70:
+            flash.state = HOST_INTEL_STATUS;
+            break;
+
+        case 0x90:
+        case 0x98:
+            flash.state = HOST_AUTOSELECT;
+            break;
+
+        case 0xff:
+            flash.state = HOST_READ_ARRAY;
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Program_word
+*
+*  ABSTRACT:
+*     Starts programming a word
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       offset          UINT_32     byte offset in the FLASH
+*       data            UINT_16     word to program
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Bits only go from 1 to 0; if the word does not read back as the data
+*   the part reports a failure once the program time is over.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Program_word (UINT_32 offset, UINT_16 data)
+{
+    UINT_16 *word;
+
+    word = &flash.word[offset >> 1];
+    *word &= data;
+
+    flash.busy_data = data;
+    flash.failed = (*word != data) ? TRUE : FALSE;
+    flash.busy_until = now + flash.device->program_word_ns;
+
+    stats.words_programmed++;
+    stats.program_ns += flash.device->program_word_ns;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Erase_range
+*
+*  ABSTRACT:
+*     Starts erasing part of the FLASH
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       start           UINT_32         byte offset in the FLASH
+*       size            UINT_32         number of bytes
+*       ms              unsigned long   erase time
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Erase_range (UINT_32 start, UINT_32 size, unsigned long ms)
+{
+    memset ((UINT_8 *)flash.word + start, 0xff, size);
+
+    flash.busy_data = 0xffff;
+    flash.failed = FALSE;
+    flash.busy_until = now + ms * HOST_NS_PER_MS;
+
+    stats.sectors_erased++;
+    stats.erase_ns += ms * HOST_NS_PER_MS;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Sector_range
+*
+*  ABSTRACT:
+*     Erase sector holding a FLASH offset
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       offset          UINT_32     byte offset in the FLASH
+*       start           UINT_32 *   first byte of the sector
+*       size            UINT_32 *   bytes in the sector
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     From the datasheets; byte wide parts in pairs have sectors twice the
+*   size of one part's.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Sector_range (UINT_32 offset, UINT_32 *start, UINT_32 *size)
+{
+    switch (flash.device->dev_id)
+    {
+        case SST_39SF040_DEV_ID:
+            *size = 0x2000;
+            break;
+
+        case INTEL_28F800B_DEV_ID:
+            *size = (offset < 0x4000) ? 0x4000 : (offset < 0x8000) ? 0x2000 :
+                    (offset < 0x20000) ? 0x18000 : 0x20000;
+            if ((offset >= 0x8000) && (offset < 0x20000))
+            {
+                *start = 0x8000;
+                return;
+            }
+            break;
+
+        case M29W800_DEV_ID:
+            *size = (offset < 0xf0000) ? 0x10000 : (offset < 0xf8000) ? 0x8000 :
+                    (offset < 0xfc000) ? 0x2000 : 0x4000;
+            break;
+
+        default:
+            *size = 0x20000;
+            break;
+    }
+
+    *start = offset & ~(*size - 1);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Busy
+*
+*  ABSTRACT:
+*     Tells whether a program or erase is still running
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       UINT_8          TRUE while busy
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static UINT_8 Busy (void)
+{
+    return ((now < flash.busy_until) ? TRUE : FALSE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Finish
+*
+*  ABSTRACT:
+*     Prints the results and ends the program
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       reason          const char *    why the loader stopped; NULL when
+*                                       the script is used up
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None (exits with 0 if the FLASH holds the hex file and no command
+*       was answered with '$' or, with "--replay", the answers were the
+*       recorded ones)
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Recorded answers compared
+******************************************************************************/
+static void Finish (const char *reason)
+{
+    static const char *phase_names[26] =
+    {
+        "erase on demand ('a')", "block ('b')", NULL, NULL, "erase ('e')", "identify ('f')",
+        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "program ('p')",
+        NULL, NULL, NULL, "byte count ('t')", NULL, NULL,
+        "download ('w')", "download ('x')", NULL, "end ('z')"
+    };
+    host_ns_t download_ns;
+    unsigned long mismatches;
+    UINT_32 offset;
+    int i;
+
+    if (phase != 0)
+    {
+        stats.phase_ns[phase - 'a'] += now - phase_start;
+    }
+
+    mismatches = 0;
+    for (offset = 0; offset < TOTAL_FLASH_EPROM_BYTES; offset++)
+    {
+        if ((image_present[offset] == TRUE) &&
+                (((UINT_8 *)flash.word)[offset] != image[offset]))
+        {
+            mismatches++;
+        }
+    }
+
+    download_ns = stats.phase_ns['w' - 'a'] + stats.phase_ns['x' - 'a'] +
+                  stats.phase_ns['b' - 'a'] + stats.phase_ns['p' - 'a'];
+
+    if (reason != NULL)
+    {
+        printf (" ** Loader stopped ............................ %s\n", reason);
+    }
+    printf (" ** Logic time (bus and UART accesses) ..... %10.3f s\n",
+            (double)now / HOST_NS_PER_S);
+    for (i = 0; i < 26; i++)
+    {
+        if ((stats.phase_count[i] != 0) && (phase_names[i] != NULL))
+        {
+            printf (" **   %-20s x%-6lu ......... %10.3f s\n", phase_names[i],
+                    stats.phase_count[i], (double)stats.phase_ns[i] / HOST_NS_PER_S);
+        }
+    }
+    printf (" ** FLASH busy erasing (%4lu sectors) ...... %10.3f s\n",
+            stats.sectors_erased, (double)stats.erase_ns / HOST_NS_PER_S);
+    printf (" ** FLASH busy programming (%7lu words) . %10.3f s\n",
+            stats.words_programmed, (double)stats.program_ns / HOST_NS_PER_S);
+    printf (" ** FLASH bus writes ....................... %10lu\n", stats.bus_writes);
+    printf (" ** FLASH bus reads ........................ %10lu\n", stats.bus_reads);
+    printf (" **   while busy (status polls) ............ %10lu\n",
+            stats.status_reads);
+    printf (" ** UART polls ............................. %10lu\n", stats.uart_polls);
+    if (stats.words_programmed != 0)
+    {
+        printf (" ** Download time per word programmed ...... %10.3f us\n",
+                (double)download_ns / stats.words_programmed / 1000.0);
+    }
+    printf (" ** Application bytes ...................... %10lu\n", image_bytes);
+    if (download_ns != 0)
+    {
+        printf (" ** Download throughput .................... %10.0f bytes/s\n",
+                (double)image_bytes * HOST_NS_PER_S / download_ns);
+    }
+    if (reply_errors != 0)
+    {
+        printf (" ** Commands answered with '$' ............. %10lu\n", reply_errors);
+    }
+
+    if (recorded_replies != NULL)
+    {
+        if ((first_difference == 0) && (replies != recorded_length))
+        {
+            first_difference = replies + 1;
+        }
+        if (first_difference == 0)
+        {
+            printf (" ** Answers ................................. MATCH FLASHSIM\n");
+        }
+        else
+        {
+            printf (" ** Answers ......... DIFFER FROM FLASHSIM AT BYTE %lu OF %lu\n",
+                    first_difference, recorded_length);
+        }
+    }
+
+    if (mismatches == 0)
+    {
+        printf (" ** FLASH contents .............................. MATCH HEX FILE\n");
+    }
+    else
+    {
+        printf (" ** FLASH contents .............................. %lu BYTES DIFFER\n",
+                mismatches);
+    }
+
+    /* A replayed run may have had blocks rejected; they were rejected by
+    the simulated Logic too if the answers match */
+    exit (((mismatches == 0) && (first_difference == 0) && (reason == NULL) &&
+           ((reply_errors == 0) || (recorded_replies != NULL))) ? 0 : 1);
+}
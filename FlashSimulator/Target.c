@@ -0,0 +1,2222 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Target.c
+*  Subsystem  : PC (Linux) - Logic simulator
+*  Procedures : Find_device_model
+*               List_device_models
+*               Target_init
+*               Target_resident
+*               Target_receive
+*               Target_poll
+*               Target_downloading
+*               Target_baud
+*               Target_get_sector
+*               Send
+*               Reply
+*               Command
+*               Arguments
+*               Finish_command
+*               Pipelined_block
+*               Verified_block
+*               Verify_timeout
+*               Unpack_block
+*               Program_block
+*               Erase_chip
+*               Erase_one_sector
+*               Erase_sectors_on_demand
+*               Mark_sectors
+*               Calc_crc
+*               Send_crc
+*               Send_sector_digests
+*               Baud_switch_request
+*               Crc_byte
+*               Flash_byte
+*
+*  Abstract   : The simulated Logic. Bytes from the PC are handled in
+*               arrival order the way the boot strap loader, stage1, stage2
+*               and the third stage loader (MAIN.C Get_command) handle them;
+*               the FLASH is a byte array that can only be programmed from 1
+*               to 0, as on the real parts.
+*  Compiler   : gcc
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Logic may start with stage3 already running
+*  17 Oct 2026
+*    Verified download ('x'); power lost after a number of blocks
+*  17 Oct 2026
+*    Erase on demand ('a')
+*  17 Oct 2026
+*    Packed 'x' blocks
+*  17 Oct 2026
+*    'n' accepts any rate S0BG can hold; the test pattern decides
+*  17 Oct 2026
+*    Bytes to and from stage3 recorded ("--record")
+**************************************************************************/
+
+#include <ctype.h>
+
+#include "include.h"
+#include "Simulator.h"
+
+static void Send (struct target_t *t, unsigned char byte);
+static void Reply (struct target_t *t, unsigned char passed, unsigned char cmd);
+static void Command (struct target_t *t, unsigned char byte);
+static void Arguments (struct target_t *t, unsigned char byte);
+static void Finish_command (struct target_t *t);
+static void Pipelined_block (struct target_t *t, unsigned char byte);
+static void Verified_block (struct target_t *t, unsigned char byte);
+static void Verify_timeout (struct target_t *t);
+static unsigned char Unpack_block (struct target_t *t);
+static unsigned char Program_block (struct target_t *t);
+static unsigned char Erase_chip (struct target_t *t);
+static unsigned char Erase_one_sector (struct target_t *t, unsigned char index);
+static unsigned char Erase_sectors_on_demand (struct target_t *t,
+        unsigned long start, unsigned long length);
+static void Mark_sectors (struct target_t *t, unsigned long start,
+                          unsigned long length);
+static unsigned char Calc_crc (struct target_t *t);
+static void Send_crc (struct target_t *t);
+static void Send_sector_digests (struct target_t *t);
+static void Baud_switch_request (struct target_t *t);
+static unsigned long Crc_byte (unsigned long crc, unsigned char byte,
+                               unsigned char width, unsigned long poly);
+static unsigned char Flash_byte (const struct target_t *t, unsigned long address);
+
+/* FLASH parts the third stage loader can identify; typical datasheet times,
+   the byte wide parts fitted in pairs */
+static const struct device_model_t device_models[] =
+{
+    /* name           description               id   word ns  sector  small  chip */
+    { "amd29f040",    "AMD 29F040 (x2)",        '1', 7000,    1000,   1000,  8000  },
+    { "intel28f800t", "Intel 28F800 top boot",  '2', 9000,    1000,   500,   0     },
+    { "intel28f800b", "Intel 28F800 bottom boot", '3', 9000,  1000,   500,   0     },
+    { "m29w800",      "ST M29W800",             '6', 10000,   800,    800,   12000 },
+    { "sst39sf040",   "SST 39SF040 (x2)",       '7', 14000,   18,     18,    70    },
+    { NULL,           NULL,                     0,   0,       0,      0,     0     }
+};
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Find_device_model
+*
+*  ABSTRACT:
+*     Looks up a FLASH part by its command line name
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       name            const char *    e.g. "amd29f040"
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       const struct device_model_t *   NULL if the name is not known
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+const struct device_model_t *Find_device_model (const char *name)
+{
+    int i;
+
+    for (i = 0; device_models[i].name != NULL; i++)
+    {
+        if (!strcmp (device_models[i].name, name))
+        {
+            return (&device_models[i]);
+        }
+    }
+    return (NULL);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: List_device_models
+*
+*  ABSTRACT:
+*     Prints the FLASH parts that can be simulated
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void List_device_models (void)
+{
+    int i;
+
+    for (i = 0; device_models[i].name != NULL; i++)
+    {
+        printf ("\t%-14s %-26s program %5.1f us/word, erase %5lu ms/sector",
+                device_models[i].name, device_models[i].description,
+                device_models[i].program_word_ns / 1000.0,
+                device_models[i].sector_erase_ms);
+        if (device_models[i].chip_erase_ms != 0)
+        {
+            printf (", %lu ms/chip", device_models[i].chip_erase_ms);
+        }
+        printf ("\n");
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Target_init
+*
+*  ABSTRACT:
+*     Powers up the simulated Logic in boot strap loader mode
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *               Logic to initialize
+*       device          const struct device_model_t *   FLASH part fitted
+*       cpu_code        unsigned char                   BSL acknowledge byte
+*       fcpu_hz         unsigned long                   CPU clock
+*       legacy          unsigned char                   TRUE: answer "*U" to
+*                                                       the commands added
+*                                                       after release 2.1
+*       stage_bytes     const unsigned long [3]         bytes in stage1,
+*                                                       stage2 and stage3
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The FLASH starts erased; the caller may preload it afterwards.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Target_init (struct target_t *t, const struct device_model_t *device,
+                  unsigned char cpu_code, unsigned long fcpu_hz,
+                  unsigned char legacy, const unsigned long stage_bytes[3])
+{
+    memset (t, 0, sizeof (*t));
+
+    t->device = device;
+    t->cpu_code = cpu_code;
+    t->fcpu_hz = fcpu_hz;
+    t->legacy = legacy;
+    t->stage_bytes[0] = stage_bytes[0];
+    t->stage_bytes[1] = stage_bytes[1];
+    t->stage_bytes[2] = stage_bytes[2];
+
+    t->phase = TGT_WAIT_FOR_ZERO;
+    memset (t->flash, 0xff, SIM_FLASH_SIZE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Target_resident
+*
+*  ABSTRACT:
+*     Starts the Logic with the third stage loader already running
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   initialized Logic
+*       baud            long                rate stage3 was left at
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The state a board is left in when a session fails after stage3 has
+*   been loaded, and the PC is started again without a reset.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Target_resident (struct target_t *t, long baud)
+{
+    t->s0bg = (unsigned int) ((t->fcpu_hz / 32 + baud / 2) / baud) - 1;
+    t->phase = TGT_COMMAND;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Target_receive
+*
+*  ABSTRACT:
+*     Hands one byte from the PC to the simulated Logic
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*       byte            unsigned char       byte sent by the PC
+*       arrival         sim_ns_t            time its stop bit arrives
+*       sender_baud     long                rate the PC sent it at
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The Logic's clock moves to the arrival time unless it is still busy
+*   (erasing, programming), in which case the byte waits in the receive ring
+*   as it does on the board. A byte sent at a rate the UART is not set to
+*   is received corrupted. A baud test that timed out before the byte came
+*   is ended first, as Baud_switch does on its own, and so is an 'x' block
+*   that stopped arriving.
+*     Once "cut_blocks" blocks are programmed the Logic stops listening.
+*     Bytes stage3 receives are written to record_pc as received, after
+*   any corruption.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     'x' blocks; power lost after "cut_blocks" blocks
+*  17 Oct 2026
+*     Recorded
+******************************************************************************/
+void Target_receive (struct target_t *t, unsigned char byte,
+                     sim_ns_t arrival, long sender_baud)
+{
+    if (t->now < arrival)
+    {
+        t->now = arrival;
+    }
+    t->stats.bytes_received++;
+
+    if (((t->phase == TGT_BAUD_TEST) || (t->phase == TGT_BAUD_CONFIRM)) &&
+            (arrival > t->deadline))
+    {
+        t->s0bg = t->old_s0bg;
+        t->phase = TGT_COMMAND;
+    }
+    Target_poll (t, arrival);
+
+    if ((t->phase != TGT_WAIT_FOR_ZERO) &&
+            Baud_mismatch (sender_baud, Target_baud (t)))
+    {
+        byte = (unsigned char)~byte;
+        t->stats.garbled_bytes++;
+    }
+
+    if ((t->record_pc != NULL) && (t->phase >= TGT_COMMAND) &&
+            (t->phase != TGT_RESET) && (t->phase != TGT_DEAD))
+    {
+        fputc (byte, t->record_pc);
+    }
+
+    switch (t->phase)
+    {
+        /* Boot strap loader measures the zero byte to set its rate */
+        case TGT_WAIT_FOR_ZERO:
+            if (byte == 0)
+            {
+                t->s0bg = (unsigned int) ((t->fcpu_hz / 32 + sender_baud / 2) /
+                                          sender_baud) - 1;
+                Send (t, t->cpu_code);
+                t->phase = TGT_STAGE1;
+                t->count = 0;
+            }
+            break;
+
+        case TGT_STAGE1:
+            if (++t->count >= t->stage_bytes[0])
+            {
+                t->phase = TGT_STAGE2;
+                t->count = 0;
+            }
+            break;
+
+        case TGT_STAGE2:
+            if (++t->count >= t->stage_bytes[1])
+            {
+                t->phase = TGT_STAGE3;
+                t->count = 0;
+            }
+            break;
+
+        /* stage2 echoes every stage3 byte */
+        case TGT_STAGE3:
+            Send (t, byte);
+            if (++t->count >= t->stage_bytes[2])
+            {
+                t->phase = TGT_COMMAND;
+                t->stats.stage3_ready_ns = t->now;
+            }
+            break;
+
+        case TGT_COMMAND:
+            Command (t, byte);
+            break;
+
+        case TGT_ARGUMENTS:
+            Arguments (t, byte);
+            break;
+
+        case TGT_PIPE_HEADER:
+        case TGT_PIPE_DATA:
+            Pipelined_block (t, byte);
+            break;
+
+        case TGT_VERIFY_SEQ:
+        case TGT_VERIFY_BLOCK:
+            Verified_block (t, byte);
+            break;
+
+        case TGT_BAUD_TEST:
+            Send (t, byte);
+            if (++t->count >= BAUD_TEST_LENGTH)
+            {
+                t->phase = TGT_BAUD_CONFIRM;
+            }
+            t->deadline = t->now + BAUD_CONFIRM_NS;
+            break;
+
+        case TGT_BAUD_CONFIRM:
+            if (byte != BAUD_CONFIRM_BYTE)
+            {
+                t->now += BAUD_SWITCH_DELAY_NS;
+                t->s0bg = t->old_s0bg;
+            }
+            t->phase = TGT_COMMAND;
+            break;
+
+        /* Application running, or no power; nothing listens any more */
+        default:
+            break;
+    }
+
+    if ((t->cut_blocks != 0) && (t->stats.blocks_programmed >= t->cut_blocks))
+    {
+        t->phase = TGT_DEAD;
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Target_poll
+*
+*  ABSTRACT:
+*     Lets the Logic act on its own timeouts up to a time
+*
+*  INPUTS:
+*
+*     Constants:
+*       VERIFY_TIMEOUT_NS
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*       until           sim_ns_t            time reached without a byte
+*                                           from the PC
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The Logic otherwise only runs when a byte arrives. An 'x' block that
+*   stopped arriving is answered "$X" at its timeout, which the PC may be
+*   waiting for; the PC calls this before reading.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Target_poll (struct target_t *t, sim_ns_t until)
+{
+    if ((t->phase == TGT_VERIFY_BLOCK) && (until > t->deadline))
+    {
+        if (t->now < t->deadline)
+        {
+            t->now = t->deadline;
+        }
+        Verify_timeout (t);
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Target_downloading
+*
+*  ABSTRACT:
+*     Checks whether the Logic is receiving 'w' or 'x' blocks
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               const struct target_t *     simulated Logic
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE in the pipelined and verified download modes
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Link noise ("--noise", "--drop") is only applied to the blocks and
+*   their acknowledges.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned char Target_downloading (const struct target_t *t)
+{
+    return (((t->phase == TGT_PIPE_HEADER) || (t->phase == TGT_PIPE_DATA) ||
+             (t->phase == TGT_VERIFY_SEQ) || (t->phase == TGT_VERIFY_BLOCK)) ?
+            TRUE : FALSE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Target_baud
+*
+*  ABSTRACT:
+*     Baud rate the Logic's UART is set to
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               const struct target_t *     simulated Logic
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       long          fCPU / (32 * (S0BG + 1))
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Only the rates the baud rate generator can produce exist, so a rate
+*   requested with 'n' may be off by the rounding of S0BG.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+long Target_baud (const struct target_t *t)
+{
+    return ((long) (t->fcpu_hz / (32UL * (t->s0bg + 1))));
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Target_get_sector
+*
+*  ABSTRACT:
+*     Address and size of one erase sector of the FLASH part
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               const struct target_t *     simulated Logic
+*       index           unsigned char               sector number
+*       start           unsigned long *             first address
+*       size            unsigned long *             bytes
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE if the sector exists
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Same map as Get_sector in the third stage loader (SECTOR.C).
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned char Target_get_sector (const struct target_t *t, unsigned char index,
+                                 unsigned long *start, unsigned long *size)
+{
+    unsigned int num_sectors;
+
+    num_sectors = 0;
+
+    switch (t->device->id)
+    {
+        /* 8 x 64K per device */
+        case '1':
+            num_sectors = 8;
+            *size = 0x20000;
+            *start = SIM_FLASH_START + (unsigned long)index * *size;
+            break;
+
+        /* 128 x 4K per device */
+        case '7':
+            num_sectors = 128;
+            *size = 0x2000;
+            *start = SIM_FLASH_START + (unsigned long)index * *size;
+            break;
+
+        /* 4 x 128K main blocks */
+        case '2':
+            num_sectors = 4;
+            *size = 0x20000;
+            *start = SIM_FLASH_START + (unsigned long)index * *size;
+            break;
+
+        /* 16K boot, 2 x 8K parameter, 96K and 3 x 128K main blocks */
+        case '3':
+            num_sectors = 7;
+            if (index == 0)
+            {
+                *start = SIM_FLASH_START;
+                *size = 0x4000;
+            }
+            else if (index < 3)
+            {
+                *start = SIM_FLASH_START + 0x4000 + (unsigned long) (index - 1) * 0x2000;
+                *size = 0x2000;
+            }
+            else if (index == 3)
+            {
+                *start = SIM_FLASH_START + 0x8000;
+                *size = 0x18000;
+            }
+            else
+            {
+                *start = SIM_FLASH_START + 0x20000 + (unsigned long) (index - 4) * 0x20000;
+                *size = 0x20000;
+            }
+            break;
+
+        /* 15 x 64K, 32K, 2 x 8K and 16K boot block at the top */
+        case '6':
+            num_sectors = 19;
+            if (index < 15)
+            {
+                *start = SIM_FLASH_START + (unsigned long)index * 0x10000;
+                *size = 0x10000;
+            }
+            else if (index == 15)
+            {
+                *start = SIM_FLASH_START + 0xF0000;
+                *size = 0x8000;
+            }
+            else if (index < 18)
+            {
+                *start = SIM_FLASH_START + 0xF8000 + (unsigned long) (index - 16) * 0x2000;
+                *size = 0x2000;
+            }
+            else
+            {
+                *start = SIM_FLASH_START + 0xFC000;
+                *size = 0x4000;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return ((index < num_sectors) ? TRUE : FALSE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Send
+*
+*  ABSTRACT:
+*     Transmits one byte to the PC (io_putbyte)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*       byte            unsigned char       byte to send
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     io_putbyte waits for the previous byte to leave, so the Logic's clock
+*   moves on to the start of this byte. What stage3 sends is written to
+*   record_logic; the boot strap loader acknowledge and the stage2 echoes
+*   are not.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Recorded
+******************************************************************************/
+static void Send (struct target_t *t, unsigned char byte)
+{
+    long baud;
+
+    if (t->now < t->tx_free)
+    {
+        t->now = t->tx_free;
+    }
+
+    baud = Target_baud (t);
+    t->tx_free = t->now + Byte_time_ns (baud);
+    t->stats.bytes_sent++;
+
+    if ((t->record_logic != NULL) && (t->phase >= TGT_COMMAND))
+    {
+        fputc (byte, t->record_logic);
+    }
+
+    Link_to_pc (byte, t->tx_free, baud);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Reply
+*
+*  ABSTRACT:
+*     Sends a "*X" or "$X" response
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*       passed          unsigned char       TRUE for '*', FALSE for '$'
+*       cmd             unsigned char       response letter
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Reply (struct target_t *t, unsigned char passed, unsigned char cmd)
+{
+    Send (t, (passed == TRUE) ? '*' : '$');
+    Send (t, cmd);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Command
+*
+*  ABSTRACT:
+*     Echoes and starts one command of the third stage loader
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*       byte            unsigned char       command received
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Follows Get_command and the responses of main() in MAIN.C. Commands
+*   that carry data move to TGT_ARGUMENTS and finish in Finish_command.
+*   With "legacy" set the commands added since release 2.1 ('w', 'v', 'n',
+*   'h', 'k' and 'x') are answered "*U", like the loader in the field.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Command (struct target_t *t, unsigned char byte)
+{
+    unsigned char cmd;
+
+    Send (t, byte);
+
+    cmd = (unsigned char)tolower (byte);
+    if ((t->legacy == TRUE) && (strchr ("wvnhkxa", cmd) != NULL))
+    {
+        cmd = 0;
+    }
+
+    t->command = cmd;
+    t->num_args = 0;
+    t->count = 0;
+
+    switch (cmd)
+    {
+        /* Do nothing; echo was sufficient */
+        case 'c':
+            break;
+
+        case 'f':
+            t->erase_on_demand = FALSE;
+            Reply (t, TRUE, t->device->id);
+            break;
+
+        case 'e':
+            Reply (t, Erase_chip (t), 'E');
+            break;
+
+        case 't':
+            t->args_needed = 4;
+            t->phase = TGT_ARGUMENTS;
+            break;
+
+        /* 6 header bytes, then the data; see Arguments */
+        case 'b':
+            t->args_needed = 0;
+            t->phase = TGT_ARGUMENTS;
+            break;
+
+        case 'p':
+            Reply (t, Program_block (t), 'P');
+            break;
+
+        case 'r':
+            t->args_needed = 17;
+            t->phase = TGT_ARGUMENTS;
+            break;
+
+        case 's':
+            Reply (t, TRUE, 'S');
+            t->phase = TGT_RESET;
+            break;
+
+        case 'g':
+            Send_crc (t);
+            break;
+
+        case 'w':
+            t->phase = TGT_PIPE_HEADER;
+            break;
+
+        case 'x':
+            t->expected = 0;
+            t->phase = TGT_VERIFY_SEQ;
+            break;
+
+        case 'v':
+            Reply (t, TRUE, 'V');
+            Send (t, SIM_CAPABILITIES);
+            break;
+
+        case 'n':
+            t->args_needed = 2;
+            t->phase = TGT_ARGUMENTS;
+            break;
+
+        case 'h':
+            Send_sector_digests (t);
+            break;
+
+        case 'k':
+            t->args_needed = 1;
+            t->phase = TGT_ARGUMENTS;
+            break;
+
+        /* Range count first; see Finish_command */
+        case 'a':
+            memset (t->sector_erased, FALSE, sizeof (t->sector_erased));
+            t->args_needed = 2;
+            t->phase = TGT_ARGUMENTS;
+            break;
+
+        case 'z':
+            Reply (t, ((t->total_bytes & 0xffffffffUL) == 0) ? TRUE : FALSE, 'Z');
+            break;
+
+        default:
+            Reply (t, TRUE, 'U');
+            break;
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Arguments
+*
+*  ABSTRACT:
+*     Receives the data bytes following a command
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*       byte            unsigned char       data byte
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     'b' stores its header and data in the download SRAM and counts every
+*   byte off the 't' total (Download_block_data). Other commands collect a
+*   fixed number of bytes.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Arguments (struct target_t *t, unsigned char byte)
+{
+    if (t->command == 'b')
+    {
+        t->sram[t->count++] = byte;
+        t->total_bytes--;
+
+        if (t->count == 6)
+        {
+            t->block_size = ((unsigned long)t->sram[4] << 8) | t->sram[5];
+        }
+
+        if ((t->count >= 6) && (t->count == 6 + t->block_size))
+        {
+            Reply (t, TRUE, 'B');
+            t->phase = TGT_COMMAND;
+        }
+        return;
+    }
+
+    t->args[t->num_args++] = byte;
+    if (t->num_args == t->args_needed)
+    {
+        t->phase = TGT_COMMAND;
+        Finish_command (t);
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Finish_command
+*
+*  ABSTRACT:
+*     Carries out a command once its data has arrived
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     'a' collects its ranges 8 bytes at a time, "count" holding the
+*   number still to come.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Added 'a'
+******************************************************************************/
+static void Finish_command (struct target_t *t)
+{
+    unsigned char passed;
+    unsigned long start;
+    unsigned long size;
+
+    switch (t->command)
+    {
+        /* Total includes the 4 bytes of the total itself */
+        case 't':
+            t->total_bytes = (Bytes_to_long (t->args) - 4) & 0xffffffffUL;
+            Reply (t, TRUE, 'T');
+            break;
+
+        case 'r':
+            Reply (t, Calc_crc (t), 'R');
+            break;
+
+        case 'n':
+            Baud_switch_request (t);
+            break;
+
+        case 'k':
+            passed = Erase_one_sector (t, t->args[0]);
+            if (passed == TRUE)
+            {
+                t->sector_erased[t->args[0]] = TRUE;
+            }
+            Reply (t, passed, 'E');
+            break;
+
+        /* Count, then one start and length per programmed range */
+        case 'a':
+            if (t->args_needed == 2)
+            {
+                t->count = ((unsigned long)t->args[0] << 8) | t->args[1];
+            }
+            else
+            {
+                Mark_sectors (t, Bytes_to_long (&t->args[0]),
+                              Bytes_to_long (&t->args[4]));
+                t->count--;
+            }
+
+            if (t->count > 0)
+            {
+                t->args_needed = 8;
+                t->num_args = 0;
+                t->phase = TGT_ARGUMENTS;
+            }
+            else
+            {
+                t->erase_on_demand = Target_get_sector (t, 0, &start, &size);
+                Reply (t, t->erase_on_demand, 'A');
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Pipelined_block
+*
+*  ABSTRACT:
+*     Receives and programs the blocks of a 'w' download
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*       byte            unsigned char       header or data byte
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Follows Download_pipelined: sequence number, address and size, then
+*   the data. Each block is programmed once complete and acknowledged with
+*   "*P" / "$P" and its sequence number; bytes of the next block arriving
+*   meanwhile wait in the receive ring. An empty block ends with "*W".
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Pipelined_block (struct target_t *t, unsigned char byte)
+{
+    unsigned char passed;
+
+    if (t->phase == TGT_PIPE_HEADER)
+    {
+        t->args[t->num_args++] = byte;
+        if (t->num_args < 7)
+        {
+            return;
+        }
+
+        t->seq = t->args[0];
+        memcpy (t->sram, &t->args[1], 6);
+        t->block_size = ((unsigned long)t->sram[4] << 8) | t->sram[5];
+        t->num_args = 0;
+
+        if (t->block_size == 0)
+        {
+            Reply (t, TRUE, 'W');
+            t->phase = TGT_COMMAND;
+            return;
+        }
+
+        t->total_bytes -= 6 + t->block_size;
+        t->count = 6;
+        t->phase = TGT_PIPE_DATA;
+        return;
+    }
+
+    t->sram[t->count++] = byte;
+    if (t->count < 6 + t->block_size)
+    {
+        return;
+    }
+
+    passed = Program_block (t);
+    Reply (t, passed, 'P');
+    Send (t, t->seq);
+    t->phase = TGT_PIPE_HEADER;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Verified_block
+*
+*  ABSTRACT:
+*     Receives and programs the blocks of an 'x' download
+*
+*  INPUTS:
+*
+*     Constants:
+*       DIGEST_POLYNOMIAL
+*       VERIFY_TIMEOUT_NS
+*       SIM_VERIFY_WINDOW
+*       CRC_NS_PER_BYTE
+*       PACKED_BLOCK_FLAG
+*       SIM_MAX_PACKED
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*       byte            unsigned char       sequence number, header, data
+*                                           or CRC byte
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Follows Download_verified: the CRC runs over the bytes as they
+*   arrive, starting at the sequence number. A complete block with a bad
+*   CRC is answered "$X" and the sequence number expected; an intact one
+*   is programmed if it is the one expected, acknowledged again without
+*   programming if it is up to SIM_VERIFY_WINDOW behind, and ignored
+*   otherwise. Each byte after the sequence number must arrive within
+*   VERIFY_TIMEOUT_NS of the previous one (Target_poll).
+*
+*     The data of a packed block (PACKED_BLOCK_FLAG and a packed length
+*   in its size) is kept apart and unpacked (Unpack_block) only when the
+*   block is programmed; a packed size over SIM_MAX_PACKED is answered
+*   "$X" at once, as the loader gives up on the block before its data.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Packed blocks
+******************************************************************************/
+static void Verified_block (struct target_t *t, unsigned char byte)
+{
+    unsigned char passed;
+
+    if (t->phase == TGT_VERIFY_SEQ)
+    {
+        t->seq = byte;
+        t->block_crc = byte;
+        t->block_size = 0;
+        t->block_packed = FALSE;
+        t->count = 0;
+        t->num_args = 0;
+        t->deadline = t->now + VERIFY_TIMEOUT_NS;
+        t->phase = TGT_VERIFY_BLOCK;
+        return;
+    }
+
+    t->now += CRC_NS_PER_BYTE;
+    t->stats.crc_ns += CRC_NS_PER_BYTE;
+    t->deadline = t->now + VERIFY_TIMEOUT_NS;
+
+    /* Address, size and data, then the 4 CRC bytes */
+    if (t->count < 6 + t->block_size)
+    {
+        if (t->count < 6)
+        {
+            t->sram[t->count] = byte;
+        }
+        else if (t->block_packed == TRUE)
+        {
+            t->packed[t->count - 6] = byte;
+        }
+        else
+        {
+            t->sram[t->count] = byte;
+        }
+        t->count++;
+        t->block_crc = Crc_byte (t->block_crc, byte, 32, DIGEST_POLYNOMIAL);
+        if (t->count == 6)
+        {
+            t->block_size = ((unsigned long)t->sram[4] << 8) | t->sram[5];
+            if ((t->block_size & PACKED_BLOCK_FLAG) &&
+                    (t->block_size != PACKED_BLOCK_FLAG))
+            {
+                t->block_packed = TRUE;
+                t->block_size &= ~PACKED_BLOCK_FLAG;
+                if (t->block_size > SIM_MAX_PACKED)
+                {
+                    t->phase = TGT_VERIFY_SEQ;
+                    t->stats.blocks_rejected++;
+                    Reply (t, FALSE, 'X');
+                    Send (t, t->expected);
+                }
+            }
+        }
+        return;
+    }
+
+    t->args[t->num_args++] = byte;
+    if (t->num_args < 4)
+    {
+        return;
+    }
+
+    t->phase = TGT_VERIFY_SEQ;
+
+    if (Bytes_to_long (t->args) != t->block_crc)
+    {
+        t->stats.blocks_rejected++;
+        Reply (t, FALSE, 'X');
+        Send (t, t->expected);
+        return;
+    }
+
+    if (t->seq != t->expected)
+    {
+        /* Programmed already; the acknowledge did not reach the PC */
+        if ((unsigned char) (t->expected - t->seq) <= SIM_VERIFY_WINDOW)
+        {
+            Reply (t, TRUE, 'P');
+            Send (t, t->seq);
+        }
+        return;
+    }
+
+    if (t->block_size == 0)
+    {
+        t->phase = TGT_COMMAND;
+        Reply (t, TRUE, 'W');
+        return;
+    }
+
+    passed = TRUE;
+    if (t->block_packed == TRUE)
+    {
+        passed = Unpack_block (t);
+    }
+    if (passed == TRUE)
+    {
+        passed = Program_block (t);
+    }
+    if (passed == TRUE)
+    {
+        t->total_bytes -= 6 + t->block_size;
+        t->expected++;
+    }
+    Reply (t, passed, 'P');
+    Send (t, t->seq);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Verify_timeout
+*
+*  ABSTRACT:
+*     Gives up on an 'x' block that stopped arriving
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic; its clock at
+*                                           the timeout
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Answered "$X" and the sequence number expected, as a bad CRC is; the
+*   next byte is taken as a sequence number.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Verify_timeout (struct target_t *t)
+{
+    t->stats.blocks_rejected++;
+    t->phase = TGT_VERIFY_SEQ;
+    Reply (t, FALSE, 'X');
+    Send (t, t->expected);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Unpack_block
+*
+*  ABSTRACT:
+*     Unpacks the data of a packed 'x' block behind its address
+*
+*  INPUTS:
+*
+*     Constants:
+*       PACK_RUN
+*       PACK_MATCH
+*       PACK_MIN_LENGTH
+*       PACK_LONG_MATCH
+*       SIM_MAX_UNPACKED
+*       UNPACK_NS_PER_BYTE
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic; block_size
+*                                           packed bytes in "packed"
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE if the packed bytes were well formed; block_size and the size
+*       in SRAM are then the unpacked size
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Follows Unpack_block of stage3 (BLKDATA.C), including its checks,
+*   and takes UNPACK_NS_PER_BYTE per byte unpacked. The time is counted as
+*   program time, since the loader unpacks just before programming.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Unpack_block (struct target_t *t)
+{
+    unsigned char control;
+    unsigned char *dest;
+    unsigned long in;
+    unsigned long out;
+    unsigned long length;
+    unsigned long distance;
+
+    dest = &t->sram[6];
+    in = 0;
+    out = 0;
+
+    while (in < t->block_size)
+    {
+        control = t->packed[in++];
+
+        if (control < PACK_RUN)
+        {
+            length = (unsigned long)control + 1;
+            if ((t->block_size - in < length) || (out + length > SIM_MAX_UNPACKED))
+            {
+                return (FALSE);
+            }
+            memcpy (&dest[out], &t->packed[in], length);
+            in += length;
+            out += length;
+        }
+        else if (control < PACK_MATCH)
+        {
+            length = (unsigned long) (control & 0x3F) + PACK_MIN_LENGTH;
+            if ((in == t->block_size) || (out + length > SIM_MAX_UNPACKED))
+            {
+                return (FALSE);
+            }
+            memset (&dest[out], t->packed[in++], length);
+            out += length;
+        }
+        else
+        {
+            length = (unsigned long) ((control >> 4) & 0x07) + PACK_MIN_LENGTH;
+            if (in == t->block_size)
+            {
+                return (FALSE);
+            }
+            distance = (((unsigned long) (control & 0x0F) << 8) | t->packed[in++]) + 1;
+            if (length == PACK_LONG_MATCH)
+            {
+                if (in == t->block_size)
+                {
+                    return (FALSE);
+                }
+                length += t->packed[in++];
+            }
+            if ((distance > out) || (out + length > SIM_MAX_UNPACKED))
+            {
+                return (FALSE);
+            }
+            while (length != 0)
+            {
+                dest[out] = dest[out - distance];
+                out++;
+                length--;
+            }
+        }
+    }
+
+    t->now += out * UNPACK_NS_PER_BYTE;
+    t->stats.program_ns += out * UNPACK_NS_PER_BYTE;
+    t->block_size = out;
+    t->sram[4] = (unsigned char) (out >> 8);
+    t->sram[5] = (unsigned char)out;
+    return (TRUE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Program_block
+*
+*  ABSTRACT:
+*     Programs the block in the download SRAM (Program_flash)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE if every word programmed, FALSE otherwise
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Words are written at even addresses, low address byte first; an odd
+*   last byte is padded with 0xFF and 0xFFFF words are skipped, as in
+*   FLASH.C. Programming only clears bits, so a word that was not erased
+*   reads back wrong and the block fails there. Each word programmed costs
+*   the device's word time. With erase on demand the sectors of the block
+*   not yet erased are erased first.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Erase on demand
+******************************************************************************/
+static unsigned char Program_block (struct target_t *t)
+{
+    unsigned long address;
+    unsigned long block_size;
+    unsigned long offset;
+    unsigned int  sram_index;
+    unsigned char lo;
+    unsigned char hi;
+    unsigned char passed;
+    sim_ns_t start;
+
+    address = Bytes_to_long (t->sram) & ~1UL;
+    block_size = ((unsigned long)t->sram[4] << 8) | t->sram[5];
+    sram_index = 6;
+
+    /* The erase is counted as erase time, not program time */
+    passed = TRUE;
+    if (t->erase_on_demand == TRUE)
+    {
+        passed = Erase_sectors_on_demand (t, Bytes_to_long (t->sram),
+                                          block_size);
+    }
+
+    start = t->now;
+
+    while ((passed == TRUE) && (block_size > 0))
+    {
+        lo = t->sram[sram_index++];
+        if (block_size == 1)
+        {
+            hi = 0xff;
+            block_size = 0;
+        }
+        else
+        {
+            hi = t->sram[sram_index++];
+            block_size -= 2;
+        }
+
+        t->now += WORD_LOOP_NS;
+
+        /* FLASH is erased; programming 0xFFFF would not change a bit */
+        if ((lo == 0xff) && (hi == 0xff))
+        {
+            address += 2;
+            continue;
+        }
+
+        if ((address < SIM_FLASH_START) ||
+                (address + 2 > SIM_FLASH_START + SIM_FLASH_SIZE))
+        {
+            passed = FALSE;
+            break;
+        }
+
+        offset = address - SIM_FLASH_START;
+        t->flash[offset] &= lo;
+        t->flash[offset + 1] &= hi;
+        t->now += t->device->program_word_ns;
+        t->stats.words_programmed++;
+
+        if ((t->flash[offset] != lo) || (t->flash[offset + 1] != hi))
+        {
+            passed = FALSE;
+            break;
+        }
+
+        address += 2;
+    }
+
+    t->stats.program_ns += t->now - start;
+    t->stats.blocks_programmed++;
+    return (passed);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Erase_chip
+*
+*  ABSTRACT:
+*     Erases the FLASH ('e')
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE if erased
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Parts with a chip erase command take the chip erase time. The Intel
+*   parts are erased block by block (Erase_INTEL28F800), so only the blocks
+*   of the sector map are erased and each takes its block time. Ends
+*   erase on demand.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Ends erase on demand
+******************************************************************************/
+static unsigned char Erase_chip (struct target_t *t)
+{
+    unsigned char index;
+
+    t->erase_on_demand = FALSE;
+
+    if (t->device->chip_erase_ms != 0)
+    {
+        memset (t->flash, 0xff, SIM_FLASH_SIZE);
+        t->now += t->device->chip_erase_ms * NS_PER_MS;
+        t->stats.erase_ns += t->device->chip_erase_ms * NS_PER_MS;
+        return (TRUE);
+    }
+
+    for (index = 0; Erase_one_sector (t, index) == TRUE; index++)
+    {
+    }
+    return ((index != 0) ? TRUE : FALSE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Erase_one_sector
+*
+*  ABSTRACT:
+*     Erases one sector of the sector map ('k')
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*       index           unsigned char       sector number
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE if erased, FALSE if there is no such sector
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Erase_one_sector (struct target_t *t, unsigned char index)
+{
+    unsigned long start;
+    unsigned long size;
+    unsigned long erase_ms;
+
+    if (Target_get_sector (t, index, &start, &size) == FALSE)
+    {
+        return (FALSE);
+    }
+
+    memset (&t->flash[start - SIM_FLASH_START], 0xff, size);
+
+    erase_ms = (size >= 0x10000) ? t->device->sector_erase_ms :
+               t->device->small_erase_ms;
+    t->now += erase_ms * NS_PER_MS;
+    t->stats.erase_ns += erase_ms * NS_PER_MS;
+    t->stats.sectors_erased++;
+    return (TRUE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Erase_sectors_on_demand
+*
+*  ABSTRACT:
+*     Erases the sectors of a range not erased yet (SECTOR.C)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*       start           unsigned long       first address of the range
+*       length          unsigned long       bytes in the range
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE (the simulated erase cannot fail)
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Each sector is erased at most once after 'a'; the Logic's clock
+*   moves on by the erase time, so bytes arriving meanwhile queue as they
+*   do in the receive ring.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Erase_sectors_on_demand (struct target_t *t,
+        unsigned long start, unsigned long length)
+{
+    unsigned long sector_start;
+    unsigned long sector_size;
+    unsigned int index;
+
+    for (index = 0; (index < SIM_MAX_SECTORS) &&
+            (Target_get_sector (t, (unsigned char)index, &sector_start,
+                                &sector_size) == TRUE); index++)
+    {
+        if ((t->sector_erased[index] == FALSE) &&
+                (sector_start < start + length) &&
+                (start < sector_start + sector_size))
+        {
+            Erase_one_sector (t, (unsigned char)index);
+            t->sector_erased[index] = TRUE;
+        }
+    }
+    return (TRUE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Mark_sectors
+*
+*  ABSTRACT:
+*     Marks the sectors of an already programmed range as erased ('a')
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*       start           unsigned long       first address of the range
+*       length          unsigned long       bytes in the range
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Mark_sectors (struct target_t *t, unsigned long start,
+                          unsigned long length)
+{
+    unsigned long sector_start;
+    unsigned long sector_size;
+    unsigned int index;
+
+    for (index = 0; (index < SIM_MAX_SECTORS) &&
+            (Target_get_sector (t, (unsigned char)index, &sector_start,
+                                &sector_size) == TRUE); index++)
+    {
+        if ((sector_start < start + length) &&
+                (start < sector_start + sector_size))
+        {
+            t->sector_erased[index] = TRUE;
+        }
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Calc_crc
+*
+*  ABSTRACT:
+*     Calculates the CRC of a FLASH range ('r')
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic; args hold the
+*                                           width, polynomial, start, end
+*                                           and CRC address
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE for "*R", FALSE for "$R"
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Same result as Calc_crc in CRC.C, computed bit by bit instead of with
+*   a table so it checks the loader's algorithm rather than repeating it.
+*   With the CRC stored in FLASH the range includes it and must come to
+*   zero after at least one non-zero byte; with the CRC from the command
+*   line the last width / 8 bytes are taken as zero and the result is
+*   always accepted (the PC compares it after 'g'). With erase on demand
+*   the sectors of the range not yet erased are erased first.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Erase on demand
+******************************************************************************/
+static unsigned char Calc_crc (struct target_t *t)
+{
+    unsigned long poly;
+    unsigned long start;
+    unsigned long end;
+    unsigned long num_flash_bytes;
+    unsigned long num_zero_bytes;
+    unsigned long i;
+    unsigned long crc;
+    unsigned char data_seen;
+    unsigned char byte;
+
+    t->crc_width = t->args[0];
+    poly = Bytes_to_long (&t->args[1]);
+    start = Bytes_to_long (&t->args[5]);
+    end = Bytes_to_long (&t->args[9]);
+    t->crc_address = Bytes_to_long (&t->args[13]);
+
+    num_flash_bytes = (end >= start) ? end - start + 1 : 0;
+    num_zero_bytes = 0;
+    if (t->crc_address == 0)
+    {
+        num_zero_bytes = t->crc_width >> 3;
+        if (num_zero_bytes > num_flash_bytes)
+        {
+            num_zero_bytes = num_flash_bytes;
+        }
+        num_flash_bytes -= num_zero_bytes;
+    }
+
+    /* Sectors no block reached still hold the old image */
+    if (t->erase_on_demand == TRUE)
+    {
+        Erase_sectors_on_demand (t, start, num_flash_bytes);
+    }
+
+    t->crc_result = 0;
+    if ((t->crc_width != 8) && (t->crc_width != 16) && (t->crc_width != 32))
+    {
+        return (FALSE);
+    }
+
+    crc = 0;
+    data_seen = 0;
+    for (i = 0; i < num_flash_bytes; i++)
+    {
+        byte = Flash_byte (t, start + i);
+        data_seen |= byte;
+        crc = Crc_byte (crc, byte, t->crc_width, poly);
+    }
+    for (i = 0; i < num_zero_bytes; i++)
+    {
+        crc = Crc_byte (crc, 0, t->crc_width, poly);
+    }
+    t->crc_result = crc;
+
+    t->now += (num_flash_bytes + num_zero_bytes) * CRC_NS_PER_BYTE;
+    t->stats.crc_ns += (num_flash_bytes + num_zero_bytes) * CRC_NS_PER_BYTE;
+
+    if ((t->crc_address != 0) && ((crc != 0) || (data_seen == 0)))
+    {
+        return (FALSE);
+    }
+    return (TRUE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Send_crc
+*
+*  ABSTRACT:
+*     Sends the CRC in ASCII hex ('g')
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Get_crc_from_flash: the bytes stored at the CRC address in ascending
+*   order, or the calculated CRC most significant byte first.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Send_crc (struct target_t *t)
+{
+    static const char hex_digits[] = "0123456789ABCDEF";
+    unsigned char byte;
+    unsigned int num_bytes;
+    unsigned int i;
+
+    num_bytes = t->crc_width >> 3;
+    for (i = 0; i < num_bytes; i++)
+    {
+        if (t->crc_address != 0)
+        {
+            byte = Flash_byte (t, t->crc_address + i);
+        }
+        else
+        {
+            byte = (unsigned char) (t->crc_result >> (8 * (num_bytes - 1 - i)));
+        }
+        Send (t, hex_digits[byte >> 4]);
+        Send (t, hex_digits[byte & 0xf]);
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Send_sector_digests
+*
+*  ABSTRACT:
+*     Sends the sector map and the CRC-32 of every sector ('h')
+*
+*  INPUTS:
+*
+*     Constants:
+*       DIGEST_POLYNOMIAL
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     "*H", the number of sectors, then start, size and CRC of each sector,
+*   MSB first. Each entry leaves once its CRC is calculated.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Send_sector_digests (struct target_t *t)
+{
+    unsigned char entry[12];
+    unsigned long start;
+    unsigned long size;
+    unsigned long digest;
+    unsigned long i;
+    unsigned int num_sectors;
+    unsigned int s;
+    unsigned int j;
+
+    num_sectors = 0;
+    while ((num_sectors < MAX_FLASH_SECTORS) &&
+            (Target_get_sector (t, (unsigned char)num_sectors, &start, &size) == TRUE))
+    {
+        num_sectors++;
+    }
+
+    Reply (t, TRUE, 'H');
+    Send (t, (unsigned char)num_sectors);
+
+    for (s = 0; s < num_sectors; s++)
+    {
+        Target_get_sector (t, (unsigned char)s, &start, &size);
+
+        digest = 0;
+        for (i = 0; i < size; i++)
+        {
+            digest = Crc_byte (digest, Flash_byte (t, start + i), 32,
+                               DIGEST_POLYNOMIAL);
+        }
+        t->now += size * CRC_NS_PER_BYTE;
+        t->stats.crc_ns += size * CRC_NS_PER_BYTE;
+
+        Long_to_bytes (start, &entry[0]);
+        Long_to_bytes (size, &entry[4]);
+        Long_to_bytes (digest, &entry[8]);
+        for (j = 0; j < 12; j++)
+        {
+            Send (t, entry[j]);
+        }
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Baud_switch_request
+*
+*  ABSTRACT:
+*     Accepts or rejects a baud rate change ('n') and starts it
+*
+*  INPUTS:
+*
+*     Constants:
+*       BAUD_SWITCH_DELAY_NS
+*       BAUD_CONFIRM_NS
+*
+*     Procedure Parameters:
+*       t               struct target_t *   simulated Logic; args hold the
+*                                           current and new rate codes
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The new S0BG is the current one scaled by the ratio of the codes, as
+*   in Baud_switch_request (SERIAL.C); only a reload S0BG cannot hold or
+*   one that leaves the rate unchanged gets "$N", so a rate too far off
+*   fails the test pattern (Baud_mismatch). After "*N" has gone out the
+*   UART changes rate and the test pattern is expected (TGT_BAUD_TEST).
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     No tolerance check, as in SERIAL.C
+******************************************************************************/
+static void Baud_switch_request (struct target_t *t)
+{
+    unsigned long cur_code;
+    unsigned long new_code;
+    unsigned long divider;
+
+    cur_code = t->args[0];
+    new_code = t->args[1];
+
+    if ((cur_code == 0) || (new_code == 0))
+    {
+        Reply (t, FALSE, 'N');
+        return;
+    }
+
+    divider = (((unsigned long)t->s0bg + 1) * new_code + cur_code / 2) / cur_code;
+
+    if ((divider == 0) || (divider > 0x2000) ||
+            ((divider == (unsigned long)t->s0bg + 1) && (new_code != cur_code)))
+    {
+        Reply (t, FALSE, 'N');
+        return;
+    }
+
+    t->new_s0bg = (unsigned int) (divider - 1);
+    Reply (t, TRUE, 'N');
+
+    /* Change rate once the 'N' has gone out */
+    t->now += BAUD_SWITCH_DELAY_NS;
+    if (t->now < t->tx_free)
+    {
+        t->now = t->tx_free;
+    }
+
+    t->old_s0bg = t->s0bg;
+    t->s0bg = t->new_s0bg;
+    t->count = 0;
+    t->deadline = t->now + BAUD_CONFIRM_NS;
+    t->phase = TGT_BAUD_TEST;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Crc_byte
+*
+*  ABSTRACT:
+*     Runs one byte through an augmented CRC, most significant bit first
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       crc             unsigned long   running CRC
+*       byte            unsigned char   data
+*       width           unsigned char   8, 16 or 32
+*       poly            unsigned long   polynomial
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned long   updated CRC
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The byte is shifted in at the bottom of the register and the
+*   polynomial subtracted whenever a 1 leaves the top; the same as the
+*   table form crc = ((crc << 8) | byte) ^ table[crc >> (width - 8)] used
+*   by the loader.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned long Crc_byte (unsigned long crc, unsigned char byte,
+                               unsigned char width, unsigned long poly)
+{
+    unsigned long top;
+    unsigned long mask;
+    unsigned long carry;
+    int bit;
+
+    top = 1UL << (width - 1);
+    mask = top | (top - 1);
+
+    for (bit = 7; bit >= 0; bit--)
+    {
+        carry = crc & top;
+        crc = ((crc << 1) | ((byte >> bit) & 1)) & mask;
+        if (carry)
+        {
+            crc ^= poly & mask;
+        }
+    }
+    return (crc);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Flash_byte
+*
+*  ABSTRACT:
+*     Reads one byte of the Logic's address space
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       t               const struct target_t *     simulated Logic
+*       address         unsigned long               24 bit address
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned char   FLASH contents; 0xFF outside the FLASH
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Flash_byte (const struct target_t *t, unsigned long address)
+{
+    if ((address < SIM_FLASH_START) || (address >= SIM_FLASH_START + SIM_FLASH_SIZE))
+    {
+        return (0xff);
+    }
+    return (t->flash[address - SIM_FLASH_START]);
+}
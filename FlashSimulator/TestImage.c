@@ -0,0 +1,281 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : TestImage.c
+*  Subsystem  : PC (Linux) - test images for the simulator
+*  Procedures : main
+*               Fill_range
+*               Write_hex
+*
+*  Abstract   : Writes the Intel hex files "make check" downloads with
+*               flashsim. An image is a list of ranges, each filled with
+*               one byte value (0xFF for an erased run, 0x5A for an old
+*               application) or with pseudo random data.
+*  Compiler   : gcc
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+**************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Data bytes per hex record */
+#define RECORD_BYTES    32
+
+/* Largest image: the 1MB FLASH of the Logic */
+#define IMAGE_BYTES     0x100000UL
+#define IMAGE_START     0x100000UL
+
+static int Fill_range (unsigned char *image, unsigned char *defined,
+                       const char *range);
+static int Write_hex (FILE *fp, const unsigned char *image,
+                      const unsigned char *defined);
+
+
+/*****************************************************************************
+*.b
+*
+*   PROCEDURE NAME: main
+*
+*   ABSTRACT:
+*     Writes a test image
+*
+*   INPUTS:
+*     testimage <hex file> <start>:<length>:<fill> [...]
+*
+*       <start>, <length>   hex, the range within 0x100000 - 0x1FFFFF
+*       <fill>              "ff", "5a", ... every byte of the range, or
+*                           "r<seed>" pseudo random bytes
+*
+*   OUTPUTS:
+*     Returns 0, or 1 when an argument is bad or the file cannot be written
+*
+*   FUNCTIONAL DESCRIPTION:
+*     Later ranges overwrite earlier ones where they overlap.
+*
+*.b
+*  History:
+*    17 Oct 2026
+*      Created
+*
+*****************************************************************************/
+
+int main (int argc, char *argv[])
+{
+    unsigned char *image;
+    unsigned char *defined;
+    FILE *fp;
+    int arg;
+    int result = 0;
+
+    if (argc < 3)
+    {
+        printf ("Usage is: testimage <hex file> <start>:<length>:<ff|5a|...|r<seed>> [...]\n");
+        return (1);
+    }
+
+    image = (unsigned char *) calloc (IMAGE_BYTES, 1);
+    defined = (unsigned char *) calloc (IMAGE_BYTES, 1);
+    if ((image == NULL) || (defined == NULL))
+    {
+        printf ("** Out of memory\n");
+        return (1);
+    }
+
+    for (arg = 2; (arg < argc) && (result == 0); arg++)
+    {
+        result = Fill_range (image, defined, argv[arg]);
+    }
+
+    if (result == 0)
+    {
+        fp = fopen (argv[1], "w");
+        if (fp == NULL)
+        {
+            printf ("** Unable to open %s\n", argv[1]);
+            result = 1;
+        }
+        else
+        {
+            result = Write_hex (fp, image, defined);
+            if (fclose (fp) != 0)
+            {
+                result = 1;
+            }
+        }
+    }
+
+    free (image);
+    free (defined);
+    return (result);
+}
+
+
+/*****************************************************************************
+*.b
+*
+*   PROCEDURE NAME: Fill_range
+*
+*   ABSTRACT:
+*     Fills one "<start>:<length>:<fill>" range of the image
+*
+*   INPUTS:
+*     image     1MB of FLASH contents from IMAGE_START
+*     defined   non zero for each byte of the image written to the file
+*     range     the argument
+*
+*   OUTPUTS:
+*     Returns 0, or 1 when the range is bad
+*
+*   FUNCTIONAL DESCRIPTION:
+*     "r<seed>" uses a 32 bit linear congruential generator, so the data
+*     is the same on every PC.
+*
+*.b
+*  History:
+*    17 Oct 2026
+*      Created
+*
+*****************************************************************************/
+
+static int Fill_range (unsigned char *image, unsigned char *defined,
+                       const char *range)
+{
+    unsigned long start;
+    unsigned long length = 0;
+    unsigned long seed = 0;
+    unsigned long offset;
+    unsigned int fill = 0;
+    int random_fill = 0;
+    char *end;
+
+    start = strtoul (range, &end, 16);
+    if (*end == ':')
+    {
+        length = strtoul (end + 1, &end, 16);
+    }
+    if ((*end != ':') || (start < IMAGE_START) || (length == 0) ||
+            (start - IMAGE_START + length > IMAGE_BYTES))
+    {
+        printf ("** Bad range %s\n", range);
+        return (1);
+    }
+
+    end++;
+    if (*end == 'r')
+    {
+        random_fill = 1;
+        seed = strtoul (end + 1, &end, 10);
+    }
+    else
+    {
+        fill = (unsigned int) strtoul (end, &end, 16);
+    }
+    if ((*end != '\0') || (fill > 0xFF))
+    {
+        printf ("** Bad fill %s\n", range);
+        return (1);
+    }
+
+    for (offset = start - IMAGE_START; length > 0; offset++, length--)
+    {
+        if (random_fill)
+        {
+            seed = (seed * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+            fill = (unsigned int) (seed >> 16) & 0xFF;
+        }
+        image[offset] = (unsigned char) fill;
+        defined[offset] = 1;
+    }
+
+    return (0);
+}
+
+
+/*****************************************************************************
+*.b
+*
+*   PROCEDURE NAME: Write_hex
+*
+*   ABSTRACT:
+*     Writes the defined bytes of the image as Intel hex
+*
+*   INPUTS:
+*     fp        the open hex file
+*     image     1MB of FLASH contents from IMAGE_START
+*     defined   non zero for each byte of the image to be written
+*
+*   OUTPUTS:
+*     Returns 0, or 1 when the file cannot be written
+*
+*   FUNCTIONAL DESCRIPTION:
+*     A record never crosses a 64K boundary; an extended linear address
+*     record (type 04) starts each 64K page that has data.
+*
+*.b
+*  History:
+*    17 Oct 2026
+*      Created
+*
+*****************************************************************************/
+
+static int Write_hex (FILE *fp, const unsigned char *image,
+                      const unsigned char *defined)
+{
+    unsigned long offset = 0;
+    unsigned long address;
+    unsigned long page = 0xFFFFFFFFUL;
+    unsigned int count;
+    unsigned int i;
+    unsigned int sum;
+
+    while (offset < IMAGE_BYTES)
+    {
+        if (!defined[offset])
+        {
+            offset++;
+            continue;
+        }
+
+        address = IMAGE_START + offset;
+        if ((address >> 16) != page)
+        {
+            page = address >> 16;
+            sum = 2 + 4 + (unsigned int) (page >> 8) + (unsigned int) (page & 0xFF);
+            fprintf (fp, ":02000004%04lX%02X\n", page, (0x100 - (sum & 0xFF)) & 0xFF);
+        }
+
+        count = 0;
+        while ((count < RECORD_BYTES) && (offset + count < IMAGE_BYTES) &&
+                defined[offset + count] &&
+                (((address + count) >> 16) == page))
+        {
+            count++;
+        }
+
+        sum = count + (unsigned int) ((address >> 8) & 0xFF) + (unsigned int) (address & 0xFF);
+        fprintf (fp, ":%02X%04lX00", count, address & 0xFFFF);
+        for (i = 0; i < count; i++)
+        {
+            fprintf (fp, "%02X", image[offset + i]);
+            sum += image[offset + i];
+        }
+        fprintf (fp, "%02X\n", (0x100 - (sum & 0xFF)) & 0xFF);
+
+        offset += count;
+    }
+
+    if (fprintf (fp, ":00000001FF\n") < 0)
+    {
+        return (1);
+    }
+    return (0);
+}
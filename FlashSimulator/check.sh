@@ -0,0 +1,195 @@
+#!/bin/sh
+###############################################################################
+# "make check" - downloads test images with flashsim and checks that FlashMain
+# returns 0 and the simulated FLASH matches the hex file; then runs the third
+# stage loader sources (stage3host) with every FLASH part and download mode.
+#
+#   run_case <name> <max simulated seconds or -> <flashsim arguments>
+#   run_stage3 <device> <hex file>
+#   run_replay <name> <device> <hex file> <flashsim arguments>
+#
+# The images are made by testimage in obj/check; flashsim writes its log
+# there too. A failed case prints the flashsim output.
+###############################################################################
+
+STAGES=--stages=../../../FlashDotExeUpgrade/Resources
+FLASHSIM=../../flashsim
+STAGE3HOST=../../stage3host
+TESTIMAGE=../../testimage
+
+failed=0
+
+run_case ()
+{
+    name=$1
+    max_seconds=$2
+    shift 2
+
+    $FLASHSIM $STAGES "$@" > "$name.out" 2>&1
+    # one result, FLASH and time per board in a gang
+    result=`sed -n 's/^ \*\* FlashMain result [. ]*\([0-9]*\)$/\1/p' "$name.out" | sort -u`
+    seconds=`sed -n 's/^ \*\* Simulated time [. ]*\([0-9.]*\) s$/\1/p' "$name.out" | sort -n | tail -1`
+
+    if [ "$result" != "0" ] || ! grep -q "MATCH HEX FILE" "$name.out" || \
+            grep -q "BYTES DIFFER" "$name.out"; then
+        cat "$name.out"
+        echo "FAIL $name (result $result)"
+        failed=1
+    elif [ "$max_seconds" != "-" ] && \
+            awk "BEGIN { exit !($seconds > $max_seconds) }"; then
+        echo "FAIL $name ($seconds s, expected at most $max_seconds s)"
+        failed=1
+    else
+        echo "ok   $name ($seconds s)"
+    fi
+}
+
+# 'w', 'b'/'p', 'x' and packed 'x' blocks, each after 'e' and with 'a'
+run_stage3 ()
+{
+    device=$1
+    hex=$2
+    runs=0
+
+    for mode in --pipelined --lockstep --verified --packed; do
+        for erase in --chip-erase --on-demand; do
+            args="--device=$device"
+            [ $mode != --pipelined ] && args="$args $mode"
+            [ $erase != --chip-erase ] && args="$args $erase"
+            name="stage3_${device}_${hex%.hex}${mode#-}${erase#-}"
+
+            if ! $STAGE3HOST $args $hex > "$name.out" 2>&1; then
+                cat "$name.out"
+                echo "FAIL stage3host $args $hex"
+                failed=1
+                return
+            fi
+            runs=`expr $runs + 1`
+        done
+    done
+    echo "ok   stage3 $device $hex ($runs modes)"
+}
+
+# The bytes FlashMain sent to flashsim's Logic, replayed into the loader
+# sources; they must program the FLASH and get the same answers. Requested
+# at the boot rate: stage3host has no baud switch.
+run_replay ()
+{
+    name=$1
+    device=$2
+    hex=$3
+    shift 3
+
+    $FLASHSIM $STAGES --device=$device --record=$name "$@" > "$name.out" 2>&1
+    if ! grep -q "MATCH HEX FILE" "$name.out"; then
+        cat "$name.out"
+        echo "FAIL $name (flashsim)"
+        failed=1
+    elif ! $STAGE3HOST --device=$device --replay=$name $hex > "$name.s3" 2>&1; then
+        cat "$name.s3"
+        echo "FAIL $name (stage3host)"
+        failed=1
+    else
+        echo "ok   $name"
+    fi
+}
+
+mkdir -p obj/check && cd obj/check || exit 1
+
+# 256K of data with a 32K hole, and the CRC over all of it
+$TESTIMAGE app.hex 100000:38000:r1 140000:8000:r2 || exit 1
+printf 'GPCRCG\nx\nx\n32\n04C11DB7\nx\n100000\n147FFF\n0\n' > app.crc
+
+# Random data and constant fills, so that the 'x' blocks pack
+$TESTIMAGE mixed.hex 100000:8000:r5 108000:8000:0 110000:8000:r6 \
+    118000:8000:a5 120000:8000:r7 128000:8000:12 || exit 1
+printf 'GPCRCG\nx\nx\n32\n04C11DB7\nx\n100000\n12FFFF\n0\n' > mixed.crc
+
+# An older application in every sector; the new one leaves 0x140000 -
+# 0x17FFFF erased and the CRC does not cover it
+$TESTIMAGE old.hex 100000:100000:5a || exit 1
+$TESTIMAGE stale.hex 100000:40000:r3 140000:40000:ff 180000:10000:r4 || exit 1
+printf 'GPCRCG\nx\nx\n32\n04C11DB7\nx\n100000\n13FFFF\n0\n' > stale.crc
+
+# At the default 20 MHz 115200 is too far off but 57600 (56818) is not;
+# at the boot rate this takes 72 s. The 262865 download bytes take 46.3 s
+# on the line and the FLASH 1.0 s; 'w' takes 46.6 s, so the line sets the
+# time. Lockstep adds the program time and a turnaround per block
+run_case pipelined        60 app.hex app.crc 115200
+run_case lockstep         - app.hex app.crc 115200 lockstep
+run_case legacy           - --legacy app.hex app.crc 115200
+run_case stale_on_demand  - --preload=old.hex stale.hex stale.crc 115200
+run_case stale_nocompress - --preload=old.hex stale.hex stale.crc 115200 nocompress
+
+# A damaged byte every 5000 on the line; only the damaged blocks are sent
+# again, and smaller blocks are used once a block fails twice (this took
+# 337 s when every block from the oldest unacknowledged one was resent)
+run_case noise_nocompress 100 --noise=5000 app.hex app.crc 115200 nocompress
+run_case drop_nocompress  - --drop=3000 app.hex app.crc 115200 nocompress
+
+# Packed blocks; with the same noise a block rejected twice has the rest
+# sent unpacked
+run_case packed           30 mixed.hex mixed.crc 115200
+run_case noise_packed     100 --noise=5000 mixed.hex mixed.crc 115200
+
+# The mixed image with its high records first and one 4K run given twice;
+# a record giving an address another value fails the file
+$TESTIMAGE high.hex 118000:8000:a5 120000:8000:r7 128000:8000:12 || exit 1
+$TESTIMAGE low.hex 100000:8000:r5 108000:8000:0 110000:8000:r6 || exit 1
+$TESTIMAGE again.hex 10C000:1000:0 || exit 1
+grep -hv '^:00000001FF' high.hex again.hex | cat - low.hex > unordered.hex
+run_case unordered        - unordered.hex mixed.crc 115200
+$TESTIMAGE clash.hex 108000:100:5a || exit 1
+grep -v '^:00000001FF' clash.hex | cat - mixed.hex > conflict.hex
+$FLASHSIM $STAGES conflict.hex mixed.crc 115200 > conflict.out 2>&1
+if grep -q "Error (11): Address 108000" conflict.out; then
+    echo "ok   conflict"
+else
+    cat conflict.out
+    echo "FAIL conflict"
+    failed=1
+fi
+
+# Power lost after 50 blocks. "resume" continues from the checkpoint once
+# the sectors it says are programmed hold the image; a blank board is
+# programmed from the start
+$FLASHSIM $STAGES --cut=50 --save=cut.hex app.hex app.crc 115200 > cut.out 2>&1
+run_case resume           - --preload=cut.hex app.hex app.crc 115200 resume
+$FLASHSIM $STAGES --cut=50 app.hex app.crc 115200 > cut.out 2>&1
+run_case resume_blank     - app.hex app.crc 115200 resume
+if ! grep -q "Resuming download at" resume.out ||
+        ! grep -q "Resuming download [. ]*NOT POSSIBLE" resume_blank.out; then
+    echo "FAIL resume (checkpoint not used as expected)"
+    failed=1
+fi
+
+# Two boards at once; the phase lines of the threads stay off the console
+run_case gang             - --ports=1,2 mixed.hex mixed.crc 115200
+if grep -q "Connecting with Logic" gang.out; then
+    echo "FAIL gang (phase lines written in a gang)"
+    failed=1
+fi
+
+# Neither rate is within 3% at 25 MHz; the boot rate is kept
+run_case baud_25mhz       - --fcpu=25000000 app.hex app.crc 115200
+
+# stage3 left running at a rate other than the one requested now
+run_case resident_57600   - --resident=57600 app.hex app.crc 115200
+run_case resident_115200  - --fcpu=18432000 --resident=115200 app.hex app.crc 57600
+
+# The loader sources themselves
+for device in amd29f040 intel28f800t intel28f800b m29w800 sst39sf040; do
+    run_stage3 $device app.hex
+    run_stage3 $device mixed.hex
+done
+
+# Both real ends: packed and plain 'x' blocks with erase on demand, 'b'/'p'
+# after a chip erase, and blocks rejected for line noise
+for device in amd29f040 intel28f800t intel28f800b m29w800 sst39sf040; do
+    run_replay replay_packed_$device $device mixed.hex mixed.hex mixed.crc 38400
+done
+run_replay replay_nocompress amd29f040 app.hex app.hex app.crc 38400 nocompress
+run_replay replay_lockstep   m29w800   app.hex app.hex app.crc 38400 lockstep
+run_replay replay_noise      amd29f040 mixed.hex --noise=5000 mixed.hex mixed.crc 38400
+
+exit $failed
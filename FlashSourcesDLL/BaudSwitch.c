@@ -0,0 +1,363 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : BaudSwitch.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : Switch_logic_baud
+*               Try_baud_switch
+*               Reconnect_logic
+*               Drain_input
+*               Switch_baud_rate
+*
+*  Abstract   : Raises the baud rate once the third stage loader runs. The
+*               boot strap loader must be loaded at a rate it can autobaud
+*               to reliably; the application download then runs faster.
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Switch_baud_rate, so a stage3 loader left running can be looked for
+*    at every rate
+**************************************************************************/
+
+#include "include.h"
+
+/* Bytes echoed by the Logic at the new rate; both bit patterns and both
+   nibble orders */
+static const unsigned char baud_test_pattern[BAUD_TEST_LENGTH] =
+{
+    0x55, 0xAA, 0x0F, 0xF0
+};
+
+/* Rates tried, fastest first; only those between the boot rate and the
+   requested rate are used */
+static const long download_bauds[] =
+{
+    115200, 57600, 0
+};
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Switch_logic_baud
+*
+*  ABSTRACT:
+*     Moves the Logic and the PC to the fastest workable rate up to the one
+*   requested
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       boot_baud       long        rate the boot strap loader was loaded at
+*       download_baud   long        highest rate wanted for the download
+*       active_baud     long *      rate in use on return
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           0 if the Logic can be reached (at whatever rate);
+*                     25 if the Logic was lost
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Each standard rate above the boot rate and not above the requested
+*   rate is tried, fastest first (Try_baud_switch). A failed try leaves
+*   both ends at the boot rate, so the next lower rate is tried, and if none
+*   works the download simply runs at the boot rate.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+int Switch_logic_baud (long boot_baud, long download_baud, long *active_baud)
+{
+    int i;
+    int result;
+
+    *active_baud = boot_baud;
+
+    for (i = 0; download_bauds[i] != 0; i++)
+    {
+        if ((download_bauds[i] > download_baud) ||
+                (download_bauds[i] <= boot_baud))
+        {
+            continue;
+        }
+
+        result = Try_baud_switch (boot_baud, download_bauds[i]);
+        if (result == BAUD_SWITCHED)
+        {
+            *active_baud = download_bauds[i];
+            return (0);
+        }
+        if (result == BAUD_LOST_LOGIC)
+        {
+            return (25);
+        }
+    }
+
+    return (0);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Try_baud_switch
+*
+*  ABSTRACT:
+*     Negotiates one baud rate change with the Logic
+*
+*  INPUTS:
+*
+*     Constants:
+*       BAUD_TEST_LENGTH
+*       BAUD_CONFIRM_BYTE
+*       BAUD_SETTLE_MS
+*       BAUD_CONFIRM_TIMEOUT_MS
+*
+*     Procedure Parameters:
+*       cur_baud        long        rate in use
+*       new_baud        long        rate to change to
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       BAUD_SWITCHED, BAUD_NOT_SWITCHED (both ends still at cur_baud) or
+*       BAUD_LOST_LOGIC
+*
+*  FUNCTIONAL DESCRIPTION:
+*     'n' is sent with the current and new rates as 115200 / rate. "$N"
+*   means the Logic cannot generate the rate. After "*N" both ends change
+*   rate; the test pattern is sent and must come back unchanged, then
+*   BAUD_CONFIRM_BYTE is sent and a 'c' echo at the new rate completes the
+*   change. On any failure the PC returns to the old rate and, once the
+*   Logic has had time to give up as well, reconnects there.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Phase lines left off the console in a gang
+******************************************************************************/
+int Try_baud_switch (long cur_baud, long new_baud)
+{
+    struct echo_t logic_val;
+    unsigned char codes[2];
+    unsigned char echo[BAUD_TEST_LENGTH];
+    unsigned char confirm = BAUD_CONFIRM_BYTE;
+    int command_response;
+
+    Phase_printf ("\t> Changing to %6ld baud .......................", new_baud);
+
+    logic_val = Send_byte_wait_for_echo ('n', FLASH_SERIAL_PORT_TIMEOUT_MS);
+    if (logic_val.error_code != 0)
+    {
+        Phase_printf (" NO ECHO\n");
+        return (BAUD_NOT_SWITCHED);
+    }
+
+    codes[0] = (unsigned char) (115200L / cur_baud);
+    codes[1] = (unsigned char) (115200L / new_baud);
+    a_write (codes, 2);
+
+    command_response = Wait_for_command_reponse ("*N", FLASH_SERIAL_PORT_TIMEOUT_MS);
+    if (command_response == CMD_FAILED)
+    {
+        Phase_printf (" NOT POSSIBLE\n");
+        return (BAUD_NOT_SWITCHED);
+    }
+    if (command_response != CMD_COMPLETE)
+    {
+        Phase_printf (" NO RESPONSE\n");
+        return (Reconnect_logic (cur_baud));
+    }
+
+    /* "*N" must have left before the port changes rate */
+    a_flush();
+    if (a_set_baud (new_baud) == FALSE)
+    {
+        Phase_printf (" NOT SUPPORTED BY PC\n");
+        return (Reconnect_logic (cur_baud));
+    }
+    Drain_input (BAUD_SETTLE_MS);
+
+    a_write (baud_test_pattern, BAUD_TEST_LENGTH);
+    if ((a_read (echo, BAUD_TEST_LENGTH, BAUD_CONFIRM_TIMEOUT_MS) != BAUD_TEST_LENGTH) ||
+            (memcmp (echo, baud_test_pattern, BAUD_TEST_LENGTH) != 0))
+    {
+        Phase_printf (" TEST FAILED\n");
+        return (Reconnect_logic (cur_baud));
+    }
+
+    a_write (&confirm, 1);
+
+    logic_val = Send_byte_wait_for_echo ('c', FLASH_SERIAL_PORT_TIMEOUT_MS);
+    if (logic_val.error_code != 0)
+    {
+        Phase_printf (" NOT CONFIRMED\n");
+        return (Reconnect_logic (cur_baud));
+    }
+
+    Phase_printf (" SUCCESSFUL\n");
+    return (BAUD_SWITCHED);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Reconnect_logic
+*
+*  ABSTRACT:
+*     Returns the PC to a baud rate and checks the Logic answers there
+*
+*  INPUTS:
+*
+*     Constants:
+*       BAUD_REVERT_WAIT_MS
+*       BAUD_RECONNECT_TRIES
+*
+*     Procedure Parameters:
+*       baud            long        rate to return to
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       BAUD_NOT_SWITCHED if the Logic echoes 'c', BAUD_LOST_LOGIC otherwise
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The Logic restores its old rate when the test pattern or the
+*   confirmation does not arrive. BAUD_REVERT_WAIT_MS covers that timeout;
+*   any bytes received meanwhile are discarded.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+int Reconnect_logic (long baud)
+{
+    struct echo_t logic_val;
+    int i;
+
+    a_set_baud (baud);
+    Drain_input (BAUD_REVERT_WAIT_MS);
+
+    for (i = 0; i < BAUD_RECONNECT_TRIES; i++)
+    {
+        logic_val = Send_byte_wait_for_echo ('c', FLASH_SERIAL_PORT_TIMEOUT_MS);
+        if (logic_val.error_code == 0)
+        {
+            return (BAUD_NOT_SWITCHED);
+        }
+        Drain_input (BAUD_SETTLE_MS);
+    }
+
+    printf ("\n**** Lost Communication with target after baud rate change ");
+    return (BAUD_LOST_LOGIC);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Drain_input
+*
+*  ABSTRACT:
+*     Discards received bytes until the line has been quiet for a time
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       quiet_ms        int         quiet time in msecs
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Used around rate changes, where a partly received byte shows up as
+*   noise.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Drain_input (int quiet_ms)
+{
+    unsigned char discard;
+
+    while (a_read (&discard, 1, quiet_ms) == 1)
+    {
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Switch_baud_rate
+*
+*  ABSTRACT:
+*     Returns one of the rates Switch_logic_baud may change to
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       index           int         0 for the fastest rate, 1 for the next
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       long            the rate, or 0 past the slowest
+*
+*  FUNCTIONAL DESCRIPTION:
+*     A stage3 loader left running by a failed download may be at any of
+*   these rates, whatever rate is requested this time.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+long Switch_baud_rate (int index)
+{
+    int i;
+
+    for (i = 0; i < index; i++)
+    {
+        if (download_bauds[i] == 0)
+        {
+            return (0);
+        }
+    }
+    return (download_bauds[index]);
+}
@@ -0,0 +1,391 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Checkpoint.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : Init_checkpoint
+*               Read_checkpoint
+*               Save_checkpoint
+*               Flush_checkpoint
+*               Remove_checkpoint
+*
+*  Abstract   : Record of how much of an image the Logic has programmed.
+*               It is kept in memory and written to a file in the working
+*               directory every CHECKPOINT_SAVE_BLOCKS blocks and when the
+*               download fails, so a session that fails part way through
+*               the download can be run again with "resume" and continue
+*               from the first byte not programmed instead of erasing the
+*               FLASH again.
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Records whether the FLASH is erased on demand
+*  17 Oct 2026
+*    Kept in memory; file written every few blocks, in the working directory
+*  17 Oct 2026
+*    Records the FLASH type
+**************************************************************************/
+
+#include "include.h"
+
+/* First line of a checkpoint file */
+#define  CHECKPOINT_TAG                   "C167 FLASH checkpoint"
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Init_checkpoint
+*
+*  ABSTRACT:
+*     Names the checkpoint file of a download and fingerprints the image
+*
+*  INPUTS:
+*
+*     Constants:
+*       DIGEST_POLYNOMIAL
+*
+*     Procedure Parameters:
+*       checkpoint      struct checkpoint_t *       initialized here
+*       name            const char *                download file name
+*                                                   (files.flashapp_hex_name)
+*       image           const struct hex_image_t *  image to be downloaded
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The file is the download file name, without its directory, with the
+*   extension ".ckp", in the working directory like "flash.log": the
+*   download file may be on a network share. In a gang "_COM<n>" is added,
+*   since every board has its own progress. The
+*   digest is the CRC-32 of the address, length and data of every segment,
+*   so a checkpoint is only used for the image it was written for. The
+*   place reached is kept as a segment and offset, not a block number, so
+*   it holds whatever block size the Logic was sent. The caller sets
+*   "flash_id" once the Logic has reported its FLASH.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     File in the working directory
+******************************************************************************/
+void Init_checkpoint (struct checkpoint_t *checkpoint, const char *name,
+                      const struct hex_image_t *image)
+{
+    unsigned long table[256];
+    unsigned char seg_header[8];    /* address and length of a segment */
+    const struct image_segment_t *seg;
+    struct flash_session_t *session = Current_session();
+    const char *ext;
+    size_t base_len;
+    unsigned int i;
+
+    /* Directory of the download file left out */
+    for (ext = name; *ext != '\0'; ext++)
+    {
+        if ((*ext == '/') || (*ext == '\\') || (*ext == ':'))
+        {
+            name = ext + 1;
+        }
+    }
+
+    ext = strrchr (name, '.');
+    if (ext == NULL)
+    {
+        ext = name + strlen (name);
+    }
+    base_len = ext - name;
+    if (base_len + 16 > sizeof (checkpoint->name))
+    {
+        base_len = sizeof (checkpoint->name) - 16;
+    }
+
+    if (session->gang == TRUE)
+    {
+        sprintf (checkpoint->name, "%.*s_COM%d.ckp", (int)base_len, name,
+                 session->com_port);
+    }
+    else
+    {
+        sprintf (checkpoint->name, "%.*s.ckp", (int)base_len, name);
+    }
+
+    Make_crc_table_32 (DIGEST_POLYNOMIAL, table);
+    checkpoint->digest = 0;
+    for (i = 0; i < image->num_segments; i++)
+    {
+        seg = &image->segment[i];
+        Long_to_bytes (seg->address, &seg_header[0]);
+        Long_to_bytes (seg->length, &seg_header[4]);
+        checkpoint->digest = Crc_32_block (checkpoint->digest, seg_header,
+                                           sizeof (seg_header), table);
+        checkpoint->digest = Crc_32_block (checkpoint->digest, seg->data,
+                                           seg->length, table);
+    }
+
+    checkpoint->num_segments = image->num_segments;
+    checkpoint->done.segment = 0;
+    checkpoint->done.offset = 0;
+    checkpoint->enabled = TRUE;
+    checkpoint->erase_on_demand = FALSE;
+    checkpoint->save_failed = FALSE;
+    checkpoint->unsaved = 0;
+    checkpoint->flash_id = 0;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Read_checkpoint
+*
+*  ABSTRACT:
+*     Reads how far an earlier session programmed the image
+*
+*  INPUTS:
+*
+*     Constants:
+*       CHECKPOINT_TAG
+*
+*     Procedure Parameters:
+*       checkpoint      struct checkpoint_t *   from Init_checkpoint, with
+*                                               "flash_id" set
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned char TRUE if part of the image is programmed; FALSE if
+*                     there is no checkpoint for this image and FLASH
+*
+*  FUNCTIONAL DESCRIPTION:
+*     "done" is set to the place reached; the start of the image if
+*   FALSE is returned. "erase_on_demand" is set if the earlier session had
+*   the Logic erase sectors on demand, in which case sectors the image has
+*   not reached may still hold the old application. A checkpoint written
+*   for another FLASH type (another board) is not used; files without the
+*   "flash" line are not either.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Reads the erase method
+*  17 Oct 2026
+*     Only used for the same FLASH type
+******************************************************************************/
+unsigned char Read_checkpoint (struct checkpoint_t *checkpoint)
+{
+    char tag[sizeof (CHECKPOINT_TAG) + 2];
+    unsigned long digest;
+    unsigned int num_segments;
+    unsigned int erase_on_demand;
+    int flash_id;
+    struct image_position_t done;
+    FILE *fp;
+
+    checkpoint->done.segment = 0;
+    checkpoint->done.offset = 0;
+
+    fp = fopen (checkpoint->name, "r");
+    if (fp == NULL)
+    {
+        return (FALSE);
+    }
+
+    if ((fgets (tag, sizeof (tag), fp) != NULL) &&
+            (strncmp (tag, CHECKPOINT_TAG, strlen (CHECKPOINT_TAG)) == 0) &&
+            (fscanf (fp, " digest %lx segments %u segment %u offset %lu", &digest,
+                     &num_segments, &done.segment, &done.offset) == 4) &&
+            (digest == checkpoint->digest) &&
+            (num_segments == checkpoint->num_segments) &&
+            (done.segment <= num_segments) &&
+            (fscanf (fp, " erase %u flash %d", &erase_on_demand, &flash_id) == 2) &&
+            (flash_id == checkpoint->flash_id))
+    {
+        checkpoint->done = done;
+        checkpoint->erase_on_demand = (erase_on_demand != FALSE) ? TRUE : FALSE;
+    }
+
+    fclose (fp);
+    return (((checkpoint->done.segment != 0) || (checkpoint->done.offset != 0)) ?
+            TRUE : FALSE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Save_checkpoint
+*
+*  ABSTRACT:
+*     Records how far the image is programmed
+*
+*  INPUTS:
+*
+*     Constants:
+*       CHECKPOINT_SAVE_BLOCKS
+*
+*     Procedure Parameters:
+*       checkpoint      struct checkpoint_t *   from Init_checkpoint
+*       done            const struct image_position_t *   end of the
+*                                               last block acknowledged
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Called for every block acknowledged. The place is only kept in
+*   memory; the file is written (Flush_checkpoint) every
+*   CHECKPOINT_SAVE_BLOCKS blocks, so a block costs no file access. A
+*   download that fails must call Flush_checkpoint before it returns.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Writes the erase method
+*  17 Oct 2026
+*     File written every CHECKPOINT_SAVE_BLOCKS blocks
+******************************************************************************/
+void Save_checkpoint (struct checkpoint_t *checkpoint,
+                      const struct image_position_t *done)
+{
+    checkpoint->done = *done;
+    checkpoint->unsaved++;
+    if (checkpoint->unsaved >= CHECKPOINT_SAVE_BLOCKS)
+    {
+        Flush_checkpoint (checkpoint);
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Flush_checkpoint
+*
+*  ABSTRACT:
+*     Writes the checkpoint file
+*
+*  INPUTS:
+*
+*     Constants:
+*       CHECKPOINT_TAG
+*
+*     Procedure Parameters:
+*       checkpoint      struct checkpoint_t *   from Init_checkpoint
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Does nothing if no block was acknowledged since the file was last
+*   written, or for a disabled checkpoint (differential download). A file
+*   that cannot be written is reported once; the download goes on.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created from Save_checkpoint
+* Revised :
+******************************************************************************/
+void Flush_checkpoint (struct checkpoint_t *checkpoint)
+{
+    FILE *fp;
+
+    if ((checkpoint->enabled == FALSE) || (checkpoint->unsaved == 0))
+    {
+        return;
+    }
+    checkpoint->unsaved = 0;
+
+    fp = fopen (checkpoint->name, "w");
+    if (fp == NULL)
+    {
+        if (checkpoint->save_failed == FALSE)
+        {
+            printf ("\n** Unable to write checkpoint file %s \n", checkpoint->name);
+            checkpoint->save_failed = TRUE;
+        }
+        return;
+    }
+
+    fprintf (fp, "%s\ndigest %08lX\nsegments %u\nsegment %u\noffset %lu\nerase %u\nflash %d\n",
+             CHECKPOINT_TAG, checkpoint->digest, checkpoint->num_segments,
+             checkpoint->done.segment, checkpoint->done.offset,
+             (unsigned int)checkpoint->erase_on_demand, checkpoint->flash_id);
+    fclose (fp);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Remove_checkpoint
+*
+*  ABSTRACT:
+*     Deletes the checkpoint file
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       checkpoint      struct checkpoint_t *   from Init_checkpoint
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Called when the FLASH is erased and when the session ends, since the
+*   blocks recorded are then either gone or complete.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Remove_checkpoint (struct checkpoint_t *checkpoint)
+{
+    checkpoint->done.segment = 0;
+    checkpoint->done.offset = 0;
+    checkpoint->unsaved = 0;
+    if (checkpoint->enabled == TRUE)
+    {
+        remove (checkpoint->name);
+    }
+}
@@ -0,0 +1,425 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Compress.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : Pack_block
+*               Find_match
+*               Pack_hash
+*               Put_literals
+*
+*  Abstract   : Packs the blocks of a verified download ('x') so fewer
+*               bytes go over the serial link. Runs of one byte and copies
+*               of earlier bytes of the same block are replaced by short
+*               codes the Logic expands again (Unpack_block in stage3).
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+**************************************************************************/
+
+#include "include.h"
+
+static unsigned long Find_match (const unsigned char *data,
+                                 unsigned long length,
+                                 unsigned long pos,
+                                 const unsigned short *head,
+                                 const unsigned short *prev,
+                                 unsigned long *distance);
+static unsigned int Pack_hash (const unsigned char *data);
+static unsigned char Put_literals (const unsigned char *data,
+                                   unsigned long count,
+                                   unsigned char *packed,
+                                   unsigned long *out,
+                                   unsigned long max_packed);
+
+/* Earlier positions with the same first 3 bytes are found through a hash
+   table and a chain per position; only the newest PACK_CHAIN_LIMIT are
+   compared */
+#define  PACK_HASH_SIZE                   0x1000
+#define  PACK_CHAIN_LIMIT                 32
+#define  NO_POSITION                      0xFFFF
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Pack_block
+*
+*  ABSTRACT:
+*     Packs the data of one 'x' block
+*
+*  INPUTS:
+*
+*     Constants:
+*       COMPRESSED_BLOCK_BYTES
+*       PACK_RUN
+*       PACK_MATCH
+*       PACK_MIN_LENGTH
+*       PACK_MAX_RUN
+*       PACK_LONG_MATCH
+*       PACK_MAX_MATCH
+*       PACK_MAX_LITERALS
+*
+*     Procedure Parameters:
+*       data            const unsigned char *   block data
+*       length          unsigned long       number of data bytes, at most
+*                                           COMPRESSED_BLOCK_BYTES
+*       packed          unsigned char *     receives the packed bytes
+*       max_packed      unsigned long       size of "packed"
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned long   number of packed bytes; 0 if they would not fit in
+*                       max_packed bytes (the block is then sent as it is)
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The packed data is a string of control bytes, each followed by its
+*   operands:
+*
+*       00-3F   control+1 literal bytes follow
+*       40-7F   the next byte repeated (control & 3F)+3 times
+*       80-FF   copy of earlier output. Length ((control >> 4) & 7)+3; when
+*               that is PACK_LONG_MATCH an extra length byte follows the
+*               distance byte and is added to it. Distance
+*               ((control & 0F) << 8 | next byte)+1, 1 to PACK_WINDOW.
+*
+*     Copies only reach back into the same block, so the Logic unpacks a
+*   block without keeping earlier ones and a block sent again unpacks the
+*   same way. A copy may overlap the bytes it produces.
+*
+*     At each position the longest earlier match (Find_match) is compared
+*   with the run of the byte there; the longer is taken (the run on a tie,
+*   since it never needs a third byte) if it is at least PACK_MIN_LENGTH
+*   bytes, otherwise the byte is added to the pending literals. Padding and erased (FF) areas become runs and long copies,
+*   repeated code and tables become copies.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned long Pack_block (const unsigned char *data, unsigned long length,
+                          unsigned char *packed, unsigned long max_packed)
+{
+    unsigned short head[PACK_HASH_SIZE];        /* newest position per hash */
+    unsigned short prev[COMPRESSED_BLOCK_BYTES]; /* older position, same hash */
+    unsigned long pos;              /* next byte to pack */
+    unsigned long literal_start;    /* first pending literal byte */
+    unsigned long out;              /* packed bytes so far */
+    unsigned long run;
+    unsigned long limit;
+    unsigned long best_length;
+    unsigned long best_distance;
+    unsigned long step;
+    unsigned long i;
+    unsigned int hash;
+
+    if ((length == 0) || (length > COMPRESSED_BLOCK_BYTES))
+    {
+        return (0);
+    }
+
+    for (i = 0; i < PACK_HASH_SIZE; i++)
+    {
+        head[i] = NO_POSITION;
+    }
+
+    pos = 0;
+    literal_start = 0;
+    out = 0;
+
+    while (pos < length)
+    {
+        /* Run of the byte at pos */
+        limit = length - pos;
+        if (limit > PACK_MAX_RUN)
+        {
+            limit = PACK_MAX_RUN;
+        }
+        run = 1;
+        while ((run < limit) && (data[pos + run] == data[pos]))
+        {
+            run++;
+        }
+
+        best_length = Find_match (data, length, pos, head, prev, &best_distance);
+
+        if ((run >= PACK_MIN_LENGTH) && (run >= best_length))
+        {
+            if ((Put_literals (&data[literal_start], pos - literal_start,
+                               packed, &out, max_packed) == FALSE) ||
+                    (out + 2 > max_packed))
+            {
+                return (0);
+            }
+            packed[out++] = (unsigned char) (PACK_RUN | (run - PACK_MIN_LENGTH));
+            packed[out++] = data[pos];
+            step = run;
+        }
+        else if (best_length >= PACK_MIN_LENGTH)
+        {
+            if ((Put_literals (&data[literal_start], pos - literal_start,
+                               packed, &out, max_packed) == FALSE) ||
+                    (out + 3 > max_packed))
+            {
+                return (0);
+            }
+            best_distance--;
+            if (best_length >= PACK_LONG_MATCH)
+            {
+                packed[out++] = (unsigned char) (PACK_MATCH |
+                                ((PACK_LONG_MATCH - PACK_MIN_LENGTH) << 4) |
+                                (best_distance >> 8));
+                packed[out++] = (unsigned char)best_distance;
+                packed[out++] = (unsigned char) (best_length - PACK_LONG_MATCH);
+            }
+            else
+            {
+                packed[out++] = (unsigned char) (PACK_MATCH |
+                                ((best_length - PACK_MIN_LENGTH) << 4) |
+                                (best_distance >> 8));
+                packed[out++] = (unsigned char)best_distance;
+            }
+            step = best_length;
+        }
+        else
+        {
+            step = 1;
+        }
+
+        /* Every position passed over can be copied from later on */
+        for (i = pos; i < pos + step; i++)
+        {
+            if (length - i >= PACK_MIN_LENGTH)
+            {
+                hash = Pack_hash (&data[i]);
+                prev[i] = head[hash];
+                head[hash] = (unsigned short)i;
+            }
+        }
+        pos += step;
+
+        if (step != 1)
+        {
+            literal_start = pos;
+        }
+        else if (pos - literal_start == PACK_MAX_LITERALS)
+        {
+            if (Put_literals (&data[literal_start], pos - literal_start,
+                              packed, &out, max_packed) == FALSE)
+            {
+                return (0);
+            }
+            literal_start = pos;
+        }
+    }
+
+    if (Put_literals (&data[literal_start], pos - literal_start,
+                      packed, &out, max_packed) == FALSE)
+    {
+        return (0);
+    }
+
+    return (out);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Find_match
+*
+*  ABSTRACT:
+*     Longest copy of earlier bytes of the block at a position
+*
+*  INPUTS:
+*
+*     Constants:
+*       PACK_MIN_LENGTH
+*       PACK_MAX_MATCH
+*       PACK_CHAIN_LIMIT
+*
+*     Procedure Parameters:
+*       data            const unsigned char *   block data
+*       length          unsigned long       number of data bytes
+*       pos             unsigned long       position to match
+*       head            const unsigned short *  newest position per hash
+*       prev            const unsigned short *  older position with the
+*                                           same hash, per position
+*       distance        unsigned long *     distance back of the copy
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned long   length of the copy, at most PACK_MAX_MATCH; 0 if
+*                       fewer than PACK_MIN_LENGTH bytes are left
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Only the newest PACK_CHAIN_LIMIT positions of the hash chain are
+*   compared. A copy may run on into the bytes it produces.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned long Find_match (const unsigned char *data,
+                                 unsigned long length,
+                                 unsigned long pos,
+                                 const unsigned short *head,
+                                 const unsigned short *prev,
+                                 unsigned long *distance)
+{
+    unsigned long limit;
+    unsigned long match;
+    unsigned long best_length;
+    unsigned int candidate;
+    unsigned int chain;
+
+    best_length = 0;
+    *distance = 0;
+    if (length - pos < PACK_MIN_LENGTH)
+    {
+        return (0);
+    }
+
+    limit = length - pos;
+    if (limit > PACK_MAX_MATCH)
+    {
+        limit = PACK_MAX_MATCH;
+    }
+
+    candidate = head[Pack_hash (&data[pos])];
+    for (chain = 0; (candidate != NO_POSITION) && (chain < PACK_CHAIN_LIMIT); chain++)
+    {
+        match = 0;
+        while ((match < limit) && (data[candidate + match] == data[pos + match]))
+        {
+            match++;
+        }
+        if (match > best_length)
+        {
+            best_length = match;
+            *distance = pos - candidate;
+            if (match == limit)
+            {
+                break;
+            }
+        }
+        candidate = prev[candidate];
+    }
+
+    return (best_length);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Pack_hash
+*
+*  ABSTRACT:
+*     Hash of the 3 bytes starting at a position
+*
+*  INPUTS:
+*
+*     Constants:
+*       PACK_HASH_SIZE
+*
+*     Procedure Parameters:
+*       data            const unsigned char *   first of the 3 bytes
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned int    0 to PACK_HASH_SIZE-1
+*
+*  FUNCTIONAL DESCRIPTION:
+*     None
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned int Pack_hash (const unsigned char *data)
+{
+    return ((((unsigned int)data[0] << 8) ^ ((unsigned int)data[1] << 4) ^
+             data[2]) & (PACK_HASH_SIZE - 1));
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Put_literals
+*
+*  ABSTRACT:
+*     Adds the pending literal bytes to the packed data
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       data            const unsigned char *   first literal byte
+*       count           unsigned long       number of literal bytes, at
+*                                           most PACK_MAX_LITERALS
+*       packed          unsigned char *     packed data
+*       out             unsigned long *     packed bytes so far; updated
+*       max_packed      unsigned long       size of "packed"
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned char   TRUE, or FALSE if the literals do not fit
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Nothing is added when count is 0.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Put_literals (const unsigned char *data,
+                                   unsigned long count,
+                                   unsigned char *packed,
+                                   unsigned long *out,
+                                   unsigned long max_packed)
+{
+    if (count == 0)
+    {
+        return (TRUE);
+    }
+
+    if (*out + 1 + count > max_packed)
+    {
+        return (FALSE);
+    }
+
+    packed[(*out)++] = (unsigned char) (count - 1);
+    memcpy (&packed[*out], data, count);
+    *out += count;
+
+    return (TRUE);
+}
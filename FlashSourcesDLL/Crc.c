@@ -0,0 +1,455 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Crc.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : Make_crc_table_32
+*               Crc_32_block
+*               Make_crc_slice_tables
+*               Crc_slice_block
+*               Read_crc_config
+*               Image_crc
+*
+*  Abstract   : PC copy of the third stage loader CRC engines (CRC.C),
+*               used to predict values the Logic computes over FLASH
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Slicing CRC of the programmed range, computed from the image
+**************************************************************************/
+
+#include "include.h"
+
+/* Value of FLASH not covered by the image */
+#define  ERASED_BYTE                      0xff
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Make_crc_table_32
+*
+*  ABSTRACT:
+*     Builds the CRC-32 lookup table for a polynomial
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       crc_poly        unsigned long       CRC polynomial (MSB first)
+*       table           unsigned long *     256 entry table to be filled
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Identical to Make_crc_table_32 in the third stage loader. Values are
+*   kept to 32 bits so the result does not depend on the size of a long.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Make_crc_table_32 (unsigned long crc_poly, unsigned long *table)
+{
+    unsigned int i;
+    unsigned int x;
+    unsigned long entry;
+
+    for (i = 0; i < 256; i++)
+    {
+        entry = i;
+        for (x = 0; x < 32; x++)
+        {
+            if (entry & 0x80000000UL)
+            {
+                entry = ((entry << 1) ^ crc_poly) & 0xffffffffUL;
+            }
+            else
+            {
+                entry = (entry << 1) & 0xffffffffUL;
+            }
+        }
+        table[i] = entry;
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Crc_32_block
+*
+*  ABSTRACT:
+*     Runs a buffer through the CRC-32 calculation
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       crc             unsigned long           running checksum
+*       data            const unsigned char *   first byte
+*       count           unsigned long           number of bytes
+*       table           const unsigned long *   table from Make_crc_table_32
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       running checksum after the last byte
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Same byte step as Crc_32_block / Calc_crc in the third stage loader:
+*   the byte is shifted into the low end of the checksum and the byte
+*   shifted out of the top selects the table entry.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned long Crc_32_block (unsigned long crc, const unsigned char *data,
+                            unsigned long count, const unsigned long *table)
+{
+    unsigned int tab_index;
+
+    while (count != 0)
+    {
+        tab_index = (unsigned int) ((crc >> 24) & 0xff);
+        crc = (((crc << 8) | *data) ^ table[tab_index]) & 0xffffffffUL;
+        data++;
+        count--;
+    }
+
+    return (crc);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Make_crc_slice_tables
+*
+*  ABSTRACT:
+*     Builds the lookup tables for the slicing CRC of any width
+*
+*  INPUTS:
+*
+*     Constants:
+*       CRC_SLICES
+*
+*     Procedure Parameters:
+*       width           unsigned char       CRC width (8, 16 or 32)
+*       crc_poly        unsigned long       CRC polynomial (MSB first)
+*       tables          unsigned long [][]  CRC_SLICES tables of 256 entries
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The CRC is kept left aligned in 32 bits (polynomial shifted up by
+*   32 - width), so one set of tables serves every width. Table 0 is the
+*   ordinary one byte table; table k gives the effect of a byte followed by
+*   k zero bytes, which lets Crc_slice_block take 4 bytes per step.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Make_crc_slice_tables (unsigned char width, unsigned long crc_poly,
+                            unsigned long tables[CRC_SLICES][256])
+{
+    unsigned int i;
+    unsigned int k;
+    unsigned int x;
+    unsigned long entry;
+
+    crc_poly = (crc_poly << (32 - width)) & 0xffffffffUL;
+
+    for (i = 0; i < 256; i++)
+    {
+        entry = (unsigned long)i << 24;
+        for (x = 0; x < 8; x++)
+        {
+            if (entry & 0x80000000UL)
+            {
+                entry = ((entry << 1) ^ crc_poly) & 0xffffffffUL;
+            }
+            else
+            {
+                entry = (entry << 1) & 0xffffffffUL;
+            }
+        }
+        tables[0][i] = entry;
+    }
+
+    for (k = 1; k < CRC_SLICES; k++)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            entry = tables[k - 1][i];
+            tables[k][i] = ((entry << 8) & 0xffffffffUL) ^ tables[0][entry >> 24];
+        }
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Crc_slice_block
+*
+*  ABSTRACT:
+*     Runs a buffer through the slicing CRC
+*
+*  INPUTS:
+*
+*     Constants:
+*       CRC_SLICES
+*
+*     Procedure Parameters:
+*       crc             unsigned long           running checksum, left aligned
+*       data            const unsigned char *   first byte
+*       count           unsigned long           number of bytes
+*       tables          unsigned long [][]      from Make_crc_slice_tables
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       running checksum after the last byte, left aligned
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Each byte is XORed into the top of the checksum before the table
+*   lookup, which equals the Logic calculation (byte shifted into the bottom)
+*   followed by width / 8 zero bytes. That is exactly what the Logic runs
+*   when the CRC is not stored in FLASH, and the value stored in FLASH when
+*   it is. Four bytes are taken per step, one lookup in each table.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned long Crc_slice_block (unsigned long crc, const unsigned char *data,
+                               unsigned long count,
+                               unsigned long tables[CRC_SLICES][256])
+{
+    while (count >= CRC_SLICES)
+    {
+        crc ^= ((unsigned long)data[0] << 24) | ((unsigned long)data[1] << 16) |
+               ((unsigned long)data[2] << 8) | (unsigned long)data[3];
+        crc = tables[3][(crc >> 24) & 0xff] ^ tables[2][(crc >> 16) & 0xff] ^
+              tables[1][(crc >> 8) & 0xff] ^ tables[0][crc & 0xff];
+        data += CRC_SLICES;
+        count -= CRC_SLICES;
+    }
+
+    while (count != 0)
+    {
+        crc = ((crc << 8) & 0xffffffffUL) ^ tables[0][((crc >> 24) ^ *data) & 0xff];
+        data++;
+        count--;
+    }
+
+    return (crc);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Read_crc_config
+*
+*  ABSTRACT:
+*     Reads the CRC parameters from a GPCRCG configuration file
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       fp              FILE *                  configuration file, at the start
+*       commandline_crc unsigned long           FALSE if no CRC was entered
+*       config          struct crc_config_t *   parameters returned here
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Moved out of Flash_monitor_image so the parameters are known before
+*   the download. The file is left positioned after the CRC address line,
+*   where FlashMain reads the user information. When a CRC was entered on
+*   the command line the stored CRC address is replaced by 0, meaning there
+*   is no CRC stored in FLASH.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Read_crc_config (FILE *fp, unsigned long commandline_crc,
+                      struct crc_config_t *config)
+{
+    char hex_buf[100];  /* stores string from CRC configuration file */
+    unsigned long temp_32;
+
+    memset (config, 0, sizeof (*config));
+
+    /* Flush the first 3 lines in crc config file */
+    fgets (hex_buf, 100, fp);
+    fgets (hex_buf, 100, fp);
+    fgets (hex_buf, 100, fp);
+
+    /* Get the CRC width ( 8 , 16 , 32 ) */
+    fgets (hex_buf, 100, fp);
+    sscanf (hex_buf, "%lu", &temp_32);
+    config->width = (unsigned char)temp_32;
+
+    /* Get the polynomial from the configuration file */
+    fgets (hex_buf, 100, fp);
+    sscanf (hex_buf, "%lx", &config->polynomial);
+
+    /* Flush another line */
+    fgets (hex_buf, 100, fp);
+
+    /* Get the ROM start address */
+    fgets (hex_buf, 100, fp);
+    sscanf (hex_buf, "%lx", &config->start);
+
+    /* Get the ROM end address */
+    fgets (hex_buf, 100, fp);
+    sscanf (hex_buf, "%lx", &config->end);
+
+    /* Get the address in FLASH where the CRC is stored */
+    fgets (hex_buf, 100, fp);
+    if (commandline_crc == FALSE)
+    {
+        sscanf (hex_buf, "%lx", &config->address);
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Image_crc
+*
+*  ABSTRACT:
+*     Computes the CRC the programmed FLASH will have
+*
+*  INPUTS:
+*
+*     Constants:
+*       ERASED_BYTE
+*       HEX_OK
+*       HEX_BAD
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  parsed application
+*       config          const struct crc_config_t * CRC parameters
+*       crc             unsigned long *             result
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       HEX_OK, or HEX_BAD if the width is not 8, 16 or 32, the range is
+*       empty or memory ran out
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The range, less the final width / 8 bytes which hold (or would hold)
+*   the CRC, is assembled in a buffer of erased bytes with the overlapping
+*   image segments copied in, and run through Crc_slice_block. The result
+*   is the value the Logic reports after 'g': the calculated CRC when none
+*   is stored, otherwise the CRC stored at the end of the range.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned int Image_crc (const struct hex_image_t *image,
+                        const struct crc_config_t *config, unsigned long *crc)
+{
+    unsigned long tables[CRC_SLICES][256];
+    const struct image_segment_t *seg;
+    unsigned char *buf;
+    unsigned long range_end;    /* address past the end of the data */
+    unsigned long range_size;
+    unsigned long first;        /* first address of the overlap */
+    unsigned long last;         /* address past the end of the overlap */
+    unsigned int i;
+
+    if ((config->width != 8) && (config->width != 16) && (config->width != 32))
+    {
+        return (HEX_BAD);
+    }
+
+    if ((config->end < config->start) ||
+            (config->end - config->start + 1 <= (unsigned long) (config->width >> 3)))
+    {
+        return (HEX_BAD);
+    }
+    range_size = config->end - config->start + 1 - (config->width >> 3);
+    range_end = config->start + range_size;
+
+    buf = (unsigned char *)malloc (range_size);
+    if (buf == NULL)
+    {
+        return (HEX_BAD);
+    }
+    memset (buf, ERASED_BYTE, range_size);
+
+    for (i = 0; i < image->num_segments; i++)
+    {
+        seg = &image->segment[i];
+
+        first = (seg->address > config->start) ? seg->address : config->start;
+        last = seg->address + seg->length;
+        if (last > range_end)
+        {
+            last = range_end;
+        }
+
+        if (first < last)
+        {
+            memcpy (&buf[first - config->start],
+                    &seg->data[first - seg->address], last - first);
+        }
+    }
+
+    Make_crc_slice_tables (config->width, config->polynomial, tables);
+    *crc = Crc_slice_block (0, buf, range_size, tables) >> (32 - config->width);
+
+    free (buf);
+    return (HEX_OK);
+}
@@ -0,0 +1,876 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Delta.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : Erase_changed_sectors
+*               Get_sector_digests
+*               Image_sector_digest
+*               Keep_changed_sectors
+*               Erase_sector
+*               Start_erase_on_demand
+*               Check_programmed_sectors
+*               Next_programmed_range
+*               Sector_programmed
+*
+*  Abstract   : Differential programming. The Logic reports a CRC-32 of
+*               every FLASH sector; sectors whose CRC matches the one
+*               expected from the Intel Hex file are neither erased nor
+*               programmed. Erase on demand also works per sector: the
+*               Logic erases a sector just before the first block that is
+*               programmed into it.
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Added Start_erase_on_demand
+*  17 Oct 2026
+*    Added Check_programmed_sectors
+**************************************************************************/
+
+#include "include.h"
+
+static unsigned char Next_programmed_range (const struct hex_image_t *image,
+        const struct image_position_t *done,
+        unsigned int *next,
+        unsigned long *start,
+        unsigned long *end);
+static unsigned char Sector_programmed (const struct hex_image_t *image,
+                                        const struct image_position_t *done,
+                                        const struct flash_sector_t *sector);
+
+/* Value of an erased FLASH byte */
+#define  ERASED_BYTE                      0xff
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Erase_changed_sectors
+*
+*  ABSTRACT:
+*     Erases only the FLASH sectors whose contents differ from the image and
+*   removes the unchanged sectors from the image
+*
+*  INPUTS:
+*
+*     Constants:
+*       DIGEST_POLYNOMIAL
+*       HEX_OK
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  parsed application
+*       changed         struct hex_image_t *        empty; receives the
+*                                                   bytes of the changed
+*                                                   sectors
+*       erased          unsigned char *             set TRUE if the FLASH
+*                                                   was prepared here
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           0 if successful; Flash_monitor_image error codes if
+*                     unsuccessful
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Reads the sector map and digests ('h'). If the Logic has no sector
+*   map for its FLASH "erased" is left FALSE and the caller erases the whole
+*   FLASH as before. Otherwise a sector is changed when its digest differs
+*   from the digest of the image bytes in that sector, with every byte the
+*   image does not define taken as erased (0xFF) - i.e. what a full erase
+*   and program would leave there. Changed sectors are erased one at a time
+*   ('k') and only their bytes are copied to "changed", which is then
+*   downloaded instead of the image. Image bytes outside the sector map
+*   (never erased by the Logic) are always kept. The image itself is not
+*   modified, so the boards of a gang can share it.
+*
+*     Reading the digests and each sector erase are timed for the
+*   benchmark report.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Digests and sector erases timed for the benchmark report
+*  17 Oct 2026
+*     Changed sectors copied out instead of reducing the image in place
+*  17 Oct 2026
+*     Phase lines left off the console in a gang
+******************************************************************************/
+int Erase_changed_sectors (const struct hex_image_t *image,
+                           struct hex_image_t *changed, unsigned char *erased)
+{
+    struct sector_map_t map;
+    unsigned long table[256];
+    unsigned long digest;
+    unsigned int num_changed;
+    unsigned int i;
+    int command_response;
+    unsigned long num_bytes;    /* FLASH bytes covered */
+    unsigned long erase_start_ms;
+
+    *erased = FALSE;
+
+    Phase_printf ("\t> Reading sector CRCs .........................");
+    Report_start (PHASE_SECTOR_DIGEST);
+    if (Get_sector_digests (&map) != CMD_COMPLETE)
+    {
+        printf ("\n**** Timed out waiting for target response: '*H' \n");
+        return (22);
+    }
+    num_bytes = 0;
+    for (i = 0; i < map.num_sectors; i++)
+    {
+        num_bytes += map.sector[i].size;
+    }
+    Report_end (PHASE_SECTOR_DIGEST, num_bytes);
+
+    if (map.num_sectors == 0)
+    {
+        Phase_printf (" NO SECTOR MAP\n");
+        return (0);
+    }
+
+    Make_crc_table_32 (DIGEST_POLYNOMIAL, table);
+
+    num_changed = 0;
+    for (i = 0; i < map.num_sectors; i++)
+    {
+        if (Image_sector_digest (image, &map.sector[i], table, &digest) != HEX_OK)
+        {
+            printf ("\n**** Out of memory \n");
+            return (24);
+        }
+        map.sector[i].changed = (digest != map.sector[i].digest) ? TRUE : FALSE;
+        if (map.sector[i].changed == TRUE)
+        {
+            num_changed++;
+        }
+    }
+    Phase_printf (" %u of %u CHANGED\n", num_changed, map.num_sectors);
+
+    if (Keep_changed_sectors (image, &map, changed) != HEX_OK)
+    {
+        printf ("\n**** Out of memory \n");
+        return (24);
+    }
+
+    Report_start (PHASE_ERASE);
+    num_bytes = 0;
+    for (i = 0; i < map.num_sectors; i++)
+    {
+        if (map.sector[i].changed == FALSE)
+        {
+            continue;
+        }
+
+        Phase_printf ("\t> Erasing sector %3u at %06lX .................", i,
+                map.sector[i].address);
+
+        erase_start_ms = Ms_clock();
+        command_response = Erase_sector ((unsigned char)i);
+
+        if (command_response != CMD_COMPLETE)
+        {
+            if (command_response == CMD_FAILED)
+            {
+                printf ("\n**** Command failed: '$E' received \n");
+            }
+            else
+            {
+                printf ("\n**** Timed out waiting for target response: '*E' \n");
+            }
+            return (23);
+        }
+        Phase_printf (" COMPLETE \n");
+        Report_op (OP_SECTOR_ERASE, map.sector[i].size,
+                   Ms_clock() - erase_start_ms);
+        num_bytes += map.sector[i].size;
+    }
+    Report_end (PHASE_ERASE, num_bytes);
+
+    *erased = TRUE;
+    return (0);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Get_sector_digests
+*
+*  ABSTRACT:
+*     Reads the sector map and the CRC of every sector from the Logic
+*
+*  INPUTS:
+*
+*     Constants:
+*       FLASH_SERIAL_PORT_TIMEOUT_MS
+*       DIGEST_TIMEOUT_MS
+*
+*     Procedure Parameters:
+*       map             struct sector_map_t *   filled in
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       CMD_COMPLETE if all sectors were received, CMD_UNKNOWN otherwise
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Sends 'h'. The Logic answers "*H", the number of sectors and then
+*   the 32 bit start, size and CRC of each sector, MSB first. The Logic
+*   computes each CRC before sending the entry, so every entry gets the
+*   full command timeout.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+int Get_sector_digests (struct sector_map_t *map)
+{
+    struct echo_t logic_val;
+    unsigned char entry[12];
+    unsigned char num_sectors;
+    unsigned int i;
+    int timeout_ms = DIGEST_TIMEOUT_MS;
+
+    map->num_sectors = 0;
+
+    logic_val = Send_byte_wait_for_echo ('h', FLASH_SERIAL_PORT_TIMEOUT_MS);
+    if (logic_val.error_code != 0)
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    if (Wait_for_command_reponse ("*H", DIGEST_TIMEOUT_MS) != CMD_COMPLETE)
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    if (a_read (&num_sectors, 1, timeout_ms) != 1)
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    for (i = 0; i < num_sectors; i++)
+    {
+        if (a_read (entry, 12, timeout_ms) != 12)
+        {
+            return (CMD_UNKNOWN);
+        }
+
+        map->sector[i].address = Bytes_to_long (&entry[0]);
+        map->sector[i].size = Bytes_to_long (&entry[4]);
+        map->sector[i].digest = Bytes_to_long (&entry[8]);
+        map->sector[i].changed = TRUE;
+    }
+
+    map->num_sectors = num_sectors;
+    return (CMD_COMPLETE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Image_sector_digest
+*
+*  ABSTRACT:
+*     Computes the digest a sector will have once the image is programmed
+*
+*  INPUTS:
+*
+*     Constants:
+*       ERASED_BYTE
+*       HEX_OK
+*       HEX_BAD
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  parsed application
+*       sector          struct flash_sector_t *     sector to compute
+*       table           unsigned long *         digest CRC table
+*       digest          unsigned long *         result
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       HEX_OK, or HEX_BAD if memory ran out
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The sector is assembled in a buffer filled with erased bytes and the
+*   image segments overlapping the sector are copied in. The buffer is then
+*   run through the same CRC-32 as Send_sector_digests in the Logic.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned int Image_sector_digest (const struct hex_image_t *image,
+                                  struct flash_sector_t *sector,
+                                  unsigned long *table,
+                                  unsigned long *digest)
+{
+    const struct image_segment_t *seg;
+    unsigned char *buf;
+    unsigned long sector_end;
+    unsigned long first;    /* first address of the overlap */
+    unsigned long last;     /* address past the end of the overlap */
+    unsigned int i;
+
+    buf = (unsigned char *)malloc (sector->size);
+    if (buf == NULL)
+    {
+        return (HEX_BAD);
+    }
+    memset (buf, ERASED_BYTE, sector->size);
+
+    sector_end = sector->address + sector->size;
+    for (i = 0; i < image->num_segments; i++)
+    {
+        seg = &image->segment[i];
+
+        first = (seg->address > sector->address) ? seg->address : sector->address;
+        last = seg->address + seg->length;
+        if (last > sector_end)
+        {
+            last = sector_end;
+        }
+
+        if (first < last)
+        {
+            memcpy (&buf[first - sector->address],
+                    &seg->data[first - seg->address], last - first);
+        }
+    }
+
+    *digest = Crc_32_block (0, buf, sector->size, table);
+
+    free (buf);
+    return (HEX_OK);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Keep_changed_sectors
+*
+*  ABSTRACT:
+*     Copies the bytes of the changed sectors out of the image
+*
+*  INPUTS:
+*
+*     Constants:
+*       HEX_OK
+*       HEX_BAD
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  parsed application
+*       map             const struct sector_map_t * sectors with "changed"
+*                                                   set
+*       kept            struct hex_image_t *        empty image; filled in
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       HEX_OK, or HEX_BAD if memory ran out (kept is left empty)
+*
+*  FUNCTIONAL DESCRIPTION:
+*     A new image is built from every segment byte that lies in a changed
+*   sector or outside all sectors, using Add_hex_image_data so the block
+*   limits and byte totals stay correct.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Source image left untouched
+******************************************************************************/
+unsigned int Keep_changed_sectors (const struct hex_image_t *image,
+                                   const struct sector_map_t *map,
+                                   struct hex_image_t *kept)
+{
+    const struct image_segment_t *seg;
+    unsigned long address;
+    unsigned long run;      /* bytes up to the next sector boundary */
+    unsigned long offset;
+    unsigned char keep;
+    unsigned int i;
+    unsigned int s;
+
+    for (i = 0; i < image->num_segments; i++)
+    {
+        seg = &image->segment[i];
+        offset = 0;
+
+        while (offset < seg->length)
+        {
+            address = seg->address + offset;
+            run = seg->length - offset;
+            keep = TRUE;
+
+            for (s = 0; s < map->num_sectors; s++)
+            {
+                if ((address >= map->sector[s].address) &&
+                        (address < map->sector[s].address + map->sector[s].size))
+                {
+                    keep = map->sector[s].changed;
+                    if (run > map->sector[s].address + map->sector[s].size - address)
+                    {
+                        run = map->sector[s].address + map->sector[s].size - address;
+                    }
+                    break;
+                }
+                /* stop an unmapped run at the start of the next sector */
+                if ((map->sector[s].address > address) &&
+                        (run > map->sector[s].address - address))
+                {
+                    run = map->sector[s].address - address;
+                }
+            }
+
+            if ((keep == TRUE) &&
+                    (Add_hex_image_data (kept, address, &seg->data[offset],
+                                         (unsigned int)run) != HEX_OK))
+            {
+                Free_hex_image (kept);
+                return (HEX_BAD);
+            }
+
+            offset += run;
+        }
+    }
+
+    return (HEX_OK);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Erase_sector
+*
+*  ABSTRACT:
+*     Commands the Logic to erase one sector
+*
+*  INPUTS:
+*
+*     Constants:
+*       FLASH_SERIAL_PORT_TIMEOUT_MS
+*       SECTOR_ERASE_TIMEOUT_MS
+*
+*     Procedure Parameters:
+*       index           unsigned char       sector number from 'h'
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       CMD_COMPLETE, CMD_FAILED ("$E") or CMD_UNKNOWN
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Sends 'k' followed by the sector number and waits for "*E".
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+int Erase_sector (unsigned char index)
+{
+    struct echo_t logic_val;
+
+    logic_val = Send_byte_wait_for_echo ('k', FLASH_SERIAL_PORT_TIMEOUT_MS);
+    if (logic_val.error_code != 0)
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    a_write (&index, 1);
+
+    return (Wait_for_command_reponse ("*E", SECTOR_ERASE_TIMEOUT_MS));
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Start_erase_on_demand
+*
+*  ABSTRACT:
+*     Commands the Logic to erase each sector as it is first programmed
+*
+*  INPUTS:
+*
+*     Constants:
+*       FLASH_SERIAL_PORT_TIMEOUT_MS
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  image to be downloaded
+*       done            const struct image_position_t *   bytes ahead of
+*                                                   it are already
+*                                                   programmed (resume)
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       CMD_COMPLETE, CMD_FAILED ("$A": no sector map) or CMD_UNKNOWN
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Sends 'a', a 16 bit count and the 32 bit start and length of every
+*   range of FLASH programmed ahead of "done" (Next_programmed_range), all
+*   MSB first, then waits for "*A". The Logic leaves the sectors of those
+*   ranges alone. A new download has no ranges.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+int Start_erase_on_demand (const struct hex_image_t *image,
+                           const struct image_position_t *done)
+{
+    struct echo_t logic_val;
+    unsigned char range_bytes[8];   /* start and length of a range */
+    unsigned long range_start;
+    unsigned long range_end;
+    unsigned long num_ranges;
+    unsigned int next;
+
+    num_ranges = 0;
+    next = 0;
+    while (Next_programmed_range (image, done, &next, &range_start,
+                                  &range_end) == TRUE)
+    {
+        num_ranges++;
+    }
+    if (num_ranges > 0xffff)
+    {
+        return (CMD_FAILED);
+    }
+
+    logic_val = Send_byte_wait_for_echo ('a', FLASH_SERIAL_PORT_TIMEOUT_MS);
+    if (logic_val.error_code != 0)
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    range_bytes[0] = (unsigned char) (num_ranges >> 8);
+    range_bytes[1] = (unsigned char)num_ranges;
+    a_write (range_bytes, 2);
+
+    next = 0;
+    while (Next_programmed_range (image, done, &next, &range_start,
+                                  &range_end) == TRUE)
+    {
+        Long_to_bytes (range_start, &range_bytes[0]);
+        Long_to_bytes (range_end - range_start, &range_bytes[4]);
+        a_write (range_bytes, 8);
+    }
+
+    return (Wait_for_command_reponse ("*A", FLASH_SERIAL_PORT_TIMEOUT_MS));
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Check_programmed_sectors
+*
+*  ABSTRACT:
+*     Checks that the FLASH holds the part of an image a checkpoint says is
+*   programmed
+*
+*  INPUTS:
+*
+*     Constants:
+*       DIGEST_POLYNOMIAL
+*       HEX_OK
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  image being downloaded
+*       done            const struct image_position_t *   bytes ahead of
+*                                                   it are programmed
+*       programmed      unsigned char *             set FALSE if a sector
+*                                                   does not hold the image
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           0 if successful; Flash_monitor_image error codes if
+*                     unsuccessful
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Reads the sector digests ('h') and compares every sector that only
+*   holds image bytes ahead of "done" with the digest it has once the image
+*   is programmed (Image_sector_digest). The sector "done" is in is not
+*   checked: a block whose "*P" was lost may already be programmed in it,
+*   and the CRC at the end covers it. Without a sector map "programmed" is
+*   left as it is. Timed for the benchmark report.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+int Check_programmed_sectors (const struct hex_image_t *image,
+                              const struct image_position_t *done,
+                              unsigned char *programmed)
+{
+    struct sector_map_t map;
+    unsigned long table[256];
+    unsigned long digest;
+    unsigned long num_bytes;    /* FLASH bytes checked */
+    unsigned int num_checked;
+    unsigned int num_differ;
+    unsigned int i;
+
+    Phase_printf ("\t> Checking programmed sectors .................");
+    Report_start (PHASE_SECTOR_DIGEST);
+    if (Get_sector_digests (&map) != CMD_COMPLETE)
+    {
+        printf ("\n**** Timed out waiting for target response: '*H' \n");
+        return (22);
+    }
+
+    if (map.num_sectors == 0)
+    {
+        Phase_printf (" NO SECTOR MAP\n");
+        return (0);
+    }
+
+    Make_crc_table_32 (DIGEST_POLYNOMIAL, table);
+
+    num_checked = 0;
+    num_differ = 0;
+    num_bytes = 0;
+    for (i = 0; i < map.num_sectors; i++)
+    {
+        if (Sector_programmed (image, done, &map.sector[i]) == FALSE)
+        {
+            continue;
+        }
+
+        if (Image_sector_digest (image, &map.sector[i], table, &digest) != HEX_OK)
+        {
+            printf ("\n**** Out of memory \n");
+            return (24);
+        }
+        num_checked++;
+        num_bytes += map.sector[i].size;
+        if (digest != map.sector[i].digest)
+        {
+            num_differ++;
+        }
+    }
+    Report_end (PHASE_SECTOR_DIGEST, num_bytes);
+
+    if (num_differ != 0)
+    {
+        Phase_printf (" %u of %u CHANGED\n", num_differ, num_checked);
+        *programmed = FALSE;
+    }
+    else
+    {
+        Phase_printf (" %u MATCH\n", num_checked);
+    }
+    return (0);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Sector_programmed
+*
+*  ABSTRACT:
+*     Tells whether all image bytes of a sector lie ahead of a place in the
+*   image
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  image being downloaded
+*       done            const struct image_position_t *   bytes ahead of
+*                                                   it are programmed
+*       sector          const struct flash_sector_t *   sector to look at
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned char TRUE if the sector holds image bytes and all of them
+*                     are ahead of "done"
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Each segment is split at "done" into the part programmed and the
+*   part still to be sent, and both are compared with the sector.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Sector_programmed (const struct hex_image_t *image,
+                                        const struct image_position_t *done,
+                                        const struct flash_sector_t *sector)
+{
+    const struct image_segment_t *seg;
+    unsigned long sector_end;
+    unsigned long split;    /* first address of the segment not programmed */
+    unsigned char found;
+    unsigned int i;
+
+    sector_end = sector->address + sector->size;
+    found = FALSE;
+    for (i = 0; i < image->num_segments; i++)
+    {
+        seg = &image->segment[i];
+        if (i < done->segment)
+        {
+            split = seg->address + seg->length;
+        }
+        else if (i == done->segment)
+        {
+            split = seg->address + done->offset;
+        }
+        else
+        {
+            split = seg->address;
+        }
+
+        if ((seg->address < split) && (seg->address < sector_end) &&
+                (split > sector->address))
+        {
+            found = TRUE;
+        }
+        if ((split < seg->address + seg->length) && (split < sector_end) &&
+                (seg->address + seg->length > sector->address))
+        {
+            return (FALSE);
+        }
+    }
+
+    return (found);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Next_programmed_range
+*
+*  ABSTRACT:
+*     Returns the next range of FLASH programmed ahead of a place in an image
+*
+*  INPUTS:
+*
+*     Constants:
+*       MIN_SECTOR_BYTES
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  image being downloaded
+*       done            const struct image_position_t *   bytes ahead of
+*                                                   it are programmed
+*       next            unsigned int *      first segment to look at; 0 for
+*                                           the first range, advanced here
+*       start           unsigned long *     first address of the range
+*       end             unsigned long *     first address after the range
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned char TRUE if a range is returned, FALSE after the last
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Following segments are joined while each starts above the range and
+*   less than MIN_SECTOR_BYTES after its end: no sector fits in the gap, so
+*   the Logic marks the same sectors for the joined range as for the
+*   segments one by one, and a file of short records (or one with runs of
+*   0xFF removed) needs only a few ranges.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Next_programmed_range (const struct hex_image_t *image,
+        const struct image_position_t *done,
+        unsigned int *next,
+        unsigned long *start,
+        unsigned long *end)
+{
+    const struct image_segment_t *seg;
+    unsigned long seg_end;
+    unsigned char found;
+
+    found = FALSE;
+    while ((*next <= done->segment) && (*next < image->num_segments))
+    {
+        seg = &image->segment[*next];
+        seg_end = seg->address +
+                  ((*next < done->segment) ? seg->length : done->offset);
+
+        if (seg_end > seg->address)
+        {
+            if (found == FALSE)
+            {
+                *start = seg->address;
+                *end = seg_end;
+                found = TRUE;
+            }
+            else if ((seg->address >= *start) &&
+                     (seg->address < *end + MIN_SECTOR_BYTES))
+            {
+                if (seg_end > *end)
+                {
+                    *end = seg_end;
+                }
+            }
+            else
+            {
+                break;
+            }
+        }
+        (*next)++;
+    }
+
+    return (found);
+}
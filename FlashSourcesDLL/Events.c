@@ -0,0 +1,412 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Events.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : EnableFlashEvents
+*               GetFlashEvent
+*               Events_enabled
+*               Post_event
+*               Progress_start
+*               Progress_update
+*               Progress_end
+*
+*  Abstract   : Progress and log events for the host. The threads flashing
+*               the boards post events into rings the host (the .NET
+*               executable or a GUI) empties at its own rate, so neither
+*               the console nor a log file is written while bytes are
+*               being sent. Each ring has one writer (the thread posting)
+*               and one reader (the host), so no lock is needed.
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Only progress events dropped when a ring is nearly full
+**************************************************************************/
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "include.h"
+
+/* Orders the event bytes and the ring index the other thread reads */
+#ifdef _WIN32
+#define  EVENT_BARRIER()                  MemoryBarrier()
+#else
+#define  EVENT_BARRIER()                  __sync_synchronize()
+#endif
+
+/* Events of one writer. head and tail only grow; they wrap together */
+struct event_ring_t
+{
+    volatile unsigned long head;    /* next event written; writer only */
+    volatile unsigned long tail;    /* next event read; host only */
+    unsigned long dropped;          /* results and log lines lost; writer
+                                       only */
+    struct flash_event_t event[EVENT_RING_SIZE];
+};
+
+/* Ring 0 is FlashMain's own; ring n is the board on COM port n */
+static struct event_ring_t rings[MAX_COM_PORT + 1];
+
+static volatile int events_enabled = FALSE;
+
+/* Ring GetFlashEvent looks at first; host only */
+static int next_ring = 0;
+
+
+// Called by the host before FlashMain when it polls GetFlashEvent; until
+// then progress is written to the console and the log lines to the log
+// files by the DLL, as before
+__declspec (dllexport) void __stdcall EnableFlashEvents (int enable)
+{
+    events_enabled = (enable != 0) ? TRUE : FALSE;
+}
+
+
+// Oldest event not read yet: 1 if one was returned, 0 if there is none.
+// The rings are taken in turn so a busy board does not hold up the
+// others. text receives at most textSize - 1 characters
+__declspec (dllexport) int __stdcall GetFlashEvent (int *comPort, int *type,
+        long *value, char *text,
+        int textSize)
+{
+    struct event_ring_t *ring;
+    struct flash_event_t *event;
+    unsigned long tail;
+    int i;
+
+    for (i = 0; i <= MAX_COM_PORT; i++)
+    {
+        ring = &rings[(next_ring + i) % (MAX_COM_PORT + 1)];
+        tail = ring->tail;
+        if (tail == ring->head)
+        {
+            continue;
+        }
+
+        /* The event was complete before head was moved past it */
+        EVENT_BARRIER();
+        event = &ring->event[tail % EVENT_RING_SIZE];
+        *comPort = event->com_port;
+        *type = event->type;
+        *value = event->value;
+        if ((text != NULL) && (textSize > 0))
+        {
+            strncpy (text, event->text, (size_t) (textSize - 1));
+            text[textSize - 1] = '\0';
+        }
+
+        /* Copied out before the writer may use the slot again */
+        EVENT_BARRIER();
+        ring->tail = tail + 1;
+
+        next_ring = (next_ring + i + 1) % (MAX_COM_PORT + 1);
+        return (1);
+    }
+
+    return (0);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Events_enabled
+*
+*  ABSTRACT:
+*     Tells if the host is polling the events
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned char   TRUE after EnableFlashEvents (1)
+*
+*  FUNCTIONAL DESCRIPTION:
+*     None
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned char Events_enabled (void)
+{
+    return ((events_enabled == TRUE) ? TRUE : FALSE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Post_event
+*
+*  ABSTRACT:
+*     Hands an event to the host
+*
+*  INPUTS:
+*
+*     Constants:
+*       EVENT_RING_SIZE
+*       EVENT_RESERVED_SLOTS
+*       EVENT_PROGRESS
+*       EVENT_TEXT_BYTES
+*       MAX_COM_PORT
+*
+*     Procedure Parameters:
+*       com_port        int             board the event is about; 0 for
+*                                       FlashMain's own events
+*       type            int             EVENT_xxx
+*       value           long            depends on the type
+*       text            const char *    depends on the type; may be NULL
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The event goes to the ring of com_port, which only the thread
+*   flashing that board (or FlashMain, for ring 0) writes. Nothing waits:
+*   when events are not enabled the event is not kept. A download posts a
+*   progress event every 0.1%, so a host that polls slowly can let the
+*   ring fill up; a progress event is dropped once only
+*   EVENT_RESERVED_SLOTS are free (the next one carries the percentage
+*   anyway), so the result and log lines of a session always find room. A
+*   result or log line that still finds the ring full (the host stopped
+*   polling) is counted and reported on the console once per ring. Text
+*   longer than EVENT_TEXT_BYTES - 1 is cut short.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Room kept for results and log lines; lost ones reported
+******************************************************************************/
+void Post_event (int com_port, int type, long value, const char *text)
+{
+    struct event_ring_t *ring;
+    struct flash_event_t *event;
+    unsigned long head;
+
+    if ((events_enabled == FALSE) || (com_port < 0) || (com_port > MAX_COM_PORT))
+    {
+        return;
+    }
+
+    ring = &rings[com_port];
+    head = ring->head;
+    if ((type == EVENT_PROGRESS) &&
+            (head - ring->tail >= EVENT_RING_SIZE - EVENT_RESERVED_SLOTS))
+    {
+        return;
+    }
+    if (head - ring->tail >= EVENT_RING_SIZE)
+    {
+        if (ring->dropped == 0)
+        {
+            printf ("\n** Host not reading events: type %d for COM%d lost \n",
+                    type, com_port);
+        }
+        ring->dropped++;
+        return;
+    }
+
+    event = &ring->event[head % EVENT_RING_SIZE];
+    event->com_port = com_port;
+    event->type = type;
+    event->value = value;
+    event->text[0] = '\0';
+    if (text != NULL)
+    {
+        strncpy (event->text, text, EVENT_TEXT_BYTES - 1);
+        event->text[EVENT_TEXT_BYTES - 1] = '\0';
+    }
+
+    /* The host may read the event once head has moved past it */
+    EVENT_BARRIER();
+    ring->head = head + 1;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Progress_start
+*
+*  ABSTRACT:
+*     Starts the download percentage
+*
+*  INPUTS:
+*
+*     Constants:
+*       EVENT_PROGRESS
+*
+*     Procedure Parameters:
+*       progress        struct progress_t *     percentage of the session
+*       total           unsigned long           bytes of the download
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Writes the "Download status" line unless other boards are being
+*   flashed at the same time. When the host polls the events the
+*   percentage is left to it (EVENT_PROGRESS) and only written to the
+*   line at the end (Progress_end).
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Progress_start (struct progress_t *progress, unsigned long total)
+{
+    progress->total = (total != 0) ? total : 1;
+    progress->permille = 0;
+    progress->next = (progress->total + 999) / 1000;
+
+    Post_event (Current_session()->com_port, EVENT_PROGRESS, 0, NULL);
+
+    if (Current_session()->gang == TRUE)
+    {
+        return;
+    }
+
+    if (Events_enabled() == TRUE)
+    {
+        printf ("\t> Download status ......................");
+    }
+    else
+    {
+        printf ("\t> Download status ......................   0.0%% complete");
+        printf ("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Progress_update
+*
+*  ABSTRACT:
+*     Updates the download percentage
+*
+*  INPUTS:
+*
+*     Constants:
+*       EVENT_PROGRESS
+*
+*     Procedure Parameters:
+*       progress        struct progress_t *     percentage of the session
+*       done            unsigned long           bytes sent (or acknowledged)
+*                                               so far
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Called for every block, so until the next 0.1% is reached it only
+*   compares done with the byte count of that step. Then the percentage
+*   is posted (EVENT_PROGRESS, in 0.1% units) or, when the host does not
+*   poll the events, written over the "Download status" line.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Progress_update (struct progress_t *progress, unsigned long done)
+{
+    if (done < progress->next)
+    {
+        return;
+    }
+
+    progress->permille = (done >= progress->total) ? 1000 :
+                         (done * 1000) / progress->total;
+    progress->next = ((progress->permille + 1) * progress->total + 999) / 1000;
+
+    if (Events_enabled() == TRUE)
+    {
+        Post_event (Current_session()->com_port, EVENT_PROGRESS,
+                    (long)progress->permille, NULL);
+    }
+    else if (Current_session()->gang == FALSE)
+    {
+        printf ("%3lu.%1lu%%\b\b\b\b\b\b", progress->permille / 10,
+                progress->permille % 10);
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Progress_end
+*
+*  ABSTRACT:
+*     Completes the "Download status" line
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       progress        struct progress_t *     percentage of the session
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Only needed when the host polls the events; the console then gets
+*   the final percentage once the download is over.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Progress_end (const struct progress_t *progress)
+{
+    if ((Events_enabled() == TRUE) && (Current_session()->gang == FALSE))
+    {
+        printf (" %3lu.%1lu%% complete", progress->permille / 10,
+                progress->permille % 10);
+    }
+}
@@ -0,0 +1,268 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Gang.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : Parse_port_list
+*               Flash_gang
+*               Gang_thread
+*
+*  Abstract   : Gang programming. The test station has a fixture on each of
+*               several COM ports; "1,3,5" as the COM port argument of
+*               FlashMain flashes the boards on all of them at once, one
+*               thread per board, from a single parse of the application.
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+**************************************************************************/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "include.h"
+
+/* What a gang thread needs; the application and options are shared and
+only read */
+struct gang_job_t
+{
+    struct flash_session_t *session;
+    struct file_info_t files;
+    const struct application_t *app;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI Gang_thread (LPVOID arg);
+#else
+static void *Gang_thread (void *arg);
+#endif
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Parse_port_list
+*
+*  ABSTRACT:
+*     Reads the COM port argument of FlashMain
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       list            const char *    "3" or "1,3,5"
+*       ports           int *           MAX_COM_PORT entries
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int     number of ports; 0 if the list is not valid
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Ports are single digits 1 ... MAX_COM_PORT separated by commas; a port
+*   may be given only once.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+int Parse_port_list (const char *list, int *ports)
+{
+    char used[MAX_COM_PORT + 1];
+    int num_ports = 0;
+    int port;
+
+    memset (used, FALSE, sizeof (used));
+    for (;;)
+    {
+        port = *list - '0';
+        if ((port < 1) || (port > MAX_COM_PORT) || (used[port] == TRUE))
+        {
+            return (0);
+        }
+        used[port] = TRUE;
+        ports[num_ports++] = port;
+        list++;
+
+        if (*list == '\0')
+        {
+            return (num_ports);
+        }
+        if (*list != ',')
+        {
+            return (0);
+        }
+        list++;
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Flash_gang
+*
+*  ABSTRACT:
+*     Flashes several boards at the same time
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       sessions        struct flash_session_t *   one per board, set up
+*                                                  by Init_session
+*       num_sessions    int
+*       files           struct file_info_t         command line options
+*       app             const struct application_t *  parsed application
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int     number of boards that failed
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Runs Run_session for every board in its own thread and waits for all
+*   of them, then lists the result of each COM port. A board that fails
+*   does not stop the others. The application image is shared; nothing
+*   written by a thread is shared with another.
+*     The progress lines of the boards are interleaved on the console, so
+*   the per-block percentage is not displayed in a gang.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+int Flash_gang (struct flash_session_t *sessions, int num_sessions,
+                struct file_info_t files, const struct application_t *app)
+{
+    struct gang_job_t jobs[MAX_COM_PORT];
+#ifdef _WIN32
+    HANDLE threads[MAX_COM_PORT];
+#else
+    pthread_t threads[MAX_COM_PORT];
+#endif
+    char started[MAX_COM_PORT];
+    int num_failed = 0;
+    int i;
+
+    printf ("\t> Flashing %d boards ...\n", num_sessions);
+
+    for (i = 0; i < num_sessions; i++)
+    {
+        sessions[i].gang = TRUE;
+        jobs[i].session = &sessions[i];
+        jobs[i].files = files;
+        jobs[i].app = app;
+
+#ifdef _WIN32
+        threads[i] = CreateThread (NULL, 0, Gang_thread, &jobs[i], 0, NULL);
+        started[i] = (threads[i] != NULL);
+#else
+        started[i] = (pthread_create (&threads[i], NULL, Gang_thread,
+                                      &jobs[i]) == 0);
+#endif
+        if (started[i] == FALSE)
+        {
+            printf ("**** Unable to start the session on COM%d \n",
+                    sessions[i].com_port);
+        }
+    }
+
+    for (i = 0; i < num_sessions; i++)
+    {
+        if (started[i] == FALSE)
+        {
+            continue;
+        }
+#ifdef _WIN32
+        WaitForSingleObject (threads[i], INFINITE);
+        CloseHandle (threads[i]);
+#else
+        pthread_join (threads[i], NULL);
+#endif
+    }
+
+    printf ("\n\t> Gang results\n");
+    for (i = 0; i < num_sessions; i++)
+    {
+        if (sessions[i].result == 0)
+        {
+            printf ("\t> COM%d ........................................ PASSED"
+                    "  (%lu.%lu s", sessions[i].com_port,
+                    sessions[i].elapsed_ms / 1000,
+                    (sessions[i].elapsed_ms % 1000) / 100);
+            if (app->have_crc_config == TRUE)
+            {
+                printf (", CRC 0x%s", sessions[i].crc_string);
+            }
+            printf (")\n");
+        }
+        else
+        {
+            printf ("\t> COM%d ........................................ FAILED"
+                    "  (error %d)\n", sessions[i].com_port, sessions[i].result);
+            num_failed++;
+        }
+    }
+
+    return (num_failed);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Gang_thread
+*
+*  ABSTRACT:
+*     Thread flashing one board of a gang
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       arg             struct gang_job_t *
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       0
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The result is left in the session.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+#ifdef _WIN32
+static DWORD WINAPI Gang_thread (LPVOID arg)
+#else
+static void *Gang_thread (void *arg)
+#endif
+{
+    struct gang_job_t *job = (struct gang_job_t *)arg;
+
+    Run_session (job->session, job->files, job->app);
+
+    return (0);
+}
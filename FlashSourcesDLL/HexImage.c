@@ -0,0 +1,892 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : HexImage.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : Init_hex_image
+*               Free_hex_image
+*               Add_hex_image_data
+*               Sort_hex_image
+*               Compare_segments
+*               Image_data_differs
+*               Write_hex_image_file
+*               Remove_erased_runs
+*               Image_next_block
+*               Image_download_size
+*
+*  Abstract   : In-memory binary image of a parsed Intel Hex file. Replaces
+*               the ASCII ".167" temporary file that used to sit between the
+*               hex parser and the download loop.
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Image walked in blocks shorter than a segment
+*  17 Oct 2026
+*    Erased runs keep a word in every sector they reach
+*  17 Oct 2026
+*    Segments sorted and overlaps merged after parsing (Sort_hex_image)
+**************************************************************************/
+
+#include "include.h"
+
+static int Compare_segments (const void *a, const void *b);
+static unsigned char Image_data_differs (const struct hex_image_t *image,
+        unsigned long address,
+        const unsigned char *data,
+        unsigned long length,
+        unsigned long *conflict);
+
+/* Number of segment descriptors / data bytes added each time an image or
+   segment runs out of room */
+#define  SEGMENT_LIST_GROW_SIZE           16
+#define  SEGMENT_DATA_GROW_SIZE           0x1000
+
+/* Number of data bytes written per line of an exported ".167" file */
+#define  BYTES_PER_EXPORT_LINE            32
+
+/* Shortest run of erased bytes worth splitting a block for; below this the
+   extra block header and command turnaround cost more than the bytes */
+#define  ERASED_RUN_MIN_BYTES             32
+
+/* Value of an erased FLASH byte */
+#define  ERASED_BYTE                      0xff
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Init_hex_image
+*
+*  ABSTRACT:
+*     Initializes an empty binary image
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       image         struct hex_image_t *    image to be initialized
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Clears the segment list and the byte counters. The total number of
+*   bytes starts at 4 because the Logic counts the 4 byte "total bytes"
+*   field itself.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Init_hex_image (struct hex_image_t *image)
+{
+    image->segment = NULL;
+    image->num_segments = 0;
+    image->max_segments = 0;
+    image->num_data_bytes = 0;
+    image->total_bytes = 4;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Free_hex_image
+*
+*  ABSTRACT:
+*     Releases all memory held by a binary image
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       image         struct hex_image_t *    image to be released
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Frees the data of every segment and the segment list. The image is
+*   left empty and may be reused.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Free_hex_image (struct hex_image_t *image)
+{
+    unsigned int i;
+
+    for (i = 0; i < image->num_segments; i++)
+    {
+        free (image->segment[i].data);
+    }
+    free (image->segment);
+
+    Init_hex_image (image);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Add_hex_image_data
+*
+*  ABSTRACT:
+*     Appends the data bytes of one Intel Hex data record to the image
+*
+*  INPUTS:
+*
+*     Constants:
+*       MAX_BYTES_IN_DOWNLOAD_BLOCK
+*       HEX_OK
+*       HEX_BAD
+*
+*     Procedure Parameters:
+*       image         struct hex_image_t *    image being built
+*       address       unsigned long           32 bit address of data[0]
+*       data          unsigned char *         data bytes of the record
+*       num_bytes     unsigned int            number of bytes in "data"
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       HEX_OK if the data was stored, HEX_BAD if memory ran out
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The bytes are appended to the last segment when they continue it
+*   exactly; otherwise a new segment is started, even below or over the
+*   bytes already added (Sort_hex_image puts a parsed image in order). A segment is also closed
+*   once it holds MAX_BYTES_IN_DOWNLOAD_BLOCK bytes, because every segment
+*   is sent to the Logic as one block and the block size field is only 16
+*   bits wide. "total_bytes" is kept up to date as the number of bytes the
+*   Logic will receive: 6 header bytes per block plus the data.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Segment data grown by as many steps as needed; callers other than
+*     the hex parser append more than one step at a time
+******************************************************************************/
+unsigned int Add_hex_image_data (struct hex_image_t *image,
+                                 unsigned long address,
+                                 unsigned char *data,
+                                 unsigned int num_bytes)
+{
+    struct image_segment_t *seg;    /* segment receiving the data */
+    struct image_segment_t *list;   /* re-allocated segment list */
+    unsigned char *buf;             /* re-allocated segment data */
+    unsigned long room;             /* bytes left before the block limit */
+    unsigned long new_capacity;
+    unsigned int count;
+
+    while (num_bytes > 0)
+    {
+        seg = NULL;
+        if (image->num_segments > 0)
+        {
+            seg = &image->segment[image->num_segments - 1];
+            if ((seg->address + seg->length != address) ||
+                    (seg->length >= MAX_BYTES_IN_DOWNLOAD_BLOCK))
+            {
+                seg = NULL;
+            }
+        }
+
+        /* Start a new segment */
+        if (seg == NULL)
+        {
+            if (image->num_segments == image->max_segments)
+            {
+                list = (struct image_segment_t *)realloc (image->segment,
+                        (image->max_segments + SEGMENT_LIST_GROW_SIZE) *
+                        sizeof (struct image_segment_t));
+                if (list == NULL)
+                {
+                    return (HEX_BAD);
+                }
+                image->segment = list;
+                image->max_segments += SEGMENT_LIST_GROW_SIZE;
+            }
+
+            seg = &image->segment[image->num_segments];
+            seg->address = address;
+            seg->length = 0;
+            seg->capacity = 0;
+            seg->data = NULL;
+            image->num_segments++;
+
+            /* 32 bit address and 16 bit size sent ahead of the block data */
+            image->total_bytes += 6;
+        }
+
+        room = MAX_BYTES_IN_DOWNLOAD_BLOCK - seg->length;
+        count = (num_bytes > room) ? (unsigned int)room : num_bytes;
+
+        if (seg->length + count > seg->capacity)
+        {
+            new_capacity = seg->capacity;
+            while (new_capacity < seg->length + count)
+            {
+                new_capacity += SEGMENT_DATA_GROW_SIZE;
+            }
+            if (new_capacity > MAX_BYTES_IN_DOWNLOAD_BLOCK)
+            {
+                new_capacity = MAX_BYTES_IN_DOWNLOAD_BLOCK;
+            }
+            buf = (unsigned char *)realloc (seg->data, new_capacity);
+            if (buf == NULL)
+            {
+                return (HEX_BAD);
+            }
+            seg->data = buf;
+            seg->capacity = new_capacity;
+        }
+
+        memcpy (&seg->data[seg->length], data, count);
+        seg->length += count;
+
+        image->num_data_bytes += count;
+        image->total_bytes += count;
+
+        address += count;
+        data += count;
+        num_bytes -= count;
+    }
+
+    return (HEX_OK);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Sort_hex_image
+*
+*  ABSTRACT:
+*     Puts the segments of a parsed image in address order and merges the
+*   ones that overlap
+*
+*  INPUTS:
+*
+*     Constants:
+*       HEX_OK
+*       HEX_BAD
+*       HEX_CONFLICT
+*
+*     Procedure Parameters:
+*       image         struct hex_image_t *    image built by
+*                                             Add_hex_image_data
+*       conflict      unsigned long *         set to the first address given
+*                                             two different values
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       HEX_OK, HEX_BAD if memory ran out or HEX_CONFLICT if two records
+*       give an address different values (image left unchanged)
+*
+*  FUNCTIONAL DESCRIPTION:
+*     An Intel Hex file need not list its records in address order, and a
+*   record may repeat bytes of another. Image_next_block, Remove_erased_runs,
+*   Image_crc and the checkpoint all need ascending segments that do not
+*   overlap, so the parser calls this once the file is read. A file already
+*   in order (the usual case) is left as it is. Otherwise the segments are
+*   sorted by address and the image is rebuilt with Add_hex_image_data;
+*   bytes given again with the same value are added once, and a byte given
+*   a different value fails the file, since either value may be the one
+*   meant.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned int Sort_hex_image (struct hex_image_t *image,
+                             unsigned long *conflict)
+{
+    struct hex_image_t sorted;
+    struct image_segment_t *seg;
+    unsigned long end;          /* address past the bytes added so far */
+    unsigned long seg_end;
+    unsigned long skip;         /* bytes of the segment already added */
+    unsigned int i;
+
+    for (i = 1; i < image->num_segments; i++)
+    {
+        if (image->segment[i].address <
+                image->segment[i - 1].address + image->segment[i - 1].length)
+        {
+            break;
+        }
+    }
+    if (i >= image->num_segments)
+    {
+        return (HEX_OK);
+    }
+
+    qsort (image->segment, image->num_segments,
+           sizeof (struct image_segment_t), Compare_segments);
+
+    Init_hex_image (&sorted);
+    end = 0;
+    for (i = 0; i < image->num_segments; i++)
+    {
+        seg = &image->segment[i];
+        seg_end = seg->address + seg->length;
+
+        /* Every byte from the segment start to "end" is already added: the
+        segment that reached "end" started no higher */
+        skip = 0;
+        if ((i > 0) && (seg->address < end))
+        {
+            skip = ((seg_end < end) ? seg_end : end) - seg->address;
+            if (Image_data_differs (&sorted, seg->address, seg->data, skip,
+                                    conflict) == TRUE)
+            {
+                Free_hex_image (&sorted);
+                return (HEX_CONFLICT);
+            }
+        }
+
+        if ((seg->length > skip) &&
+                (Add_hex_image_data (&sorted, seg->address + skip,
+                                     &seg->data[skip],
+                                     (unsigned int) (seg->length - skip)) != HEX_OK))
+        {
+            Free_hex_image (&sorted);
+            return (HEX_BAD);
+        }
+
+        if ((i == 0) || (seg_end > end))
+        {
+            end = seg_end;
+        }
+    }
+
+    Free_hex_image (image);
+    *image = sorted;
+    return (HEX_OK);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Compare_segments
+*
+*  ABSTRACT:
+*     Orders two segments by address (qsort)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       a             const void *    struct image_segment_t
+*       b             const void *    struct image_segment_t
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           -1, 0 or 1 as "a" starts below, at or above "b"
+*
+*  FUNCTIONAL DESCRIPTION:
+*     None
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static int Compare_segments (const void *a, const void *b)
+{
+    unsigned long address_a = ((const struct image_segment_t *)a)->address;
+    unsigned long address_b = ((const struct image_segment_t *)b)->address;
+
+    if (address_a < address_b)
+    {
+        return (-1);
+    }
+    return ((address_a > address_b) ? 1 : 0);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Image_data_differs
+*
+*  ABSTRACT:
+*     Compares bytes with the ones an image already holds at their address
+*
+*  INPUTS:
+*
+*     Constants:
+*       TRUE
+*       FALSE
+*
+*     Procedure Parameters:
+*       image         const struct hex_image_t *  sorted image holding
+*                                             every byte of the range
+*       address       unsigned long           address of data[0]
+*       data          const unsigned char *   bytes to compare
+*       length        unsigned long           number of bytes
+*       conflict      unsigned long *         set to the address of the
+*                                             first byte that differs
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned char TRUE if a byte differs
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Sort_hex_image only compares the bytes at the top of the image, so
+*   the segments are searched from the last one down.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Image_data_differs (const struct hex_image_t *image,
+        unsigned long address,
+        const unsigned char *data,
+        unsigned long length,
+        unsigned long *conflict)
+{
+    const struct image_segment_t *seg;
+    unsigned long first;    /* first address of the overlap */
+    unsigned long last;     /* address past the end of the overlap */
+    unsigned long j;
+    unsigned int i;
+
+    for (i = image->num_segments; i > 0; i--)
+    {
+        seg = &image->segment[i - 1];
+        if (seg->address >= address + length)
+        {
+            continue;
+        }
+        if (seg->address + seg->length <= address)
+        {
+            break;
+        }
+
+        first = (seg->address > address) ? seg->address : address;
+        last = seg->address + seg->length;
+        if (last > address + length)
+        {
+            last = address + length;
+        }
+
+        for (j = first; j < last; j++)
+        {
+            if (seg->data[j - seg->address] != data[j - address])
+            {
+                *conflict = j;
+                return (TRUE);
+            }
+        }
+    }
+
+    return (FALSE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Write_hex_image_file
+*
+*  ABSTRACT:
+*     Writes a binary image out in the legacy ASCII ".167" format
+*
+*  INPUTS:
+*
+*     Constants:
+*       TRUE
+*       BYTES_PER_EXPORT_LINE
+*
+*     Procedure Parameters:
+*       image               struct hex_image_t *    image to be written
+*       out                 FILE *                  opened text file
+*       write_header_info   unsigned char           TRUE if the total byte
+*                                                   count and the block
+*                                                   address and size are to
+*                                                   be written
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       0 if successful, 1 if the file could not be written
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Every byte is written as 2 ASCII hex characters. With header info
+*   the file starts with the 32 bit total byte count and every block starts
+*   on a new line with its 16 bit segment, 16 bit offset and 16 bit size,
+*   i.e. exactly the byte stream that is sent to the Logic. Without header
+*   info only the data bytes are written. The file is no longer used for
+*   the download; it is kept as a debugging aid.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned char Write_hex_image_file (struct hex_image_t *image,
+                                    FILE *out,
+                                    unsigned char write_header_info)
+{
+    struct image_segment_t *seg;
+    unsigned int i;
+    unsigned long j;
+
+    if (write_header_info == TRUE)
+    {
+        fprintf (out, "%08lX", image->total_bytes);
+    }
+
+    for (i = 0; i < image->num_segments; i++)
+    {
+        seg = &image->segment[i];
+
+        if (write_header_info == TRUE)
+        {
+            fprintf (out, "\n%04lX%04lX%04lX", (seg->address >> 16) & 0xffff,
+                     seg->address & 0xffff, seg->length);
+        }
+
+        for (j = 0; j < seg->length; j++)
+        {
+            if ((write_header_info == TRUE) && ((j % BYTES_PER_EXPORT_LINE) == 0))
+            {
+                fprintf (out, "\n");
+            }
+            fprintf (out, "%02X", seg->data[j]);
+        }
+    }
+
+    if (write_header_info == TRUE)
+    {
+        fprintf (out, "\n");
+    }
+
+    return ((ferror (out) != 0) ? 1 : 0);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Remove_erased_runs
+*
+*  ABSTRACT:
+*     Removes runs of erased (0xFF) bytes from the image
+*
+*  INPUTS:
+*
+*     Constants:
+*       ERASED_BYTE
+*       ERASED_RUN_MIN_BYTES
+*       HEX_OK
+*       HEX_BAD
+*
+*     Procedure Parameters:
+*       image         struct hex_image_t *    image to be reduced
+*       num_removed   unsigned long *         number of bytes removed
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       HEX_OK, or HEX_BAD if memory ran out (image left unchanged)
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Programming 0xFF never changes a FLASH bit, so these bytes need not
+*   be sent at all. A run at the start or end of a segment is always cut
+*   off; a run inside a segment is cut out (splitting the segment in two)
+*   only when it is at least ERASED_RUN_MIN_BYTES long. Cuts are made on
+*   even addresses because the Logic programs whole words; a kept piece of
+*   odd length is padded by the Logic with 0xFF, which is the byte that was
+*   removed. The image is rebuilt with Add_hex_image_data so block limits
+*   and byte totals stay correct.
+*
+*     A Logic that erases on demand only erases the sectors blocks are
+*   programmed into, so a sector the file fills with 0xFF alone would keep
+*   its old contents. One word of every cut is therefore kept where it
+*   starts a segment and at every MIN_SECTOR_BYTES boundary inside it:
+*   sectors start on such a boundary, so each sector a cut reaches still
+*   gets a block (programming 0xFF changes nothing).
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     One word kept per sector a cut reaches, for erase on demand
+******************************************************************************/
+unsigned int Remove_erased_runs (struct hex_image_t *image,
+                                 unsigned long *num_removed)
+{
+    struct hex_image_t kept;
+    struct image_segment_t *seg;
+    unsigned long keep_start;   /* offset of the first byte not yet added */
+    unsigned long run_start;    /* offset of the first byte of a 0xFF run */
+    unsigned long run_end;      /* offset past the last byte of the run */
+    unsigned long cut_start;    /* run_start rounded up to an even address */
+    unsigned long cut_end;      /* run_end rounded down to an even address */
+    unsigned long probe;        /* offset of a word of the cut that is kept */
+    unsigned long probe_end;
+    unsigned long j;
+    unsigned int i;
+
+    Init_hex_image (&kept);
+
+    for (i = 0; i < image->num_segments; i++)
+    {
+        seg = &image->segment[i];
+        keep_start = 0;
+        j = 0;
+
+        while (j < seg->length)
+        {
+            if (seg->data[j] != ERASED_BYTE)
+            {
+                j++;
+                continue;
+            }
+
+            run_start = j;
+            while ((j < seg->length) && (seg->data[j] == ERASED_BYTE))
+            {
+                j++;
+            }
+            run_end = j;
+
+            cut_start = run_start + ((seg->address + run_start) & 1);
+            cut_end = (run_end == seg->length) ? run_end :
+                      run_end - ((seg->address + run_end) & 1);
+
+            if ((cut_end <= cut_start) ||
+                    ((run_start != 0) && (run_end != seg->length) &&
+                     (cut_end - cut_start < ERASED_RUN_MIN_BYTES)))
+            {
+                continue;
+            }
+
+            if ((cut_start > keep_start) &&
+                    (Add_hex_image_data (&kept, seg->address + keep_start,
+                                         &seg->data[keep_start],
+                                         (unsigned int) (cut_start - keep_start)) != HEX_OK))
+            {
+                Free_hex_image (&kept);
+                return (HEX_BAD);
+            }
+
+            /* A cut after kept bytes starts in their sector unless it starts
+            on a boundary */
+            probe = cut_start;
+            if (run_start != 0)
+            {
+                probe = ((seg->address + cut_start + MIN_SECTOR_BYTES - 1) &
+                         ~ (unsigned long) (MIN_SECTOR_BYTES - 1)) - seg->address;
+            }
+            while (probe < cut_end)
+            {
+                probe_end = (cut_end - probe > 2) ? probe + 2 : cut_end;
+                if (Add_hex_image_data (&kept, seg->address + probe,
+                                        &seg->data[probe],
+                                        (unsigned int) (probe_end - probe)) != HEX_OK)
+                {
+                    Free_hex_image (&kept);
+                    return (HEX_BAD);
+                }
+                probe = ((seg->address + probe + MIN_SECTOR_BYTES) &
+                         ~ (unsigned long) (MIN_SECTOR_BYTES - 1)) - seg->address;
+            }
+            keep_start = cut_end;
+        }
+
+        if ((seg->length > keep_start) &&
+                (Add_hex_image_data (&kept, seg->address + keep_start,
+                                     &seg->data[keep_start],
+                                     (unsigned int) (seg->length - keep_start)) != HEX_OK))
+        {
+            Free_hex_image (&kept);
+            return (HEX_BAD);
+        }
+    }
+
+    *num_removed = image->num_data_bytes - kept.num_data_bytes;
+
+    Free_hex_image (image);
+    *image = kept;
+    return (HEX_OK);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Image_next_block
+*
+*  ABSTRACT:
+*     Takes the next download block from an image
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  image being downloaded
+*       position        struct image_position_t *   first byte of the block;
+*                                                   moved past it
+*       max_length      unsigned long               largest block
+*       block           struct download_block_t *   block returned
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       TRUE if a block was returned, FALSE at the end of the image
+*
+*  FUNCTIONAL DESCRIPTION:
+*     A block never crosses the end of a segment. With max_length
+*   MAX_BYTES_IN_DOWNLOAD_BLOCK and a position at the start of a segment
+*   the block is the whole segment; shorter blocks start at an even offset
+*   (max_length is even), so the words programmed are the same. At the end
+*   of a segment the position moves to the start of the next.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned char Image_next_block (const struct hex_image_t *image,
+                                struct image_position_t *position,
+                                unsigned long max_length,
+                                struct download_block_t *block)
+{
+    const struct image_segment_t *seg;
+
+    while ((position->segment < image->num_segments) &&
+            (position->offset >= image->segment[position->segment].length))
+    {
+        position->segment++;
+        position->offset = 0;
+    }
+
+    if (position->segment >= image->num_segments)
+    {
+        return (FALSE);
+    }
+
+    seg = &image->segment[position->segment];
+    block->start = *position;
+    block->address = seg->address + position->offset;
+    block->data = seg->data + position->offset;
+    block->length = seg->length - position->offset;
+    if (block->length > max_length)
+    {
+        block->length = max_length;
+    }
+
+    position->offset += block->length;
+    if (position->offset >= seg->length)
+    {
+        position->segment++;
+        position->offset = 0;
+    }
+    block->end = *position;
+
+    return (TRUE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Image_download_size
+*
+*  ABSTRACT:
+*     Number of bytes the Logic receives for the rest of an image
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  image being downloaded
+*       position        const struct image_position_t *  first byte sent
+*       max_length      unsigned long               largest block
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned long   total sent after 't': the 4 byte total itself and
+*                       6 header bytes plus the data of every block
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Equals "total_bytes" of the image for a whole download in segment
+*   sized blocks.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned long Image_download_size (const struct hex_image_t *image,
+                                   const struct image_position_t *position,
+                                   unsigned long max_length)
+{
+    struct image_position_t next;
+    struct download_block_t block;
+    unsigned long total;
+
+    next = *position;
+    total = 4;
+    while (Image_next_block (image, &next, max_length, &block) == TRUE)
+    {
+        total += 6 + block.length;
+    }
+
+    return (total);
+}
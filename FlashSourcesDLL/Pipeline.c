@@ -0,0 +1,930 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Pipeline.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : Get_logic_capabilities
+*               Download_image_pipelined
+*               Wait_for_block_ack
+*               Send_block
+*               Wait_for_end_ack
+*               Start_block_mode
+*               End_block_mode
+*               Use_smaller_blocks
+*
+*  Abstract   : Pipelined block download. The next block is transmitted
+*               while the Logic programs the previous one, so the serial
+*               link and the FLASH work in parallel instead of taking turns.
+*               In the verified mode every block carries a CRC and a block
+*               damaged on the link is sent again, and blocks may be
+*               packed (Pack_block) when the Logic can unpack them.
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Verified download ('x') with retransmission; resumes at a checkpoint
+*  17 Oct 2026
+*    Packed 'x' blocks
+*  17 Oct 2026
+*    Damaged blocks sent again from the one named by "$X"; smaller blocks
+*    when a block keeps failing
+*  17 Oct 2026
+*    Packing given up with the first smaller blocks
+**************************************************************************/
+
+#include "include.h"
+
+static unsigned long Send_block (unsigned char seq, unsigned long address,
+                                 const unsigned char *data, unsigned long length,
+                                 const unsigned long *table, unsigned char pack);
+static int Wait_for_end_ack (void);
+static int Start_block_mode (unsigned char command);
+static int End_block_mode (unsigned char seq, const unsigned long *table);
+static int Use_smaller_blocks (const struct hex_image_t *image,
+                               const struct image_position_t *position,
+                               unsigned char seq, const unsigned long *table,
+                               unsigned long *max_block,
+                               unsigned long *code_size);
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Get_logic_capabilities
+*
+*  ABSTRACT:
+*     Asks the third stage loader which optional features it supports
+*
+*  INPUTS:
+*
+*     Constants:
+*       CMD_COMPLETE
+*       CMD_UNKNOWN
+*       FLASH_SERIAL_PORT_TIMEOUT_MS
+*
+*     Procedure Parameters:
+*       capabilities    unsigned char *     CAP_xxx bits returned here
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       CMD_COMPLETE if the Logic answered, CMD_UNKNOWN otherwise
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Sends 'v'. A loader that knows the command answers "*V" followed by
+*   one byte of CAP_xxx bits. Loaders built before the command existed
+*   answer "*U" (unknown command); that is a valid answer meaning no
+*   optional features, so the download falls back to 'b' / 'p'.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+int Get_logic_capabilities (unsigned char *capabilities)
+{
+    struct echo_t logic_val;
+    unsigned char response[2];
+    unsigned char indata;
+    struct deadline_t deadline;
+
+    *capabilities = 0;
+
+    logic_val = Send_byte_wait_for_echo ('v', FLASH_SERIAL_PORT_TIMEOUT_MS);
+    if (logic_val.error_code != 0)
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    /* Skip anything ahead of the response marker */
+    Start_deadline (&deadline, FLASH_SERIAL_PORT_TIMEOUT_MS);
+    do
+    {
+        if (Read_byte_deadline (&indata, &deadline) == 0)
+        {
+            return (CMD_UNKNOWN);
+        }
+    }
+    while (indata != '*');
+
+    if (Read_byte_deadline (&response[0], &deadline) == 0)
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    if (response[0] == 'U')
+    {
+        return (CMD_COMPLETE);
+    }
+
+    if ((response[0] != 'V') || (Read_byte_deadline (&response[1], &deadline) == 0))
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    *capabilities = response[1];
+    return (CMD_COMPLETE);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Wait_for_block_ack
+*
+*  ABSTRACT:
+*     Waits for the "*P" / "$P" acknowledge of one pipelined block
+*
+*  INPUTS:
+*
+*     Constants:
+*       CMD_COMPLETE
+*       CMD_FAILED
+*       CMD_RESEND
+*       CMD_UNKNOWN
+*       PROGRAM_TIMEOUT_MS
+*
+*     Procedure Parameters:
+*       seq             unsigned char       sequence number expected
+*       resend_seq      unsigned char *     after "$X", the sequence number
+*                                           of the block the Logic expects
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       CMD_COMPLETE, CMD_FAILED ("$P"), CMD_RESEND ("$X", verified mode
+*       only) or CMD_UNKNOWN (timeout or the acknowledge was for another
+*       block)
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Acknowledges are 3 bytes: '*' or '$', 'P' and the sequence number of
+*   the block that was programmed. The Logic programs blocks in the order
+*   received, so the acknowledge must be for the oldest outstanding block.
+*   In the verified mode the Logic answers a damaged block with "$X" and
+*   the sequence number it expects next, which is returned so the caller
+*   can resend from that block.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     "$X" answer of the verified mode
+*  17 Oct 2026
+*     Sequence number of "$X" returned
+******************************************************************************/
+int Wait_for_block_ack (unsigned char seq, unsigned char *resend_seq)
+{
+    unsigned char indata;
+    unsigned char response[2];
+    struct deadline_t deadline;
+
+    Start_deadline (&deadline, PROGRAM_TIMEOUT_MS);
+    do
+    {
+        if (Read_byte_deadline (&indata, &deadline) == 0)
+        {
+            return (CMD_UNKNOWN);
+        }
+    }
+    while ((indata != '*') && (indata != '$'));
+
+    if (a_read (response, 2, FLASH_SERIAL_PORT_TIMEOUT_MS) != 2)
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    if ((indata == '$') && (response[0] == 'X'))
+    {
+        *resend_seq = response[1];
+        return (CMD_RESEND);
+    }
+
+    if ((response[0] != 'P') || (response[1] != seq))
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    return ((indata == '*') ? CMD_COMPLETE : CMD_FAILED);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Send_block
+*
+*  ABSTRACT:
+*     Writes one block of a pipelined or verified download
+*
+*  INPUTS:
+*
+*     Constants:
+*       COMPRESSED_BLOCK_BYTES
+*       PACKED_BLOCK_FLAG
+*
+*     Procedure Parameters:
+*       seq             unsigned char       sequence number of the block
+*       address         unsigned long       FLASH address
+*       data            const unsigned char *   block data
+*       length          unsigned long       number of data bytes; 0 for
+*                                           the block ending the download
+*       table           const unsigned long *   CRC table; NULL if the
+*                                           block carries no CRC ('w')
+*       pack            unsigned char       TRUE to pack the data if that
+*                                           makes it shorter ('x' only)
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned long   number of data bytes written, packed or not
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The block is the sequence number, 32 bit address, 16 bit size and
+*   the data. For 'x' the CRC-32 follows, MSB first: the Crc_32_block of
+*   the address, size and data, started at the sequence number.
+*
+*     A packed block has PACKED_BLOCK_FLAG in its size and the number of
+*   packed bytes instead of the data length; the CRC covers the bytes as
+*   written. A block that does not get shorter is written as it is. The
+*   packed bytes are kept on the stack so the boards of a gang can pack at
+*   the same time.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Packed blocks
+******************************************************************************/
+static unsigned long Send_block (unsigned char seq, unsigned long address,
+                                 const unsigned char *data, unsigned long length,
+                                 const unsigned long *table, unsigned char pack)
+{
+    unsigned char block_header[7];  /* sequence, address and size of a block */
+    unsigned char block_crc[4];
+    unsigned char packed[COMPRESSED_BLOCK_BYTES];
+    unsigned long size_field;       /* block size as sent */
+    unsigned long packed_length;
+    unsigned long crc;
+
+    size_field = length;
+    if ((pack == TRUE) && (length != 0))
+    {
+        packed_length = Pack_block (data, length, packed, length - 1);
+        if (packed_length != 0)
+        {
+            data = packed;
+            length = packed_length;
+            size_field = PACKED_BLOCK_FLAG | packed_length;
+        }
+    }
+
+    block_header[0] = seq;
+    Long_to_bytes (address, &block_header[1]);
+    block_header[5] = (unsigned char) (size_field >> 8);
+    block_header[6] = (unsigned char)size_field;
+    a_write (block_header, 7);
+    if (length != 0)
+    {
+        a_write (data, (int)length);
+    }
+
+    if (table != NULL)
+    {
+        crc = Crc_32_block (seq, &block_header[1], 6, table);
+        crc = Crc_32_block (crc, data, length, table);
+        Long_to_bytes (crc, block_crc);
+        a_write (block_crc, 4);
+    }
+
+    return (length);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Wait_for_end_ack
+*
+*  ABSTRACT:
+*     Waits for the answer to the empty block ending an 'x' download
+*
+*  INPUTS:
+*
+*     Constants:
+*       CMD_COMPLETE
+*       CMD_RESEND
+*       CMD_UNKNOWN
+*       PROGRAM_TIMEOUT_MS
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       CMD_COMPLETE ("*W"), CMD_RESEND ("$X") or CMD_UNKNOWN
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Unlike Wait_for_command_reponse the letter after the '*' or '$' must
+*   follow it directly, so a "$X" is not taken for a failed "*W".
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static int Wait_for_end_ack (void)
+{
+    unsigned char indata;
+    unsigned char response;
+    struct deadline_t deadline;
+
+    Start_deadline (&deadline, PROGRAM_TIMEOUT_MS);
+    do
+    {
+        if (Read_byte_deadline (&indata, &deadline) == 0)
+        {
+            return (CMD_UNKNOWN);
+        }
+    }
+    while ((indata != '*') && (indata != '$'));
+
+    if (Read_byte_deadline (&response, &deadline) == 0)
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    if ((indata == '*') && (response == 'W'))
+    {
+        return (CMD_COMPLETE);
+    }
+    if ((indata == '$') && (response == 'X'))
+    {
+        return (CMD_RESEND);
+    }
+    return (CMD_UNKNOWN);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Download_image_pipelined
+*
+*  ABSTRACT:
+*     Sends and programs every segment of the image using the 'w' or 'x'
+*     command
+*
+*  INPUTS:
+*
+*     Constants:
+*       PIPELINE_DEPTH
+*       MAX_BYTES_IN_DOWNLOAD_BLOCK
+*       VERIFIED_BLOCK_BYTES
+*       COMPRESSED_BLOCK_BYTES
+*       BLOCK_RETRY_LIMIT
+*       BLOCK_SHRINK_RETRIES
+*       MIN_VERIFIED_BLOCK_BYTES
+*       RESYNC_QUIET_MS
+*       DIGEST_POLYNOMIAL
+*       CMD_COMPLETE
+*       CMD_FAILED
+*       FLASH_SERIAL_PORT_TIMEOUT_MS
+*       PROGRAM_TIMEOUT_MS
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  parsed application
+*       progress        struct progress_t *         download percentage;
+*                                                   started with the total
+*                                                   bytes sent after 't'
+*       verified        unsigned char               TRUE to use 'x'
+*       compressed      unsigned char               TRUE to pack the 'x'
+*                                                   blocks
+*       checkpoint      struct checkpoint_t *       "done" is where the
+*                                                   download starts; saved
+*                                                   as blocks are
+*                                                   acknowledged
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           0 if successful; Flash_monitor_image error codes if
+*                     unsuccessful
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Must be called after the total byte count has been accepted ("*T").
+*   After 'w' every block is sent as a sequence number, 32 bit address,
+*   16 bit size and the data. Up to PIPELINE_DEPTH blocks are outstanding:
+*   the next block is written while the Logic programs the previous one,
+*   and a block is only counted as done when its "*P" + sequence number
+*   arrives. An empty block ends the mode and is answered with "*W". The
+*   download percentage is updated as blocks are acknowledged
+*   (Progress_update) and completed (Progress_end) once "*W" arrives.
+*
+*     With 'x' the segments are sent in blocks of VERIFIED_BLOCK_BYTES,
+*   each followed by its CRC (Send_block). When a block is answered with
+*   anything but its "*P" the blocks already written are let out and the
+*   input is drained for RESYNC_QUIET_MS, so the Logic gives up on a
+*   partly received block and waits for a sequence number. The first "$X"
+*   or "$P" for a block needs no drain: the Logic has read the whole block
+*   and is waiting for the next. "$X" names the block the Logic expects:
+*   the blocks ahead of it were programmed and only their "*P" was lost,
+*   so they are counted as done, and sending resumes at the named block
+*   (the Logic ignored the blocks written after it). Without "$X" sending
+*   resumes at the oldest block not acknowledged; if the Logic programmed
+*   it, it answers "*P" again without programming it twice.
+*
+*     The failures are counted per block. A block rejected with "$X"
+*   BLOCK_SHRINK_RETRIES times in a row ends the 'x' mode
+*   (Use_smaller_blocks); the total of the rest of the image in blocks
+*   half the size is sent after 't' and 'x' starts again, with sequence
+*   numbers from 0. A damaged bit then costs less to send again, and
+*   damage that recurs at the same place of each resend no longer hits
+*   the same block every time. Packing is given up at the first change
+*   (COMPRESSED_BLOCK_BYTES halved is VERIFIED_BLOCK_BYTES), so the rest
+*   goes as the plain verified blocks of a Logic without packing; a
+*   packed block answered "$P" (the Logic could not unpack it) counts as
+*   rejected too, and is sent plain instead of failing the download. A block failing BLOCK_RETRY_LIMIT times in
+*   a row at MIN_VERIFIED_BLOCK_BYTES ends the download. The empty block
+*   is only sent again when answered "$X".
+*
+*     Compressed, the segments are sent in blocks of COMPRESSED_BLOCK_BYTES,
+*   each packed on its own (Send_block) until blocks are made smaller, and
+*   the bytes saved are shown at the end unless other boards are being
+*   flashed at the same time.
+*
+*     The download starts at the place recorded in the checkpoint, which
+*   is not the start of the image when a download is resumed; sequence
+*   numbers count from the first block sent.
+*
+*     The time from writing a block to its "*P" goes to the benchmark
+*   report; it includes the wait behind the block ahead of it.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Block latencies recorded for the benchmark report
+*  17 Oct 2026
+*     Image is read only; no progress display in a gang
+*  17 Oct 2026
+*     Verified mode; starts at the checkpoint and saves it
+*  17 Oct 2026
+*     Packed blocks
+*  17 Oct 2026
+*     Percentage kept by Progress_update
+*  17 Oct 2026
+*     Resends from the block named by "$X"; smaller blocks after repeated
+*     failures
+*  17 Oct 2026
+*     Smaller blocks are not packed
+******************************************************************************/
+int Download_image_pipelined (const struct hex_image_t *image,
+                              struct progress_t *progress,
+                              unsigned char verified,
+                              unsigned char compressed,
+                              struct checkpoint_t *checkpoint)
+{
+    struct download_block_t outstanding[PIPELINE_DEPTH];   /* blocks sent and
+                                                              not acknowledged */
+    struct download_block_t *block;
+    struct image_position_t position;   /* first byte of the next block */
+    unsigned long table[256];       /* block CRC; verified mode */
+    unsigned long max_block;        /* largest block sent */
+    unsigned long first_max_block;  /* max_block before any failure */
+    unsigned long code_size;        /* total sent after 't' for the rest */
+    unsigned char command;
+    unsigned char more;             /* FALSE once the last block is sent */
+    unsigned char pack;             /* TRUE while blocks are packed */
+    unsigned char resend_seq;       /* block the Logic expects after "$X" */
+    unsigned int next_to_send;      /* number of the next block to transmit */
+    unsigned int next_to_ack;       /* number of the oldest unacknowledged block */
+    unsigned int retries;           /* failures of the oldest block in a row */
+    unsigned int blocks_resent;
+    unsigned long num_bytes_acked;  /* same units as progress->total */
+    unsigned long image_bytes_sent; /* data bytes of the blocks written */
+    unsigned long wire_bytes_sent;  /* the same after packing */
+    unsigned long sent_ms[PIPELINE_DEPTH];  /* when each outstanding block
+                                               was written */
+    int command_response;
+    int rc;
+
+    command = (verified == TRUE) ? 'x' : 'w';
+    rc = Start_block_mode (command);
+    if (rc != 0)
+    {
+        return (rc);
+    }
+
+    max_block = MAX_BYTES_IN_DOWNLOAD_BLOCK;
+    if (verified == TRUE)
+    {
+        max_block = (compressed == TRUE) ? COMPRESSED_BLOCK_BYTES :
+                    VERIFIED_BLOCK_BYTES;
+        Make_crc_table_32 (DIGEST_POLYNOMIAL, table);
+    }
+    else
+    {
+        compressed = FALSE;
+    }
+    first_max_block = max_block;
+    pack = compressed;
+
+    position = checkpoint->done;
+    more = TRUE;
+    next_to_send = 0;
+    next_to_ack = 0;
+    retries = 0;
+    blocks_resent = 0;
+    image_bytes_sent = 0;
+    wire_bytes_sent = 0;
+    num_bytes_acked = 4;
+
+    while (1)
+    {
+        /* Keep the pipeline full */
+        while ((more == TRUE) && (next_to_send - next_to_ack < PIPELINE_DEPTH))
+        {
+            block = &outstanding[next_to_send % PIPELINE_DEPTH];
+            more = Image_next_block (image, &position, max_block, block);
+            if (more == FALSE)
+            {
+                break;
+            }
+
+            wire_bytes_sent += Send_block ((unsigned char)next_to_send,
+                                           block->address, block->data,
+                                           block->length,
+                                           (verified == TRUE) ? table : NULL,
+                                           pack);
+            image_bytes_sent += block->length;
+            sent_ms[next_to_send % PIPELINE_DEPTH] = Ms_clock();
+
+            next_to_send++;
+        }
+
+        if (next_to_ack == next_to_send)
+        {
+            break;
+        }
+        block = &outstanding[next_to_ack % PIPELINE_DEPTH];
+
+        command_response = Wait_for_block_ack ((unsigned char)next_to_ack,
+                                               &resend_seq);
+
+        /* Blocks ahead of the one named by "$X" were programmed */
+        if ((command_response == CMD_RESEND) &&
+                ((unsigned char) (resend_seq - next_to_ack) <
+                 next_to_send - next_to_ack))
+        {
+            while ((unsigned char)next_to_ack != resend_seq)
+            {
+                Report_op (OP_PIPELINED_BLOCK, block->length,
+                           Ms_clock() - sent_ms[next_to_ack % PIPELINE_DEPTH]);
+                num_bytes_acked += 6 + block->length;
+                Save_checkpoint (checkpoint, &block->end);
+                next_to_ack++;
+                retries = 0;
+                block = &outstanding[next_to_ack % PIPELINE_DEPTH];
+            }
+            Progress_update (progress, num_bytes_acked);
+        }
+
+        if ((command_response != CMD_COMPLETE) && (verified == TRUE) &&
+                (retries < BLOCK_RETRY_LIMIT))
+        {
+            /* Send again from the block the Logic expects. After a first
+            "$X" or "$P" the Logic is reading the next block; otherwise it
+            may be inside a block whose size was damaged, and is
+            resynchronized */
+            if (((command_response != CMD_RESEND) &&
+                    (command_response != CMD_FAILED)) || (retries != 0))
+            {
+                a_flush();
+                Drain_input (RESYNC_QUIET_MS);
+            }
+            retries++;
+            Report_op (OP_RETRANSMIT, block->length,
+                       Ms_clock() - sent_ms[next_to_ack % PIPELINE_DEPTH]);
+            position = block->start;
+            more = TRUE;
+
+            /* A packed block the Logic could not unpack is rejected with
+            "$P" */
+            if (((command_response == CMD_RESEND) ||
+                    ((command_response == CMD_FAILED) && (pack == TRUE))) &&
+                    (retries >= BLOCK_SHRINK_RETRIES) &&
+                    (max_block > MIN_VERIFIED_BLOCK_BYTES))
+            {
+                rc = Use_smaller_blocks (image, &position,
+                                         (unsigned char)next_to_ack, table,
+                                         &max_block, &code_size);
+                if (rc != 0)
+                {
+                    return (rc);
+                }
+
+                /* The rest has more block headers; the percentage goes on
+                from the bytes already programmed */
+                progress->total = num_bytes_acked + code_size - 4;
+                pack = FALSE;
+                next_to_ack = 0;
+                retries = 0;
+            }
+            else
+            {
+                blocks_resent += next_to_send - next_to_ack;
+            }
+            next_to_send = next_to_ack;
+            continue;
+        }
+
+        if (command_response != CMD_COMPLETE)
+        {
+            if (command_response == CMD_FAILED)
+            {
+                printf ("\n**** Command failed: '$P' received for block %u \n",
+                        next_to_ack);
+                return (12);
+            }
+            else if (verified == TRUE)
+            {
+                printf ("\n**** Block %u not received intact after %u tries \n",
+                        next_to_ack, retries + 1);
+                return (26);
+            }
+            else
+            {
+                printf ("\n**** Timed out waiting for target response: '*P' block %u \n",
+                        next_to_ack);
+                return (12);
+            }
+        }
+
+        Report_op (OP_PIPELINED_BLOCK, block->length,
+                   Ms_clock() - sent_ms[next_to_ack % PIPELINE_DEPTH]);
+        num_bytes_acked += 6 + block->length;
+        Save_checkpoint (checkpoint, &block->end);
+        next_to_ack++;
+        retries = 0;
+        Progress_update (progress, num_bytes_acked);
+    }
+
+    /* Empty block ends the pipelined download */
+    rc = End_block_mode ((unsigned char)next_to_send,
+                         (verified == TRUE) ? table : NULL);
+    if (rc != 0)
+    {
+        return (rc);
+    }
+    Progress_end (progress);
+
+    if ((blocks_resent != 0) && (Current_session()->gang == FALSE))
+    {
+        printf ("\n     Blocks sent again: %u ", blocks_resent);
+    }
+
+    if ((max_block != first_max_block) && (Current_session()->gang == FALSE))
+    {
+        printf ("\n     Blocks made smaller: %lu bytes from %lu ", max_block,
+                first_max_block);
+    }
+
+    if ((compressed == TRUE) && (image_bytes_sent != 0) &&
+            (Current_session()->gang == FALSE))
+    {
+        printf ("\n     Packed: %lu bytes sent for %lu (%lu%%) ", wire_bytes_sent,
+                image_bytes_sent, (wire_bytes_sent * 100) / image_bytes_sent);
+    }
+
+    return (0);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Start_block_mode
+*
+*  ABSTRACT:
+*     Sends 'w' or 'x' and checks the echo
+*
+*  INPUTS:
+*
+*     Constants:
+*       FLASH_SERIAL_PORT_TIMEOUT_MS
+*
+*     Procedure Parameters:
+*       command         unsigned char       'w' or 'x'
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           0 if echoed; 8 otherwise
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The Logic waits for the first block as soon as it has echoed.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created from Download_image_pipelined
+* Revised :
+******************************************************************************/
+static int Start_block_mode (unsigned char command)
+{
+    struct echo_t logic_val;
+
+    logic_val = Send_byte_wait_for_echo (command, FLASH_SERIAL_PORT_TIMEOUT_MS);
+
+    if (logic_val.error_code == ECHO_TIMEOUT)
+    {
+        printf ("\n**** Lost Communication with target: did not receive '%c' ",
+                command);
+        return (8);
+    }
+    else if (logic_val.error_code == INVALID_ECHO)
+    {
+        printf ("\n**** Received invalid echo from target: did not receive '%c' ",
+                command);
+        return (8);
+    }
+
+    return (0);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: End_block_mode
+*
+*  ABSTRACT:
+*     Sends the empty block ending a 'w' or 'x' download
+*
+*  INPUTS:
+*
+*     Constants:
+*       BLOCK_RETRY_LIMIT
+*       RESYNC_QUIET_MS
+*       PROGRAM_TIMEOUT_MS
+*
+*     Procedure Parameters:
+*       seq             unsigned char       sequence number the Logic
+*                                           expects
+*       table           const unsigned long *   CRC table; NULL for 'w'
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           0 once "*W" is received; 10 otherwise
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The empty block is only sent again when the Logic asks for it with
+*   "$X": if the "*W" was lost the Logic is reading commands again.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created from Download_image_pipelined
+* Revised :
+******************************************************************************/
+static int End_block_mode (unsigned char seq, const unsigned long *table)
+{
+    unsigned int tries;
+    int command_response;
+
+    tries = 0;
+    do
+    {
+        Send_block (seq, 0, NULL, 0, table, FALSE);
+
+        if (table != NULL)
+        {
+            command_response = Wait_for_end_ack();
+        }
+        else
+        {
+            command_response = Wait_for_command_reponse ("*W", PROGRAM_TIMEOUT_MS);
+        }
+        if (command_response == CMD_RESEND)
+        {
+            a_flush();
+            Drain_input (RESYNC_QUIET_MS);
+        }
+    }
+    while ((command_response == CMD_RESEND) && (++tries <= BLOCK_RETRY_LIMIT));
+
+    if (command_response != CMD_COMPLETE)
+    {
+        printf ("\n**** Timed out waiting for target response: '*W' \n");
+        return (10);
+    }
+
+    return (0);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Use_smaller_blocks
+*
+*  ABSTRACT:
+*     Starts the 'x' download again with blocks half the size
+*
+*  INPUTS:
+*
+*     Constants:
+*       MIN_VERIFIED_BLOCK_BYTES
+*
+*     Procedure Parameters:
+*       image           const struct hex_image_t *  image being downloaded
+*       position        const struct image_position_t *  first byte not
+*                                           programmed
+*       seq             unsigned char       sequence number the Logic
+*                                           expects
+*       table           const unsigned long *   block CRC table
+*       max_block       unsigned long *     largest block; halved
+*       code_size       unsigned long *     total sent after 't'
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           0 if the Logic waits for block 0 of the rest;
+*                     Send_download_size or End_block_mode error codes
+*                     otherwise
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The Logic counts 6 header bytes per block off the 't' total, so the
+*   total cannot stay the same when blocks get smaller. The 'x' mode is
+*   ended with the empty block and the total of the rest, as for a resumed
+*   download, is sent after 't'. 'z' still checks that the rest arrived;
+*   the blocks before it were each checked by their CRC.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static int Use_smaller_blocks (const struct hex_image_t *image,
+                               const struct image_position_t *position,
+                               unsigned char seq, const unsigned long *table,
+                               unsigned long *max_block,
+                               unsigned long *code_size)
+{
+    int rc;
+
+    rc = End_block_mode (seq, table);
+    if (rc != 0)
+    {
+        return (rc);
+    }
+
+    *max_block /= 2;
+    if (*max_block < MIN_VERIFIED_BLOCK_BYTES)
+    {
+        *max_block = MIN_VERIFIED_BLOCK_BYTES;
+    }
+    *code_size = Image_download_size (image, position, *max_block);
+
+    rc = Send_download_size (*code_size);
+    if (rc != 0)
+    {
+        return (rc);
+    }
+
+    return (Start_block_mode ('x'));
+}
@@ -0,0 +1,962 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Report.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : Report_init
+*               Report_start
+*               Report_end
+*               Report_add
+*               Report_op
+*               Report_flash
+*               Report_link
+*               Report_finish
+*               Report_write
+*
+*  Abstract   : Benchmark report. Every phase of a FLASH session (boot
+*               strap load, identification, erase, download, CRC ...) is
+*               timed on the millisecond clock together with the serial
+*               bytes it moved, and the blocks and sectors are timed one at
+*               a time into latency histograms. "report=<file>" on the
+*               command line writes the result as JSON, or as CSV rows when
+*               the file name ends in ".csv".
+*                 The measurements belong to the session of the calling
+*               thread (Current_session), so every board of a gang has its
+*               own report.
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Measurements kept per session; COM port in the report
+*  17 Oct 2026
+*    Blocks sent again by the verified download
+**************************************************************************/
+
+#include "include.h"
+
+/* Names used in the report files; same order as PHASE_xxx */
+static const char *phase_names[NUM_REPORT_PHASES] =
+{
+    "hex_parse",
+    "bsl_connect",
+    "stage1",
+    "stage2",
+    "stage3",
+    "connect",
+    "flash_id",
+    "capabilities",
+    "baud_switch",
+    "sector_digest",
+    "erase",
+    "download",
+    "crc",
+    "end_session"
+};
+
+/* Same order as OP_xxx */
+static const char *op_names[NUM_REPORT_OPS] =
+{
+    "block_transfer",
+    "block_program",
+    "pipelined_block",
+    "sector_erase",
+    "retransmit"
+};
+
+static void Write_json (FILE *fp, const char *hex_name, int result);
+static void Write_csv (FILE *fp, const char *hex_name, int result);
+static void Write_csv_session (FILE *fp, const char *hex_name, int result);
+static void Port_report_name (const char *name, int com_port, char *port_name);
+static void Write_quoted (FILE *fp, const char *s, char escape);
+static unsigned char Is_csv_name (const char *name);
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Report_init
+*
+*  ABSTRACT:
+*     Clears the measurements and starts the session clock
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Called once at the start of every session; the DLL stays loaded
+*   between FlashMain calls, so nothing may be left from the previous one.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Report of the current session
+******************************************************************************/
+void Report_init (void)
+{
+    struct report_t *report = &Current_session()->report;
+
+    memset (report, 0, sizeof (struct report_t));
+    report->start_ms = Ms_clock();
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Report_start
+*
+*  ABSTRACT:
+*     Marks the start of a phase
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       phase           int         PHASE_xxx
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Records the clock and the serial byte counters. A phase may be run
+*   more than once (one erase per changed sector); each run is added to
+*   the totals by Report_end.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Report_start (int phase)
+{
+    struct phase_stats_t *p = &Current_session()->report.phase[phase];
+
+    p->start_ms = Ms_clock();
+    a_byte_counts (&p->start_tx, &p->start_rx);
+    p->running = TRUE;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Report_end
+*
+*  ABSTRACT:
+*     Marks the end of a phase
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       phase           int             PHASE_xxx
+*       data_bytes      unsigned long   application, stage or FLASH bytes
+*                                       the phase handled; 0 if the phase
+*                                       has no payload
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Adds the time and the serial bytes since Report_start to the phase.
+*   Ignored if the phase is not running.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Report_end (int phase, unsigned long data_bytes)
+{
+    struct phase_stats_t *p = &Current_session()->report.phase[phase];
+    unsigned long tx_bytes;
+    unsigned long rx_bytes;
+
+    if (p->running == FALSE)
+    {
+        return;
+    }
+
+    a_byte_counts (&tx_bytes, &rx_bytes);
+    p->ms += Ms_clock() - p->start_ms;
+    p->tx_bytes += tx_bytes - p->start_tx;
+    p->rx_bytes += rx_bytes - p->start_rx;
+    p->data_bytes += data_bytes;
+    p->count++;
+    p->running = FALSE;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Report_add
+*
+*  ABSTRACT:
+*     Adds a phase measured outside the session
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       phase           int             PHASE_xxx
+*       ms              unsigned long   duration of the phase
+*       data_bytes      unsigned long   bytes the phase handled
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The application is parsed once for all the boards of a gang, before
+*   their sessions start; its time is added to each of their reports. The
+*   phase moved no serial bytes.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Report_add (int phase, unsigned long ms, unsigned long data_bytes)
+{
+    struct phase_stats_t *p = &Current_session()->report.phase[phase];
+
+    p->ms += ms;
+    p->data_bytes += data_bytes;
+    p->count++;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Report_op
+*
+*  ABSTRACT:
+*     Adds the latency of one block or sector operation
+*
+*  INPUTS:
+*
+*     Constants:
+*       LATENCY_BUCKETS
+*
+*     Procedure Parameters:
+*       op              int             OP_xxx
+*       num_bytes       unsigned long   data bytes of the block or sector
+*       ms              unsigned long   time from command to acknowledge
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Bucket 0 counts operations under 1 ms; bucket n (1 ... 16) counts
+*   those from 2^(n-1) up to 2^n ms and the last bucket everything longer.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Report_op (int op, unsigned long num_bytes, unsigned long ms)
+{
+    struct op_stats_t *o = &Current_session()->report.op[op];
+    unsigned int bucket;
+
+    if ((o->count == 0) || (ms < o->min_ms))
+    {
+        o->min_ms = ms;
+    }
+    if (ms > o->max_ms)
+    {
+        o->max_ms = ms;
+    }
+    o->count++;
+    o->bytes += num_bytes;
+    o->total_ms += ms;
+
+    bucket = 0;
+    while ((bucket < LATENCY_BUCKETS - 1) && (ms >= (1UL << bucket)))
+    {
+        bucket++;
+    }
+    o->histogram[bucket]++;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Report_flash
+*
+*  ABSTRACT:
+*     Records the FLASH part reported by the Logic
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       flash_name      const char *    Flash_type_name(); must stay valid
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The name goes into every report so slow parts can be picked out.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Report_flash (const char *flash_name)
+{
+    Current_session()->report.flash_name = flash_name;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Report_link
+*
+*  ABSTRACT:
+*     Records the baud rates of the session
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       boot_baud       long        rate the loaders were sent at
+*       download_baud   long        rate of the application download
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Called when the port is opened and again after a baud rate switch.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Report_link (long boot_baud, long download_baud)
+{
+    struct report_t *report = &Current_session()->report;
+
+    report->boot_baud = boot_baud;
+    report->download_baud = download_baud;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Report_finish
+*
+*  ABSTRACT:
+*     Stops the session clock
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     A phase still running ended with the failure that stopped the
+*   session; it is closed here so the time up to the failure is reported.
+*   Called when the session ends, since the reports of a gang are written
+*   only once every board is done.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created from Report_write
+* Revised :
+******************************************************************************/
+void Report_finish (void)
+{
+    struct report_t *report = &Current_session()->report;
+    int i;
+
+    for (i = 0; i < NUM_REPORT_PHASES; i++)
+    {
+        Report_end (i, 0);
+    }
+    report->total_ms = Ms_clock() - report->start_ms;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Report_write
+*
+*  ABSTRACT:
+*     Writes the benchmark report file
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       name            const char *    "report=" file name
+*       hex_name        const char *    application Intel Hex file
+*       result          int             FlashMain return code
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           0 if written, 1 if the file could not be opened
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Writes the report of the current session, which Report_finish has
+*   stopped.
+*     A ".csv" file gets one row per phase and per operation, appended so
+*   that one file collects the sessions of many boards; the column names
+*   are written when the file is new. Any other name is overwritten with a
+*   JSON object; when a gang is flashed every board gets its own, with
+*   "_COM<n>" added to the name before the extension.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Session of the calling thread; one JSON file per board of a gang
+******************************************************************************/
+int Report_write (const char *name, const char *hex_name, int result)
+{
+    struct flash_session_t *session = Current_session();
+    char port_name[FILENAME_MAX];
+    FILE *fp;
+    unsigned char csv;
+    unsigned char new_file;
+    int i;
+
+    csv = Is_csv_name (name);
+    if ((csv == FALSE) && (session->gang == TRUE))
+    {
+        Port_report_name (name, session->com_port, port_name);
+        name = port_name;
+    }
+    new_file = TRUE;
+    if (csv == TRUE)
+    {
+        fp = fopen (name, "r");
+        if (fp != NULL)
+        {
+            new_file = FALSE;
+            fclose (fp);
+        }
+        fp = fopen (name, "a");
+    }
+    else
+    {
+        fp = fopen (name, "w");
+    }
+
+    if (fp == NULL)
+    {
+        printf ("\n** Unable to open report file %s \n", name);
+        return (1);
+    }
+
+    if (csv == TRUE)
+    {
+        if (new_file == TRUE)
+        {
+            fprintf (fp, "file,port,flash,boot_baud,download_baud,result,record,name,"
+                     "count,ms,data_bytes,tx_bytes,rx_bytes,bytes_per_s,"
+                     "min_ms,max_ms");
+            for (i = 0; i < LATENCY_BUCKETS - 1; i++)
+            {
+                fprintf (fp, ",lt%lums", 1UL << i);
+            }
+            fprintf (fp, ",ge%lums\n", 1UL << (LATENCY_BUCKETS - 2));
+        }
+        Write_csv (fp, hex_name, result);
+    }
+    else
+    {
+        Write_json (fp, hex_name, result);
+    }
+
+    fclose (fp);
+    return (0);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Write_json
+*
+*  ABSTRACT:
+*     Writes the report as one JSON object
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       fp              FILE *          open for writing
+*       hex_name        const char *    application Intel Hex file
+*       result          int             FlashMain return code
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Phases and operations are objects keyed by name; all of them are
+*   written, with a count of 0 if they did not run, so every report has the
+*   same shape. Rates are null when no time was measured or the phase has
+*   no payload.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Write_json (FILE *fp, const char *hex_name, int result)
+{
+    struct flash_session_t *session = Current_session();
+    struct report_t *report = &session->report;
+    struct phase_stats_t *p;
+    struct op_stats_t *o;
+    unsigned long total_tx;
+    unsigned long total_rx;
+    int i;
+    int j;
+
+    a_byte_counts (&total_tx, &total_rx);
+
+    fprintf (fp, "{\n  \"file\": ");
+    Write_quoted (fp, hex_name, '\\');
+    fprintf (fp, ",\n  \"port\": %d", session->com_port);
+    fprintf (fp, ",\n  \"flash\": ");
+    if (report->flash_name != NULL)
+    {
+        Write_quoted (fp, report->flash_name, '\\');
+    }
+    else
+    {
+        fprintf (fp, "null");
+    }
+    fprintf (fp, ",\n  \"boot_baud\": %ld,\n  \"download_baud\": %ld,\n",
+             report->boot_baud, report->download_baud);
+    fprintf (fp, "  \"result\": %d,\n  \"total_ms\": %lu,\n", result,
+             report->total_ms);
+    fprintf (fp, "  \"tx_bytes\": %lu,\n  \"rx_bytes\": %lu,\n", total_tx,
+             total_rx);
+
+    fprintf (fp, "  \"phases\": {\n");
+    for (i = 0; i < NUM_REPORT_PHASES; i++)
+    {
+        p = &report->phase[i];
+        fprintf (fp, "    \"%s\": {\"count\": %lu, \"ms\": %lu, "
+                 "\"data_bytes\": %lu, \"tx_bytes\": %lu, \"rx_bytes\": %lu, ",
+                 phase_names[i], p->count, p->ms, p->data_bytes, p->tx_bytes,
+                 p->rx_bytes);
+        if ((p->ms != 0) && (p->data_bytes != 0))
+        {
+            fprintf (fp, "\"bytes_per_s\": %.0f, ",
+                     p->data_bytes * 1000.0 / p->ms);
+        }
+        else
+        {
+            fprintf (fp, "\"bytes_per_s\": null, ");
+        }
+        if (p->ms != 0)
+        {
+            fprintf (fp, "\"line_bytes_per_s\": %.0f}",
+                     (p->tx_bytes + p->rx_bytes) * 1000.0 / p->ms);
+        }
+        else
+        {
+            fprintf (fp, "\"line_bytes_per_s\": null}");
+        }
+        fprintf (fp, (i < NUM_REPORT_PHASES - 1) ? ",\n" : "\n");
+    }
+    fprintf (fp, "  },\n");
+
+    fprintf (fp, "  \"histogram_upper_ms\": [");
+    for (j = 0; j < LATENCY_BUCKETS - 1; j++)
+    {
+        fprintf (fp, "%lu, ", 1UL << j);
+    }
+    fprintf (fp, "null],\n");
+
+    fprintf (fp, "  \"operations\": {\n");
+    for (i = 0; i < NUM_REPORT_OPS; i++)
+    {
+        o = &report->op[i];
+        fprintf (fp, "    \"%s\": {\"count\": %lu, \"bytes\": %lu, "
+                 "\"total_ms\": %lu, \"min_ms\": %lu, \"max_ms\": %lu, ",
+                 op_names[i], o->count, o->bytes, o->total_ms, o->min_ms,
+                 o->max_ms);
+        if (o->total_ms != 0)
+        {
+            fprintf (fp, "\"mean_ms\": %.1f, \"bytes_per_s\": %.0f, ",
+                     (double)o->total_ms / o->count,
+                     o->bytes * 1000.0 / o->total_ms);
+        }
+        else
+        {
+            fprintf (fp, "\"mean_ms\": %s, \"bytes_per_s\": null, ",
+                     (o->count != 0) ? "0.0" : "null");
+        }
+        fprintf (fp, "\"histogram\": [");
+        for (j = 0; j < LATENCY_BUCKETS; j++)
+        {
+            fprintf (fp, (j < LATENCY_BUCKETS - 1) ? "%lu, " : "%lu]}",
+                     o->histogram[j]);
+        }
+        fprintf (fp, (i < NUM_REPORT_OPS - 1) ? ",\n" : "\n");
+    }
+    fprintf (fp, "  }\n}\n");
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Write_csv
+*
+*  ABSTRACT:
+*     Appends the report as CSV rows
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       fp              FILE *          open for appending
+*       hex_name        const char *    application Intel Hex file
+*       result          int             FlashMain return code
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Every row starts with the session columns (file, FLASH, baud rates,
+*   result) so rows of many sessions can be filtered and pivoted directly.
+*   A "total" row is followed by one "phase" row per phase and one "op"
+*   row per operation; columns that do not apply to a record are empty.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Write_csv (FILE *fp, const char *hex_name, int result)
+{
+    struct report_t *report = &Current_session()->report;
+    struct phase_stats_t *p;
+    struct op_stats_t *o;
+    unsigned long total_tx;
+    unsigned long total_rx;
+    int i;
+    int j;
+
+    a_byte_counts (&total_tx, &total_rx);
+
+    Write_csv_session (fp, hex_name, result);
+    fprintf (fp, "total,session,1,%lu,,%lu,%lu,,,", report->total_ms,
+             total_tx, total_rx);
+    for (j = 0; j < LATENCY_BUCKETS; j++)
+    {
+        fprintf (fp, ",");
+    }
+    fprintf (fp, "\n");
+
+    for (i = 0; i < NUM_REPORT_PHASES; i++)
+    {
+        p = &report->phase[i];
+        Write_csv_session (fp, hex_name, result);
+        fprintf (fp, "phase,%s,%lu,%lu,%lu,%lu,%lu,", phase_names[i], p->count,
+                 p->ms, p->data_bytes, p->tx_bytes, p->rx_bytes);
+        if ((p->ms != 0) && (p->data_bytes != 0))
+        {
+            fprintf (fp, "%.0f", p->data_bytes * 1000.0 / p->ms);
+        }
+        fprintf (fp, ",,");
+        for (j = 0; j < LATENCY_BUCKETS; j++)
+        {
+            fprintf (fp, ",");
+        }
+        fprintf (fp, "\n");
+    }
+
+    for (i = 0; i < NUM_REPORT_OPS; i++)
+    {
+        o = &report->op[i];
+        Write_csv_session (fp, hex_name, result);
+        fprintf (fp, "op,%s,%lu,%lu,%lu,,,", op_names[i], o->count,
+                 o->total_ms, o->bytes);
+        if (o->total_ms != 0)
+        {
+            fprintf (fp, "%.0f", o->bytes * 1000.0 / o->total_ms);
+        }
+        fprintf (fp, ",%lu,%lu", o->min_ms, o->max_ms);
+        for (j = 0; j < LATENCY_BUCKETS; j++)
+        {
+            fprintf (fp, ",%lu", o->histogram[j]);
+        }
+        fprintf (fp, "\n");
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Write_csv_session
+*
+*  ABSTRACT:
+*     Writes the session columns that start every CSV row
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       fp              FILE *          open for appending
+*       hex_name        const char *    application Intel Hex file
+*       result          int             FlashMain return code
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     File, COM port, FLASH, boot and download baud rates and result, each
+*   followed by a comma.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     COM port column
+******************************************************************************/
+static void Write_csv_session (FILE *fp, const char *hex_name, int result)
+{
+    struct flash_session_t *session = Current_session();
+    struct report_t *report = &session->report;
+
+    Write_quoted (fp, hex_name, '"');
+    fprintf (fp, ",%d,", session->com_port);
+    Write_quoted (fp, (report->flash_name != NULL) ? report->flash_name : "", '"');
+    fprintf (fp, ",%ld,%ld,%d,", report->boot_baud, report->download_baud,
+             result);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Port_report_name
+*
+*  ABSTRACT:
+*     Name of the JSON report of one board of a gang
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       name            const char *    "report=" file name
+*       com_port        int             port of the board
+*       port_name       char *          FILENAME_MAX characters
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     "run.json" becomes "run_COM3.json"; "_COM3" is appended to a name
+*   without an extension. A '.' in a directory name is not an extension.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Port_report_name (const char *name, int com_port, char *port_name)
+{
+    const char *ext = strrchr (name, '.');
+    size_t base_len;
+
+    if ((ext == NULL) || (strchr (ext, '/') != NULL) ||
+            (strchr (ext, '\\') != NULL))
+    {
+        ext = name + strlen (name);
+    }
+    base_len = ext - name;
+    if (base_len + strlen (ext) + 8 > FILENAME_MAX)
+    {
+        base_len = FILENAME_MAX - strlen (ext) - 8;
+    }
+    sprintf (port_name, "%.*s_COM%d%s", (int)base_len, name, com_port, ext);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Write_quoted
+*
+*  ABSTRACT:
+*     Writes a string in double quotes
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       fp              FILE *
+*       s               const char *
+*       escape          char            '\\' for JSON, '"' for CSV
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Quotes inside the string are preceded by "escape"; with JSON
+*   backslashes (Windows paths) are escaped too.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Write_quoted (FILE *fp, const char *s, char escape)
+{
+    fputc ('"', fp);
+    while (*s != '\0')
+    {
+        if ((*s == '"') || ((*s == '\\') && (escape == '\\')))
+        {
+            fputc (escape, fp);
+        }
+        fputc (*s, fp);
+        s++;
+    }
+    fputc ('"', fp);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Is_csv_name
+*
+*  ABSTRACT:
+*     TRUE if a file name ends in ".csv" (any case)
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       name            const char *
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned char   TRUE or FALSE
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static unsigned char Is_csv_name (const char *name)
+{
+    const char *ext = ".csv";
+    size_t len = strlen (name);
+    size_t i;
+
+    if (len < 4)
+    {
+        return (FALSE);
+    }
+    name += len - 4;
+    for (i = 0; i < 4; i++)
+    {
+        if ((name[i] | 0x20) != ext[i])
+        {
+            return (FALSE);
+        }
+    }
+    return (TRUE);
+}
@@ -18,35 +18,250 @@
 *  01 Apr 2000 D.Smail
 *    Created
 * Revised:
+*  17 Oct 2026
+*    Added buffer level write, read and flush callbacks
+*  17 Oct 2026
+*    Added the baud rate callback
+*  17 Oct 2026
+*    a_read() character fallback bounded by the millisecond clock
+*  17 Oct 2026
+*    Bytes written and read are counted for the benchmark report
+*  17 Oct 2026
+*    Callbacks registered per COM port; a_*() use the transport of the
+*    session running on the calling thread
 **************************************************************************/
 
+#include "include.h"
 
-typedef void (__stdcall *TxCharFnPtr) (unsigned char tx);
-typedef int (__stdcall *RxCharFnPtr) (void);
+/* Receive timeout (msecs) of a single call to the .NET character callback */
+#define RX_CHAR_POLL_MS     20
 
-static TxCharFnPtr txCharPtr;
-static RxCharFnPtr rxCharPtr;
+/* Callbacks set by the Set*Callback exports; used by every port that has
+no callbacks of its own */
+static struct transport_t default_transport;
+
+/* Callbacks set by SetPortCallbacks, indexed by COM port */
+static struct transport_t port_transport[MAX_COM_PORT + 1];
+static char port_registered[MAX_COM_PORT + 1];
+
+// Allow DLL to open the serial port through .NET
+__declspec (dllexport) void __stdcall SetInitComCallback (InitComFnPtr func)
+{
+    default_transport.init_com = func;
+}
 
 // Allow DLL to call .NET functions though a function pointer
 __declspec (dllexport) void SetTxCharCallback (TxCharFnPtr func)
 {
-    txCharPtr = func;
+    default_transport.tx_char = func;
 }
 
 // Allow DLL to call .NET functions though a function pointer
 __declspec (dllexport) void SetRxCharCallback (RxCharFnPtr func)
 {
-    rxCharPtr = func;
+    default_transport.rx_char = func;
+}
+
+// Allow DLL to hand whole buffers to .NET; optional, a_write() falls back to
+// the character callback when not set
+__declspec (dllexport) void SetTxBufferCallback (TxBufferFnPtr func)
+{
+    default_transport.tx_buffer = func;
+}
+
+// Allow DLL to read whole buffers from .NET; optional, a_read() falls back to
+// the character callback when not set
+__declspec (dllexport) void SetRxBufferCallback (RxBufferFnPtr func)
+{
+    default_transport.rx_buffer = func;
+}
+
+// Allow DLL to wait until .NET has transmitted everything written
+__declspec (dllexport) void SetFlushCallback (FlushFnPtr func)
+{
+    default_transport.flush = func;
+}
+
+// Allow DLL to change the baud rate of the open serial port
+__declspec (dllexport) void SetBaudCallback (SetBaudFnPtr func)
+{
+    default_transport.set_baud = func;
+}
+
+// Register the callbacks of one COM port for gang programming; the buffer
+// callbacks are required, they must be safe to call from a worker thread
+// and only ever touch "comPort"
+__declspec (dllexport) void SetPortCallbacks (int comPort,
+        InitComFnPtr initCom, TxBufferFnPtr txBuffer, RxBufferFnPtr rxBuffer,
+        FlushFnPtr flush, SetBaudFnPtr setBaud)
+{
+    if ((comPort < 1) || (comPort > MAX_COM_PORT))
+    {
+        return;
+    }
+    memset (&port_transport[comPort], 0, sizeof (struct transport_t));
+    port_transport[comPort].init_com = initCom;
+    port_transport[comPort].tx_buffer = txBuffer;
+    port_transport[comPort].rx_buffer = rxBuffer;
+    port_transport[comPort].flush = flush;
+    port_transport[comPort].set_baud = setBaud;
+    port_registered[comPort] = TRUE;
+}
+
+// Callbacks of "com_port": its own if SetPortCallbacks was called for it,
+// otherwise the default ones
+void Port_transport (int com_port, struct transport_t *transport)
+{
+    if ((com_port >= 1) && (com_port <= MAX_COM_PORT) &&
+            port_registered[com_port])
+    {
+        *transport = port_transport[com_port];
+    }
+    else
+    {
+        *transport = default_transport;
+    }
+}
+
+// Open the port of the current session at "baud"
+void a_init_com (long baud)
+{
+    struct flash_session_t *session = Current_session();
+
+    session->transport.init_com ((unsigned int)session->com_port,
+                                 (unsigned int)baud);
 }
 
 // Wrap C function around a function pointer to .NET
 void a_putc (unsigned char tx)
 {
-    txCharPtr (tx);
+    struct flash_session_t *session = Current_session();
+
+    session->tx_bytes++;
+    if (session->transport.tx_buffer != 0)
+    {
+        session->transport.tx_buffer (&tx, 1);
+    }
+    else
+    {
+        session->transport.tx_char (tx);
+    }
 }
 
-// Wrap C function around a function pointer to .NET
+// Wrap C function around a function pointer to .NET; -1 if no character
+// arrived within RX_CHAR_POLL_MS
 int a_getc (void)
 {
-    return rxCharPtr();
+    struct flash_session_t *session = Current_session();
+    unsigned char rx;
+    int rx_char;
+
+    if (session->transport.rx_buffer != 0)
+    {
+        if (session->transport.rx_buffer (&rx, 1, RX_CHAR_POLL_MS) == 1)
+        {
+            session->rx_bytes++;
+            return rx;
+        }
+        return -1;
+    }
+    rx_char = session->transport.rx_char();
+    if (rx_char != -1)
+    {
+        session->rx_bytes++;
+    }
+    return rx_char;
+}
+
+// Transmit "len" bytes with a single transition into .NET
+void a_write (const unsigned char *buf, int len)
+{
+    struct flash_session_t *session = Current_session();
+    int i;
+
+    session->tx_bytes += len;
+    if (session->transport.tx_buffer != 0)
+    {
+        session->transport.tx_buffer (buf, len);
+    }
+    else
+    {
+        for (i = 0; i < len; i++)
+        {
+            session->transport.tx_char (buf[i]);
+        }
+    }
+}
+
+// Receive up to "len" bytes; returns the number of bytes received before
+// "timeout_ms" expired. Bytes already received are returned even when
+// "timeout_ms" is 0; the buffer callback must do the same
+int a_read (unsigned char *buf, int len, int timeout_ms)
+{
+    struct flash_session_t *session = Current_session();
+    int num_read = 0;
+    int rx;
+    struct deadline_t deadline;
+
+    if (session->transport.rx_buffer != 0)
+    {
+        num_read = session->transport.rx_buffer (buf, len, timeout_ms);
+        if (num_read > 0)
+        {
+            session->rx_bytes += num_read;
+        }
+        return num_read;
+    }
+
+    /* each empty poll of the character callback blocks for up to
+    RX_CHAR_POLL_MS, so the clock is checked between polls */
+    Start_deadline (&deadline, timeout_ms);
+    while (num_read < len)
+    {
+        rx = session->transport.rx_char();
+        if (rx != -1)
+        {
+            buf[num_read++] = (unsigned char)rx;
+        }
+        else if (Deadline_remaining_ms (&deadline) == 0)
+        {
+            break;
+        }
+    }
+    session->rx_bytes += num_read;
+    return num_read;
+}
+
+// Wait until all bytes written have left the PC
+void a_flush (void)
+{
+    struct flash_session_t *session = Current_session();
+
+    if (session->transport.flush != 0)
+    {
+        session->transport.flush();
+    }
+}
+
+// Change the baud rate of the open serial port; FALSE if .NET can't
+int a_set_baud (long baud)
+{
+    struct flash_session_t *session = Current_session();
+
+    if (session->transport.set_baud == 0)
+    {
+        return 0;
+    }
+    session->transport.set_baud ((int)baud);
+    return 1;
+}
+
+// Bytes written to and read from the port of the current session; only
+// differences are meaningful
+void a_byte_counts (unsigned long *tx_bytes, unsigned long *rx_bytes)
+{
+    struct flash_session_t *session = Current_session();
+
+    *tx_bytes = session->tx_bytes;
+    *rx_bytes = session->rx_bytes;
 }
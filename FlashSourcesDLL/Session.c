@@ -0,0 +1,400 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Session.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : Init_session
+*               Current_session
+*               Set_current_session
+*               Phase_printf
+*               Run_session
+*               Clear_port_results
+*               Set_port_result
+*               GetPortResult
+*
+*  Abstract   : Flashing of one board. Everything that belongs to a board
+*               (serial port callbacks, byte counters, benchmark report,
+*               CRC read back, result) is held in a flash_session_t, and
+*               each thread works on its own session, so several boards
+*               can be flashed by one process at the same time (Gang.c).
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Phase lines left off the console in a gang (Phase_printf)
+**************************************************************************/
+
+#include <stdarg.h>
+
+#include "include.h"
+
+/* Session of the calling thread */
+static THREAD_LOCAL struct flash_session_t *current_session;
+
+/* Result of every COM port in the last FlashMain; PORT_NOT_FLASHED if the
+port was not used */
+static int port_result[MAX_COM_PORT + 1];
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Init_session
+*
+*  ABSTRACT:
+*     Prepares the session of one COM port
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       session         struct flash_session_t *
+*       com_port        int             1 ... MAX_COM_PORT
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Takes the serial callbacks registered for the port (Port_transport)
+*   and clears everything else.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Init_session (struct flash_session_t *session, int com_port)
+{
+    memset (session, 0, sizeof (struct flash_session_t));
+    session->com_port = com_port;
+    session->gang = FALSE;
+    session->result = PORT_NOT_FLASHED;
+    Port_transport (com_port, &session->transport);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Current_session
+*
+*  ABSTRACT:
+*     Session of the calling thread
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       struct flash_session_t *    set by Set_current_session
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The serial port wrappers (a_putc ...) and the benchmark report work
+*   on this session, so the protocol code needs no extra parameter.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+struct flash_session_t *Current_session (void)
+{
+    return (current_session);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Set_current_session
+*
+*  ABSTRACT:
+*     Selects the session of the calling thread
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       session         struct flash_session_t *
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Set_current_session (struct flash_session_t *session)
+{
+    current_session = session;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Phase_printf
+*
+*  ABSTRACT:
+*     Writes a line of the progress of a session to the console
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       format          const char *    printf format
+*       ...                             printf arguments
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Used for the "\t> ..." lines of every phase and the word that
+*   completes them. In a gang nothing is written: every board's thread
+*   would write its lines into the others' on the one console, and
+*   Flash_gang shows the result of each board at the end. Errors are still
+*   written with printf; Run_session names the COM port with the error
+*   code.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Phase_printf (const char *format, ...)
+{
+    va_list args;
+
+    if ((current_session != NULL) && (current_session->gang == TRUE))
+    {
+        return;
+    }
+
+    va_start (args, format);
+    vprintf (format, args);
+    va_end (args);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Run_session
+*
+*  ABSTRACT:
+*     Flashes the board on the COM port of a session
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       session         struct flash_session_t *
+*       files           struct file_info_t      command line options
+*       app             const struct application_t *  parsed application;
+*                                               only read
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int     FlashMain error code; also in session->result
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Opens the port at the boot strap loader baud rate, sends the three
+*   boot loader stages (unless stage3 is still running) and then programs
+*   the application. Boot loader
+*   errors are reported as 100 + code, programming errors as 200 + code.
+*     Runs on the calling thread; Flash_gang calls it from one thread per
+*   board. The result is also posted to the host (EVENT_RESULT).
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created from FlashMain
+* Revised :
+*  17 Oct 2026
+*     Stage3 left running by an earlier session reused
+*  17 Oct 2026
+*     Result posted as an event
+******************************************************************************/
+int Run_session (struct flash_session_t *session, struct file_info_t files,
+                 const struct application_t *app)
+{
+    struct hex_image_t changed; /* sectors reprogrammed by a delta download */
+    long logic_baud;            /* rate stage3 runs at */
+    unsigned long start_ms;
+    int rc;
+
+    Set_current_session (session);
+    a_init_com (files.boot_baud);
+
+    start_ms = Ms_clock();
+    Report_init();
+    Report_add (PHASE_HEX_PARSE, app->parse_ms, app->parsed_bytes);
+    Report_link (files.boot_baud, files.boot_baud);
+
+    Init_hex_image (&changed);
+
+    /* Load the boot loader files in RAM */
+    rc = Boot_strap_loader_monitor (files, &logic_baud);
+    if (rc)
+    {
+        rc += 100;
+    }
+    else
+    {
+        /* a stage3 left at the download rate by an earlier session needs
+        no switch */
+        if (logic_baud != files.boot_baud)
+        {
+            files.boot_baud = logic_baud;
+            Report_link (logic_baud, logic_baud);
+        }
+
+        /* Program the application to FLASH */
+        rc = Flash_monitor_image (files, app, session->crc_string, &changed);
+        if (rc)
+        {
+            rc += 200;
+        }
+    }
+    Free_hex_image (&changed);
+
+    if (rc)
+    {
+        printf ("\n**** Report Error code %d ", rc);
+        if (session->gang == TRUE)
+        {
+            printf ("on COM%d ", session->com_port);
+        }
+        printf ("\n**** Program aborted.\n");
+    }
+
+    Report_finish();
+    session->elapsed_ms = Ms_clock() - start_ms;
+    session->result = rc;
+    Set_port_result (session->com_port, rc);
+    Post_event (session->com_port, EVENT_RESULT, rc, NULL);
+
+    return (rc);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Clear_port_results
+*
+*  ABSTRACT:
+*     Marks every COM port as not flashed
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Called at the start of FlashMain.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Clear_port_results (void)
+{
+    int i;
+
+    for (i = 0; i <= MAX_COM_PORT; i++)
+    {
+        port_result[i] = PORT_NOT_FLASHED;
+    }
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Set_port_result
+*
+*  ABSTRACT:
+*     Records the FlashMain error code of one COM port
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       com_port        int
+*       result          int         0 if the board was flashed
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Each board of a gang writes only its own entry.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Set_port_result (int com_port, int result)
+{
+    if ((com_port >= 1) && (com_port <= MAX_COM_PORT))
+    {
+        port_result[com_port] = result;
+    }
+}
+
+
+// Result of "comPort" in the last FlashMain: 0 if the board was flashed,
+// the error code if not, PORT_NOT_FLASHED if the port was not in the list
+__declspec (dllexport) int GetPortResult (int comPort)
+{
+    if ((comPort < 1) || (comPort > MAX_COM_PORT))
+    {
+        return (PORT_NOT_FLASHED);
+    }
+    return (port_result[comPort]);
+}
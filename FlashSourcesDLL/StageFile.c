@@ -5,9 +5,19 @@
 *  Project    : C167 FLASH Programming
 *  File Name  : StageFile.c
 *  Subsystem  : PC (MS-DOS)
-*  Procedures :
+*  Procedures : CopyStage1HexData
+*               CopyStage2HexData
+*               CopyStage3HexData
+*               GetStage1
+*               GetStage2
+*               GetStage3
+*               Get_stage_image
+*               Copy_stage
+*               Decode_stage
 *
-*  Abstract   : Used to interface between pre .NET code and .NET code
+*  Abstract   : Used to interface between pre .NET code and .NET code.
+*               Each stage is decoded to a binary image once, when .NET
+*               hands it over, and every session sends that image.
 *  Compiler   :
 *
 *  EPROM Drawing:
@@ -17,6 +27,10 @@
 *  01 Nov 2014 D.Smail
 *    Created
 * Revised:
+*  17 Oct 2026
+*    Stages decoded once and kept as binary images
+*  17 Oct 2026
+*    A stage too long for its copy is rejected instead of overrunning it
 **************************************************************************/
 
 #include "INCLUDE.H"
@@ -25,17 +39,25 @@ static char stage1[100];
 static char stage2[500];
 static char stage3[20000];
 
+/* Binary images of stage1 ... stage3; valid when stage_decoded is TRUE */
+static struct hex_image_t stage_image[3];
+static unsigned char stage_decoded[3];
+
+static void Copy_stage (int index, char *copy, size_t copy_size,
+                        const char *hex);
+static void Decode_stage (int index, const char *hex);
+
 __declspec (dllexport) void __stdcall CopyStage1HexData (char* aString, long int aSize)
 {
-    strcpy (stage1, aString);
+    Copy_stage (0, stage1, sizeof (stage1), aString);
 }
 __declspec (dllexport) void __stdcall CopyStage2HexData (char* aString, long int aSize)
 {
-    strcpy (stage2, aString);
+    Copy_stage (1, stage2, sizeof (stage2), aString);
 }
 __declspec (dllexport) void __stdcall CopyStage3HexData (char* aString, long int aSize)
 {
-    strcpy (stage3, aString);
+    Copy_stage (2, stage3, sizeof (stage3), aString);
 }
 
 char *GetStage1 (void)
@@ -52,3 +74,141 @@ char *GetStage3 (void)
 {
     return stage3;
 }
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Get_stage_image
+*
+*  ABSTRACT:
+*     Binary image of a boot loader stage
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       stage           int         1, 2 or 3
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       const struct hex_image_t *  NULL if the stage was not handed over
+*                                   or is not valid Intel Hex
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The images are only read once decoded, so every board of a gang sends
+*   the same ones.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+const struct hex_image_t *Get_stage_image (int stage)
+{
+    if ((stage < 1) || (stage > 3) || (stage_decoded[stage - 1] == FALSE))
+    {
+        return (NULL);
+    }
+    return (&stage_image[stage - 1]);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Copy_stage
+*
+*  ABSTRACT:
+*     Keeps the Intel Hex of a boot loader stage and decodes it
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       index           int             0 ... 2
+*       copy            char *          stage1 ... stage3
+*       copy_size       size_t          bytes in copy
+*       hex             const char *    Intel Hex resource
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     A resource that does not fit is not copied and the stage is left
+*   undecoded, so Boot_strap_loader_monitor reports it (errors 4 ... 6).
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+static void Copy_stage (int index, char *copy, size_t copy_size,
+                        const char *hex)
+{
+    if (strlen (hex) >= copy_size)
+    {
+        copy[0] = '\0';
+        Free_hex_image (&stage_image[index]);
+        stage_decoded[index] = FALSE;
+        return;
+    }
+
+    strcpy (copy, hex);
+    Decode_stage (index, copy);
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Decode_stage
+*
+*  ABSTRACT:
+*     Converts a boot loader stage from Intel Hex to a binary image
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       index           int             0 ... 2
+*       hex             const char *    Intel Hex resource
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Replaces the image of an earlier copy. Called by the CopyStage
+*   exports, before FlashMain runs, so no session is reading the image.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created from Boot_strap_loader_monitor
+* Revised :
+******************************************************************************/
+static void Decode_stage (int index, const char *hex)
+{
+    /* a zeroed image is an empty one */
+    Free_hex_image (&stage_image[index]);
+
+    stage_decoded[index] = FALSE;
+    if (Parse_hex_file ((char *)hex, NULL, &stage_image[index]) == 0)
+    {
+        stage_decoded[index] = TRUE;
+    }
+    else
+    {
+        Free_hex_image (&stage_image[index]);
+    }
+}
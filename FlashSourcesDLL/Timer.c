@@ -0,0 +1,417 @@
+/***************************************************************************
+*.b
+*  Copyright (c) 2000-2013 Bombardier Transportation
+****************************************************************************
+*  Project    : C167 FLASH Programming
+*  File Name  : Timer.c
+*  Subsystem  : PC (MS-DOS)
+*  Procedures : Ms_clock
+*               Set_ms_clock
+*               Start_deadline
+*               Deadline_remaining_ms
+*               Read_byte_deadline
+*               Pace_us
+*               Set_us_delay
+*
+*  Abstract   : Millisecond timeouts for the serial protocol. Every wait for
+*               the Logic is a blocking read bounded by a deadline on a
+*               monotonic clock, instead of a poll of a_getc() against
+*               time() (one second steps, one core kept busy).
+*  Compiler   :
+*
+*  EPROM Drawing:
+*.b
+*****************************************************************************
+* History:
+*  17 Oct 2026
+*    Created
+* Revised:
+*  17 Oct 2026
+*    Millisecond clock read from the performance counter on Windows
+**************************************************************************/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "include.h"
+
+/* Clock used for every deadline; NULL selects Default_ms_clock */
+static MsClockFnPtr msClockPtr;
+
+/* Replaces the wait in Pace_us when set */
+static UsDelayFnPtr usDelayPtr;
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Default_ms_clock
+*
+*  ABSTRACT:
+*     Monotonic millisecond clock of the operating system
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned long   msecs since an arbitrary start; wraps
+*
+*  FUNCTIONAL DESCRIPTION:
+*     The performance counter on Windows, as in Pace_us; GetTickCount only
+*   moves every 10 to 16 ms, which is longer than many of the per block
+*   times of the benchmark report. CLOCK_MONOTONIC elsewhere. Neither moves
+*   when the wall clock is set. Deadlines only use differences, so wrapping
+*   does not matter. The counter is split into whole seconds and the rest
+*   so the scaling does not overflow.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+*  17 Oct 2026
+*     Performance counter instead of GetTickCount
+******************************************************************************/
+static unsigned long Default_ms_clock (void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;     /* counts per second; fixed at boot */
+    LARGE_INTEGER now;
+
+    if ((frequency.QuadPart == 0) && !QueryPerformanceFrequency (&frequency))
+    {
+        return ((unsigned long)GetTickCount());
+    }
+
+    QueryPerformanceCounter (&now);
+    return ((unsigned long) ((now.QuadPart / frequency.QuadPart) * 1000 +
+                             ((now.QuadPart % frequency.QuadPart) * 1000) /
+                             frequency.QuadPart));
+#else
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return ((unsigned long)now.tv_sec * 1000UL +
+            (unsigned long) (now.tv_nsec / 1000000L));
+#endif
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Ms_clock
+*
+*  ABSTRACT:
+*     Reads the millisecond clock
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       None
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       unsigned long   msecs since an arbitrary start; wraps
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Reads the clock installed by Set_ms_clock, or the operating system
+*   clock when none is installed.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+unsigned long Ms_clock (void)
+{
+    if (msClockPtr != NULL)
+    {
+        return (msClockPtr());
+    }
+    return (Default_ms_clock());
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Set_ms_clock
+*
+*  ABSTRACT:
+*     Replaces the millisecond clock
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       clock_fn        MsClockFnPtr    new clock; NULL restores the default
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Lets a host that simulates the Logic run the protocol against its own
+*   time base.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Set_ms_clock (MsClockFnPtr clock_fn)
+{
+    msClockPtr = clock_fn;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Start_deadline
+*
+*  ABSTRACT:
+*     Starts a timeout
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       deadline        struct deadline_t *     timeout to start
+*       timeout_ms      long                    msecs from now
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Start_deadline (struct deadline_t *deadline, long timeout_ms)
+{
+    deadline->start_ms = Ms_clock();
+    deadline->timeout_ms = (timeout_ms > 0) ? (unsigned long)timeout_ms : 0;
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Deadline_remaining_ms
+*
+*  ABSTRACT:
+*     Time left before a timeout expires
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       deadline        struct deadline_t *     started timeout
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           msecs left; 0 once expired
+*
+*  FUNCTIONAL DESCRIPTION:
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+int Deadline_remaining_ms (const struct deadline_t *deadline)
+{
+    unsigned long elapsed;
+
+    elapsed = Ms_clock() - deadline->start_ms;
+    if (elapsed >= deadline->timeout_ms)
+    {
+        return (0);
+    }
+    return ((int) (deadline->timeout_ms - elapsed));
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Read_byte_deadline
+*
+*  ABSTRACT:
+*     Waits for one byte from the Logic until a timeout expires
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       byte            unsigned char *         received byte
+*       deadline        struct deadline_t *     started timeout
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       int           1 if a byte was received, 0 if the timeout expired
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Blocks in a_read() for at most the time left, so the thread sleeps
+*   until the byte arrives. Used in loops that skip unwanted bytes: the
+*   total wait stays bounded however many bytes are skipped.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+int Read_byte_deadline (unsigned char *byte, const struct deadline_t *deadline)
+{
+    int remaining_ms;
+
+    remaining_ms = Deadline_remaining_ms (deadline);
+    if (remaining_ms == 0)
+    {
+        return (0);
+    }
+    return (a_read (byte, 1, remaining_ms));
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Pace_us
+*
+*  ABSTRACT:
+*     Waits a number of microseconds
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       pace_us         unsigned long   microseconds
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Spaces the bytes sent to the boot strap loader and the first stage
+*   loader, which have no flow control. Replaces a fixed count loop whose
+*   length depended on the PC and the optimizer. Waits below a millisecond
+*   are timed with the performance counter; longer ones sleep. A delay
+*   installed by Set_us_delay is called instead.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Pace_us (unsigned long pace_us)
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER start;
+    LARGE_INTEGER now;
+    LONGLONG ticks;
+#endif
+
+    if (usDelayPtr != NULL)
+    {
+        usDelayPtr (pace_us);
+        return;
+    }
+
+#ifdef _WIN32
+    if (pace_us >= 1000)
+    {
+        Sleep ((DWORD) (pace_us / 1000));
+        pace_us %= 1000;
+    }
+
+    if ((pace_us == 0) || !QueryPerformanceFrequency (&frequency))
+    {
+        return;
+    }
+
+    ticks = (frequency.QuadPart * (LONGLONG)pace_us) / 1000000;
+    QueryPerformanceCounter (&start);
+    do
+    {
+        QueryPerformanceCounter (&now);
+    }
+    while ((now.QuadPart - start.QuadPart) < ticks);
+#else
+    if (pace_us != 0)
+    {
+        usleep ((useconds_t)pace_us);
+    }
+#endif
+}
+
+
+/*****************************************************************************
+*
+* .b
+*
+*  PROCEDURE NAME: Set_us_delay
+*
+*  ABSTRACT:
+*     Replaces the wait of Pace_us
+*
+*  INPUTS:
+*
+*     Procedure Parameters:
+*       delay_fn        UsDelayFnPtr    new delay; NULL restores the default
+*
+*  OUTPUTS:
+*
+*     Returned Value:
+*       None
+*
+*  FUNCTIONAL DESCRIPTION:
+*     Companion of Set_ms_clock: a simulated Logic advances its own clock
+*   rather than letting the PC wait.
+*
+* .b
+*
+* History :
+*  17 Oct 2026
+*     Created
+* Revised :
+******************************************************************************/
+void Set_us_delay (UsDelayFnPtr delay_fn)
+{
+    usDelayPtr = delay_fn;
+}